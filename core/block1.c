@@ -46,83 +46,220 @@
 #include <string.h>
 #include <stdio.h>
 
-// the maximum payload transferred by block1 we accumulate per server
-#define MAX_BLOCK1_SIZE 4096
+// initial allocation, in blocks, when the peer does not announce the total size
+#define BLOCK1_INITIAL_BLOCKS 4
+
+static lwm2m_block1_data_t * prv_findTransfer(lwm2m_block1_data_t * block1Data,
+                                              coap_packet_t * message)
+{
+    while (block1Data != NULL
+        && (block1Data->code != message->code
+         || !uri_matchPath(block1Data->uri, message->uri_path)))
+    {
+        block1Data = block1Data->next;
+    }
+
+    return block1Data;
+}
+
+static void prv_freeTransfer(lwm2m_block1_data_t * block1Data)
+{
+    lwm2m_free(block1Data->uri);
+    lwm2m_free(block1Data->block1buffer);
+    lwm2m_free(block1Data);
+}
+
+static void prv_removeTransfer(lwm2m_block1_data_t ** pBlock1Data,
+                               lwm2m_block1_data_t * block1Data)
+{
+    while (*pBlock1Data != block1Data)
+    {
+        pBlock1Data = &(*pBlock1Data)->next;
+    }
+    *pBlock1Data = block1Data->next;
+    prv_freeTransfer(block1Data);
+}
+
+static lwm2m_block1_data_t * prv_newTransfer(lwm2m_block1_data_t ** pBlock1Data,
+                                             coap_packet_t * message)
+{
+    lwm2m_block1_data_t * block1Data;
+    lwm2m_block1_data_t * oldestP;
+    int count;
+
+    // make room by dropping the least recently active transfer
+    count = 0;
+    oldestP = NULL;
+    for (block1Data = *pBlock1Data ; block1Data != NULL ; block1Data = block1Data->next)
+    {
+        count++;
+        if (oldestP == NULL || block1Data->lastActivity <= oldestP->lastActivity)
+        {
+            oldestP = block1Data;
+        }
+    }
+    if (count >= LWM2M_BLOCK1_MAX_TRANSFERS)
+    {
+        LOG_ARG("Dropping Block1 transfer to %s", oldestP->uri);
+        prv_removeTransfer(pBlock1Data, oldestP);
+    }
+
+    block1Data = (lwm2m_block1_data_t *)lwm2m_malloc(sizeof(lwm2m_block1_data_t));
+    if (block1Data == NULL) return NULL;
+    memset(block1Data, 0, sizeof(lwm2m_block1_data_t));
+
+    block1Data->uri = coap_get_multi_option_as_string(message->uri_path);
+    if (block1Data->uri == NULL)
+    {
+        lwm2m_free(block1Data);
+        return NULL;
+    }
+    block1Data->code = message->code;
+
+    block1Data->next = *pBlock1Data;
+    *pBlock1Data = block1Data;
+
+    return block1Data;
+}
+
+static bool prv_reserve(lwm2m_block1_data_t * block1Data,
+                        size_t capacity)
+{
+    uint8_t * buffer;
+
+    if (capacity <= block1Data->block1bufferCapacity) return true;
+
+    // data is appended in place, reallocate only when the buffer is full
+    buffer = (uint8_t *)lwm2m_malloc(capacity);
+    if (buffer == NULL) return false;
+    if (block1Data->block1bufferSize != 0)
+    {
+        memcpy(buffer, block1Data->block1buffer, block1Data->block1bufferSize);
+    }
+    lwm2m_free(block1Data->block1buffer);
+    block1Data->block1buffer = buffer;
+    block1Data->block1bufferCapacity = capacity;
+
+    return true;
+}
 
 coap_status_t coap_block1_handler(lwm2m_block1_data_t ** pBlock1Data,
-                                  uint16_t mid,
-                                  uint8_t * buffer,
-                                  size_t length,
-                                  uint16_t blockSize,
-                                  uint32_t blockNum,
-                                  bool blockMore,
+                                  coap_packet_t * message,
+                                  time_t currentTime,
                                   uint8_t ** outputBuffer,
                                   size_t * outputLength)
 {
-    lwm2m_block1_data_t * block1Data = *pBlock1Data;;
+    lwm2m_block1_data_t * block1Data;
+    uint32_t blockNum;
+    uint8_t blockMore;
+    uint16_t blockSize;
+    uint32_t size1;
+    size_t length;
+
+    coap_get_header_block1(message, &blockNum, &blockMore, &blockSize, NULL);
+    length = message->payload_len;
+
+    // RFC 7959 allows the token to change between blocks so transfers are identified by method and URI
+    block1Data = prv_findTransfer(*pBlock1Data, message);
 
     // manage new block1 transfer
     if (blockNum == 0)
     {
-       // we already have block1 data for this server, clear it
-       if (block1Data != NULL)
-       {
-           lwm2m_free(block1Data->block1buffer);
-       }
-       else
-       {
-           block1Data = lwm2m_malloc(sizeof(lwm2m_block1_data_t));
-           *pBlock1Data = block1Data;
-           if (NULL == block1Data) return COAP_500_INTERNAL_SERVER_ERROR;
-       }
-
-       block1Data->block1buffer = lwm2m_malloc(length);
-       block1Data->block1bufferSize = length;
-
-       // write new block in buffer
-       memcpy(block1Data->block1buffer, buffer, length);
-       block1Data->lastmid = mid;
+        size_t capacity;
+
+        if (block1Data != NULL && block1Data->lastmid == message->mid && block1Data->block1bufferSize == length)
+        {
+            // retransmission of the first block
+            block1Data->lastActivity = currentTime;
+        }
+        else
+        {
+            if (coap_get_header_size1(message, &size1))
+            {
+                if (size1 > LWM2M_BLOCK1_MAX_SIZE)
+                {
+                    if (block1Data != NULL) prv_removeTransfer(pBlock1Data, block1Data);
+                    return COAP_413_ENTITY_TOO_LARGE;
+                }
+                capacity = size1;
+            }
+            else
+            {
+                capacity = blockMore ? (size_t)blockSize * BLOCK1_INITIAL_BLOCKS : length;
+            }
+            if (capacity < length) capacity = length;
+
+            // we already have a transfer for this resource, restart it reusing its buffer
+            if (block1Data == NULL)
+            {
+                block1Data = prv_newTransfer(pBlock1Data, message);
+                if (block1Data == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+            }
+            block1Data->block1bufferSize = 0;
+            if (!prv_reserve(block1Data, capacity))
+            {
+                prv_removeTransfer(pBlock1Data, block1Data);
+                return COAP_500_INTERNAL_SERVER_ERROR;
+            }
+
+            // write new block in buffer
+            memcpy(block1Data->block1buffer, message->payload, length);
+            block1Data->block1bufferSize = length;
+            block1Data->lastmid = message->mid;
+            block1Data->lastActivity = currentTime;
+        }
     }
     // manage already started block1 transfer
     else
     {
-       if (block1Data == NULL)
-       {
-           // we never receive the first block
-           // TODO should we clean block1 data for this server ?
-           return COAP_408_REQ_ENTITY_INCOMPLETE;
-       }
-
-       // If this is a retransmission, we already did that.
-       if (block1Data->lastmid != mid)
-       {
-          uint8_t * oldBuffer = block1Data->block1buffer;
-          size_t oldSize = block1Data->block1bufferSize;
-
-          if (block1Data->block1bufferSize != blockSize * blockNum)
-          {
-              // we don't receive block in right order
-              // TODO should we clean block1 data for this server ?
-              return COAP_408_REQ_ENTITY_INCOMPLETE;
-          }
-
-          // is it too large?
-          if (block1Data->block1bufferSize + length >= MAX_BLOCK1_SIZE) {
-              return COAP_413_ENTITY_TOO_LARGE;
-          }
-          // re-alloc new buffer
-          block1Data->block1bufferSize = oldSize+length;
-          block1Data->block1buffer = lwm2m_malloc(block1Data->block1bufferSize);
-          if (NULL == block1Data->block1buffer) return COAP_500_INTERNAL_SERVER_ERROR;
-          memcpy(block1Data->block1buffer, oldBuffer, oldSize);
-          lwm2m_free(oldBuffer);
-
-          // write new block in buffer
-          memcpy(block1Data->block1buffer + oldSize, buffer, length);
-          block1Data->lastmid = mid;
-       }
+        if (block1Data == NULL)
+        {
+            // we never receive the first block
+            return COAP_408_REQ_ENTITY_INCOMPLETE;
+        }
+
+        // If this is a retransmission, we already did that.
+        if (block1Data->lastmid != message->mid)
+        {
+            size_t needed;
+
+            if (block1Data->block1bufferSize != (size_t)blockSize * blockNum)
+            {
+                // we don't receive block in right order, the peer has to restart from the first block
+                prv_removeTransfer(pBlock1Data, block1Data);
+                return COAP_408_REQ_ENTITY_INCOMPLETE;
+            }
+
+            // is it too large?
+            needed = block1Data->block1bufferSize + length;
+            if (needed > LWM2M_BLOCK1_MAX_SIZE)
+            {
+                prv_removeTransfer(pBlock1Data, block1Data);
+                return COAP_413_ENTITY_TOO_LARGE;
+            }
+            if (needed > block1Data->block1bufferCapacity)
+            {
+                size_t capacity;
+
+                capacity = block1Data->block1bufferCapacity * 2;
+                if (capacity < needed) capacity = needed;
+                if (capacity > LWM2M_BLOCK1_MAX_SIZE) capacity = LWM2M_BLOCK1_MAX_SIZE;
+                if (!prv_reserve(block1Data, capacity))
+                {
+                    prv_removeTransfer(pBlock1Data, block1Data);
+                    return COAP_500_INTERNAL_SERVER_ERROR;
+                }
+            }
+
+            // write new block in buffer
+            memcpy(block1Data->block1buffer + block1Data->block1bufferSize, message->payload, length);
+            block1Data->block1bufferSize = needed;
+            block1Data->lastmid = message->mid;
+        }
+        block1Data->lastActivity = currentTime;
     }
 
+    block1Data->complete = !blockMore;
     if (blockMore)
     {
         *outputLength = -1;
@@ -139,15 +276,39 @@ coap_status_t coap_block1_handler(lwm2m_block1_data_t ** pBlock1Data,
     }
 }
 
+void block1_step(lwm2m_block1_data_t ** pBlock1Data,
+                 time_t currentTime,
+                 time_t * timeoutP)
+{
+    while (*pBlock1Data != NULL)
+    {
+        lwm2m_block1_data_t * block1Data = *pBlock1Data;
+        time_t interval;
+
+        // completed transfers are only kept to answer retransmissions of the last block
+        interval = block1Data->lastActivity - currentTime
+                 + (block1Data->complete ? (time_t)COAP_MAX_TRANSMIT_SPAN : (time_t)LWM2M_BLOCK1_TIMEOUT);
+        if (interval <= 0)
+        {
+            LOG_ARG("Block1 transfer to %s timed out", block1Data->uri);
+            *pBlock1Data = block1Data->next;
+            prv_freeTransfer(block1Data);
+        }
+        else
+        {
+            if (interval < *timeoutP) *timeoutP = interval;
+            pBlock1Data = &block1Data->next;
+        }
+    }
+}
+
 void free_block1_buffer(lwm2m_block1_data_t * block1Data)
 {
-    if (block1Data != NULL)
+    while (block1Data != NULL)
     {
-        // free block1 buffer
-        lwm2m_free(block1Data->block1buffer);
-        block1Data->block1bufferSize = 0 ;
+        lwm2m_block1_data_t * nextP = block1Data->next;
 
-        // free current element
-        lwm2m_free(block1Data);
+        prv_freeTransfer(block1Data);
+        block1Data = nextP;
     }
 }
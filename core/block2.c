@@ -0,0 +1,181 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Cache of the serialized responses to reads retrieved with Block2.
+ *
+ * The first block of a read always runs the request and, if the response does
+ * not fit in one block, stores its payload here. The following blocks are then
+ * sliced out of the stored payload instead of reading and serializing the
+ * objects again, which also keeps the blocks of one transfer consistent.
+ */
+
+#include "internals.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int32_t prv_getAccept(coap_packet_t * message)
+{
+    if (IS_OPTION(message, COAP_OPTION_ACCEPT) && message->accept_num > 0)
+    {
+        return message->accept[0];
+    }
+
+    return -1;
+}
+
+static void prv_freeResponse(lwm2m_block2_data_t * block2Data)
+{
+    lwm2m_free(block2Data->uri);
+    lwm2m_free(block2Data->buffer);
+    lwm2m_free(block2Data);
+}
+
+static void prv_removeResponse(lwm2m_block2_data_t ** pBlock2Data,
+                               lwm2m_block2_data_t * block2Data)
+{
+    while (*pBlock2Data != block2Data)
+    {
+        pBlock2Data = &(*pBlock2Data)->next;
+    }
+    *pBlock2Data = block2Data->next;
+    prv_freeResponse(block2Data);
+}
+
+lwm2m_block2_data_t * block2_find(lwm2m_block2_data_t * block2Data,
+                                  coap_packet_t * message,
+                                  time_t currentTime)
+{
+    int32_t accept;
+
+    accept = prv_getAccept(message);
+    while (block2Data != NULL
+        && (block2Data->accept != accept
+         || !uri_matchPath(block2Data->uri, message->uri_path)))
+    {
+        block2Data = block2Data->next;
+    }
+
+    if (block2Data != NULL)
+    {
+        block2Data->lastActivity = currentTime;
+    }
+
+    return block2Data;
+}
+
+/*
+ * Takes ownership of buffer.
+ */
+void block2_store(lwm2m_block2_data_t ** pBlock2Data,
+                  coap_packet_t * message,
+                  coap_packet_t * response,
+                  uint8_t * buffer,
+                  size_t length,
+                  time_t currentTime)
+{
+    lwm2m_block2_data_t * block2Data;
+    lwm2m_block2_data_t * oldestP;
+    int count;
+
+    // a new read of the same resource replaces the previous response
+    block2Data = block2_find(*pBlock2Data, message, currentTime);
+    if (block2Data != NULL)
+    {
+        prv_removeResponse(pBlock2Data, block2Data);
+    }
+
+    count = 0;
+    oldestP = NULL;
+    for (block2Data = *pBlock2Data ; block2Data != NULL ; block2Data = block2Data->next)
+    {
+        count++;
+        if (oldestP == NULL || block2Data->lastActivity <= oldestP->lastActivity)
+        {
+            oldestP = block2Data;
+        }
+    }
+    if (count >= LWM2M_BLOCK2_MAX_RESPONSES)
+    {
+        prv_removeResponse(pBlock2Data, oldestP);
+    }
+
+    block2Data = (lwm2m_block2_data_t *)lwm2m_malloc(sizeof(lwm2m_block2_data_t));
+    if (block2Data == NULL) goto error;
+    memset(block2Data, 0, sizeof(lwm2m_block2_data_t));
+
+    block2Data->uri = coap_get_multi_option_as_string(message->uri_path);
+    if (block2Data->uri == NULL)
+    {
+        lwm2m_free(block2Data);
+        goto error;
+    }
+    block2Data->accept = prv_getAccept(message);
+    block2Data->contentType = (uint16_t)response->content_type;
+    if (IS_OPTION(response, COAP_OPTION_ETAG))
+    {
+        block2Data->etagLen = MIN(response->etag_len, sizeof(block2Data->etag));
+        memcpy(block2Data->etag, response->etag, block2Data->etagLen);
+    }
+    block2Data->buffer = buffer;
+    block2Data->length = length;
+    block2Data->lastActivity = currentTime;
+
+    block2Data->next = *pBlock2Data;
+    *pBlock2Data = block2Data;
+    return;
+
+error:
+    // the following blocks will be built again from the objects
+    lwm2m_free(buffer);
+}
+
+void block2_step(lwm2m_block2_data_t ** pBlock2Data,
+                 time_t currentTime,
+                 time_t * timeoutP)
+{
+    while (*pBlock2Data != NULL)
+    {
+        lwm2m_block2_data_t * block2Data = *pBlock2Data;
+        time_t interval;
+
+        interval = block2Data->lastActivity + LWM2M_BLOCK2_TIMEOUT - currentTime;
+        if (interval <= 0)
+        {
+            LOG_ARG("Dropping cached response to %s", block2Data->uri);
+            *pBlock2Data = block2Data->next;
+            prv_freeResponse(block2Data);
+        }
+        else
+        {
+            if (interval < *timeoutP) *timeoutP = interval;
+            pBlock2Data = &block2Data->next;
+        }
+    }
+}
+
+void block2_free(lwm2m_block2_data_t * block2Data)
+{
+    while (block2Data != NULL)
+    {
+        lwm2m_block2_data_t * nextP = block2Data->next;
+
+        prv_freeResponse(block2Data);
+        block2Data = nextP;
+    }
+}
@@ -36,7 +36,7 @@ static void prv_handleResponse(lwm2m_server_t * bootstrapServer,
     {
         LOG("Received ACK/2.04, Bootstrap pending, waiting for DEL/PUT from BS server...");
         bootstrapServer->status = STATE_BS_PENDING;
-        bootstrapServer->registration = lwm2m_gettime() + COAP_EXCHANGE_LIFETIME;
+        bootstrapServer->registration = utils_getTime() + COAP_EXCHANGE_LIFETIME;
     }
     else
     {
@@ -111,7 +111,7 @@ static void prv_requestBootstrap(lwm2m_context_t * context,
         coap_set_header_uri_query(transaction->message, query);
         transaction->callback = prv_handleBootstrapReply;
         transaction->userData = (void *)bootstrapServer;
-        context->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(context->transactionList, transaction);
+        transaction_add(context, transaction);
         if (transaction_send(context, transaction) == 0)
         {
             LOG("CI bootstrap requested to BS server");
@@ -307,7 +307,7 @@ static coap_status_t prv_checkServerStatus(lwm2m_server_t * serverP)
     case STATE_DEREGISTERED:
         // server initiated bootstrap
     case STATE_BS_PENDING:
-        serverP->registration = lwm2m_gettime() + COAP_EXCHANGE_LIFETIME;
+        serverP->registration = utils_getTime() + COAP_EXCHANGE_LIFETIME;
         break;
 
     case STATE_BS_FINISHED:
@@ -680,7 +680,7 @@ int lwm2m_bootstrap_delete(lwm2m_context_t * contextP,
     transaction->callback = prv_resultCallback;
     transaction->userData = (void *)dataP;
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
+    transaction_add(contextP, transaction);
 
     return transaction_send(contextP, transaction);
 }
@@ -723,7 +723,7 @@ int lwm2m_bootstrap_write(lwm2m_context_t * contextP,
     transaction->callback = prv_resultCallback;
     transaction->userData = (void *)dataP;
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
+    transaction_add(contextP, transaction);
 
     return transaction_send(contextP, transaction);
 }
@@ -753,7 +753,7 @@ int lwm2m_bootstrap_finish(lwm2m_context_t * contextP,
     transaction->callback = prv_resultCallback;
     transaction->userData = (void *)dataP;
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
+    transaction_add(contextP, transaction);
 
     return transaction_send(contextP, transaction);
 }
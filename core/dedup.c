@@ -0,0 +1,136 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Message deduplication as described in RFC 7252 section 4.5.
+ *
+ * The response to each confirmable request is kept for EXCHANGE_LIFETIME, the
+ * time during which the peer may retransmit the request with the same message
+ * ID. A retransmission is answered with the stored response instead of being
+ * handled again, so that executes and creates are not repeated when an
+ * acknowledgement is lost.
+ */
+
+#include "internals.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PRV_EXCHANGE_LIFETIME ((time_t)COAP_EXCHANGE_LIFETIME)
+
+static void prv_freeResponse(lwm2m_dedup_data_t * dedupData)
+{
+    lwm2m_free(dedupData->buffer);
+    lwm2m_free(dedupData);
+}
+
+lwm2m_dedup_data_t * dedup_find(lwm2m_dedup_data_t * dedupData,
+                                uint16_t mid,
+                                time_t currentTime)
+{
+    while (dedupData != NULL
+        && (dedupData->mid != mid || dedupData->expiry <= currentTime))
+    {
+        dedupData = dedupData->next;
+    }
+
+    return dedupData;
+}
+
+/*
+ * Copies buffer.
+ */
+void dedup_store(lwm2m_dedup_data_t ** pDedupData,
+                 uint16_t mid,
+                 uint8_t * buffer,
+                 size_t length,
+                 time_t currentTime)
+{
+    lwm2m_dedup_data_t ** nextP;
+    lwm2m_dedup_data_t * dedupData;
+    int count;
+
+    // entries are kept newest first: drop the ones past the limit
+    count = 1;
+    nextP = pDedupData;
+    while (*nextP != NULL)
+    {
+        dedupData = *nextP;
+        if (count >= LWM2M_DEDUP_MAX_RESPONSES || dedupData->mid == mid)
+        {
+            *nextP = dedupData->next;
+            prv_freeResponse(dedupData);
+        }
+        else
+        {
+            count++;
+            nextP = &dedupData->next;
+        }
+    }
+
+    dedupData = (lwm2m_dedup_data_t *)lwm2m_malloc(sizeof(lwm2m_dedup_data_t));
+    if (dedupData == NULL) return;
+    memset(dedupData, 0, sizeof(lwm2m_dedup_data_t));
+
+    dedupData->buffer = (uint8_t *)lwm2m_malloc(length);
+    if (dedupData->buffer == NULL)
+    {
+        lwm2m_free(dedupData);
+        return;
+    }
+    memcpy(dedupData->buffer, buffer, length);
+    dedupData->length = length;
+    dedupData->mid = mid;
+    dedupData->expiry = currentTime + PRV_EXCHANGE_LIFETIME;
+
+    dedupData->next = *pDedupData;
+    *pDedupData = dedupData;
+}
+
+void dedup_step(lwm2m_dedup_data_t ** pDedupData,
+                time_t currentTime,
+                time_t * timeoutP)
+{
+    while (*pDedupData != NULL)
+    {
+        lwm2m_dedup_data_t * dedupData = *pDedupData;
+        time_t interval;
+
+        interval = dedupData->expiry - currentTime;
+        if (interval <= 0)
+        {
+            *pDedupData = dedupData->next;
+            prv_freeResponse(dedupData);
+        }
+        else
+        {
+            if (interval < *timeoutP) *timeoutP = interval;
+            pDedupData = &dedupData->next;
+        }
+    }
+}
+
+void dedup_free(lwm2m_dedup_data_t * dedupData)
+{
+    while (dedupData != NULL)
+    {
+        lwm2m_dedup_data_t * nextP = dedupData->next;
+
+        prv_freeResponse(dedupData);
+        dedupData = nextP;
+    }
+}
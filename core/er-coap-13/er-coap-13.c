@@ -66,7 +66,6 @@
 static uint16_t current_mid = 0;
 
 coap_status_t coap_error_code = NO_ERROR;
-const char *coap_error_message = "";
 /*-----------------------------------------------------------------------------------*/
 /*- LOCAL HELP FUNCTIONS ------------------------------------------------------------*/
 /*-----------------------------------------------------------------------------------*/
@@ -229,6 +228,21 @@ coap_serialize_multi_option(unsigned int number, unsigned int current_number, ui
   return i;
 }
 /*-----------------------------------------------------------------------------------*/
+/* upper bound of the serialized size of a multi option */
+static
+size_t
+coap_multi_option_size(multi_option_t *array)
+{
+  size_t length = 0;
+
+  for (; array != NULL; array = array->next)
+  {
+    length += COAP_MAX_OPTION_HEADER_LEN + array->len;
+  }
+
+  return length;
+}
+/*-----------------------------------------------------------------------------------*/
 static
 void
 coap_merge_multi_option(uint8_t **dst, size_t *dst_len, uint8_t *option, size_t option_len, char separator)
@@ -295,10 +309,35 @@ coap_add_multi_option(multi_option_t **dst, uint8_t *option, size_t option_len,
   }
 }
 
+static void
+coap_add_multi_option_view(coap_packet_t *coap_pkt, multi_option_t **dst, uint8_t *option, size_t option_len)
+{
+  multi_option_t *opt;
+
+  if (coap_pkt->views == NULL || coap_pkt->views->count >= COAP_MAX_OPTION_VIEWS)
+  {
+    coap_add_multi_option(dst, option, option_len, 1);
+    return;
+  }
+
+  opt = coap_pkt->views->options + coap_pkt->views->count;
+  coap_pkt->views->count++;
+  opt->next = NULL;
+  opt->len = (uint8_t)option_len;
+  opt->data = option;
+  opt->is_static = 2;
+
+  while (*dst)
+  {
+    dst = &((*dst)->next);
+  }
+  *dst = opt;
+}
+
 void
 free_multi_option(multi_option_t *dst)
 {
-  if (dst)
+  while (dst)
   {
     multi_option_t *n = dst->next;
     dst->next = NULL;
@@ -306,8 +345,11 @@ free_multi_option(multi_option_t *dst)
     {
         lwm2m_free(dst->data);
     }
-    lwm2m_free(dst);
-    free_multi_option(n);
+    if (dst->is_static != 2)
+    {
+        lwm2m_free(dst);
+    }
+    dst = n;
   }
 }
 
@@ -513,6 +555,11 @@ size_t coap_serialize_get_size(void *packet)
     {
         length += COAP_MAX_OPTION_HEADER_LEN + coap_pkt->proxy_uri_len;
     }
+    if (IS_OPTION(coap_pkt, COAP_OPTION_SIZE1))
+    {
+        // can be stored in extended fields
+        length += COAP_MAX_OPTION_HEADER_LEN;
+    }
 
     if (coap_pkt->payload_len)
     {
@@ -526,11 +573,25 @@ size_t coap_serialize_get_size(void *packet)
 /*-----------------------------------------------------------------------------------*/
 size_t
 coap_serialize_message(void *packet, uint8_t *buffer)
+{
+  /* buffer is sized with coap_serialize_get_size() */
+  return coap_serialize_message_bounded(packet, buffer, SIZE_MAX);
+}
+
+/*
+ * Serializes in a single pass, checking the room left before each field.
+ * Returns 0 if the message does not fit in buffer_len bytes. The header is
+ * then left untouched so that the caller can retry with a larger buffer.
+ */
+size_t
+coap_serialize_message_bounded(void *packet, uint8_t *buffer, size_t buffer_len)
 {
   coap_packet_t *const coap_pkt = (coap_packet_t *) packet;
   uint8_t *option;
   unsigned int current_number = 0;
 
+  if (buffer_len < (size_t)COAP_HEADER_LEN + coap_pkt->token_len) return 0;
+
   /* Initialize */
   coap_pkt->buffer = buffer;
   coap_pkt->version = 1;
@@ -580,9 +641,15 @@ coap_serialize_message(void *packet, uint8_t *buffer)
   COAP_SERIALIZE_BLOCK_OPTION(  COAP_OPTION_BLOCK1,         block1, "Block1")
   COAP_SERIALIZE_INT_OPTION(    COAP_OPTION_SIZE,           size, "Size")
   COAP_SERIALIZE_STRING_OPTION( COAP_OPTION_PROXY_URI,      proxy_uri, '\0', "Proxy-Uri")
+  COAP_SERIALIZE_INT_OPTION(    COAP_OPTION_SIZE1,          size1, "Size1")
 
   PRINTF("-Done serializing at %p----\n", option);
 
+  if (coap_pkt->payload_len)
+  {
+    COAP_SERIALIZE_CHECK(1 + coap_pkt->payload_len)
+  }
+
   /* Free allocated header fields */
   coap_free_header(packet);
 
@@ -614,6 +681,17 @@ coap_serialize_message(void *packet, uint8_t *buffer)
 /*-----------------------------------------------------------------------------------*/
 coap_status_t
 coap_parse_message(void *packet, uint8_t *data, uint16_t data_len)
+{
+  return coap_parse_message_views(packet, data, data_len, NULL);
+}
+
+/*
+ * With views, the Uri-Path, Uri-Query and Location-Path options reference the
+ * datagram from nodes stored in views: parsing does no allocation.
+ * Both data and views must outlive the packet.
+ */
+coap_status_t
+coap_parse_message_views(void *packet, uint8_t *data, uint16_t data_len, coap_option_views_t *views)
 {
   coap_packet_t *const coap_pkt = (coap_packet_t *) packet;
   uint8_t *current_option;
@@ -627,6 +705,11 @@ coap_parse_message(void *packet, uint8_t *data, uint16_t data_len)
 
   /* pointer to packet bytes */
   coap_pkt->buffer = data;
+  coap_pkt->views = views;
+  if (views != NULL)
+  {
+    views->count = 0;
+  }
 
   /* parse header fields */
   coap_pkt->version = (COAP_HEADER_VERSION_MASK & coap_pkt->buffer[0])>>COAP_HEADER_VERSION_POSITION;
@@ -637,7 +720,7 @@ coap_parse_message(void *packet, uint8_t *data, uint16_t data_len)
 
   if (coap_pkt->version != 1)
   {
-    coap_error_message = "CoAP version must be 1";
+    coap_pkt->error_message = "CoAP version must be 1";
     return BAD_REQUEST_4_00;
   }
 
@@ -776,18 +859,18 @@ coap_parse_message(void *packet, uint8_t *data, uint16_t data_len)
       case COAP_OPTION_URI_PATH:
         /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
         // coap_merge_multi_option( (char **) &(coap_pkt->uri_path), &(coap_pkt->uri_path_len), current_option, option_length, 0);
-        coap_add_multi_option( &(coap_pkt->uri_path), current_option, option_length, 1);
+        coap_add_multi_option_view(coap_pkt, &(coap_pkt->uri_path), current_option, option_length);
         PRINTF("Uri-Path [%.*s]\n", option_length, current_option);
         break;
       case COAP_OPTION_URI_QUERY:
         /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
         // coap_merge_multi_option( (char **) &(coap_pkt->uri_query), &(coap_pkt->uri_query_len), current_option, option_length, '&');
-        coap_add_multi_option( &(coap_pkt->uri_query), current_option, option_length, 1);
+        coap_add_multi_option_view(coap_pkt, &(coap_pkt->uri_query), current_option, option_length);
         PRINTF("Uri-Query [%.*s]\n", option_length, current_option);
         break;
 
       case COAP_OPTION_LOCATION_PATH:
-        coap_add_multi_option( &(coap_pkt->location_path), current_option, option_length, 1);
+        coap_add_multi_option_view(coap_pkt, &(coap_pkt->location_path), current_option, option_length);
         break;
       case COAP_OPTION_LOCATION_QUERY:
         /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
@@ -801,7 +884,7 @@ coap_parse_message(void *packet, uint8_t *data, uint16_t data_len)
         coap_pkt->proxy_uri_len = option_length;
         /*TODO length > 270 not implemented (actually not required) */
         PRINTF("Proxy-Uri NOT IMPLEMENTED [%.*s]\n", coap_pkt->proxy_uri_len, coap_pkt->proxy_uri);
-        coap_error_message = "This is a constrained server (Contiki)";
+        coap_pkt->error_message = "This is a constrained server (Contiki)";
         return PROXYING_NOT_SUPPORTED_5_05;
         break;
 
@@ -829,12 +912,16 @@ coap_parse_message(void *packet, uint8_t *data, uint16_t data_len)
         coap_pkt->size = coap_parse_int_option(current_option, option_length);
         PRINTF("Size [%lu]\n", coap_pkt->size);
         break;
+      case COAP_OPTION_SIZE1:
+        coap_pkt->size1 = coap_parse_int_option(current_option, option_length);
+        PRINTF("Size1 [%lu]\n", coap_pkt->size1);
+        break;
       default:
         PRINTF("unknown (%u)\n", option_number);
         /* Check if critical (odd) */
         if (option_number & 1)
         {
-          coap_error_message = "Unsupported critical option";
+          coap_pkt->error_message = "Unsupported critical option";
           return BAD_OPTION_4_02;
         }
     }
@@ -1356,6 +1443,27 @@ coap_set_header_size(void *packet, uint32_t size)
   return 1;
 }
 /*-----------------------------------------------------------------------------------*/
+int
+coap_get_header_size1(void *packet, uint32_t *size)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *) packet;
+
+  if (!IS_OPTION(coap_pkt, COAP_OPTION_SIZE1)) return 0;
+
+  *size = coap_pkt->size1;
+  return 1;
+}
+
+int
+coap_set_header_size1(void *packet, uint32_t size)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *) packet;
+
+  coap_pkt->size1 = size;
+  SET_OPTION(coap_pkt, COAP_OPTION_SIZE1);
+  return 1;
+}
+/*-----------------------------------------------------------------------------------*/
 /*- PAYLOAD -------------------------------------------------------------------------*/
 /*-----------------------------------------------------------------------------------*/
 int
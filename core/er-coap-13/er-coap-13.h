@@ -48,6 +48,7 @@
 /*
  * The maximum buffer size that is provided for resource responses and must be respected due to the limited IP buffer.
  * Larger data must be handled by the resource and will be sent chunk-wise through a TCP stream or CoAP blocks.
+ * Also the default block size of liblwm2m, so it must be a power of two from 16 to LWM2M_MAX_BLOCK_SIZE.
  */
 #ifndef REST_MAX_CHUNK_SIZE
 #define REST_MAX_CHUNK_SIZE     128
@@ -101,6 +102,7 @@
 enum { OPTION_MAP_SIZE = sizeof(uint8_t) * 8 };
 #define SET_OPTION(packet, opt) ((packet)->options[opt / OPTION_MAP_SIZE] |= 1 << (opt % OPTION_MAP_SIZE))
 #define IS_OPTION(packet, opt) ((packet)->options[opt / OPTION_MAP_SIZE] & (1 << (opt % OPTION_MAP_SIZE)))
+#define UNSET_OPTION(packet, opt) ((packet)->options[opt / OPTION_MAP_SIZE] &= ~(1 << (opt % OPTION_MAP_SIZE)))
 
 #ifndef MIN
 #define MIN(a, b) ((a) < (b)? (a) : (b))
@@ -179,6 +181,7 @@ typedef enum {
   COAP_OPTION_BLOCK1 = 27,        /* 1-3 B */
   COAP_OPTION_SIZE = 28,          /* 0-4 B */
   COAP_OPTION_PROXY_URI = 35,     /* 1-270 B */
+  COAP_OPTION_SIZE1 = 60,         /* 0-4 B */
   OPTION_MAX_VALUE = 0xFFFF
 } coap_option_t;
 
@@ -209,6 +212,8 @@ typedef enum {
   CONTENT_MAX_VALUE = 0xFFFF
 } coap_content_type_t;
 
+/* is_static: 0 when data is allocated, 1 when data points into the message buffer,
+ * 2 when the node itself also belongs to a coap_option_views_t */
 typedef struct _multi_option_t {
   struct _multi_option_t *next;
   uint8_t is_static;
@@ -216,6 +221,17 @@ typedef struct _multi_option_t {
   uint8_t *data;
 } multi_option_t;
 
+#ifndef COAP_MAX_OPTION_VIEWS
+#define COAP_MAX_OPTION_VIEWS 16
+#endif
+
+/* Inline storage for the Uri-Path, Uri-Query and Location-Path options of a parsed message.
+ * Options beyond COAP_MAX_OPTION_VIEWS are allocated as usual. */
+typedef struct {
+  uint8_t count;
+  multi_option_t options[COAP_MAX_OPTION_VIEWS];
+} coap_option_views_t;
+
 /* Parsed message struct */
 typedef struct {
   uint8_t *buffer; /* pointer to CoAP header / incoming packet buffer / memory to serialize packet */
@@ -225,7 +241,7 @@ typedef struct {
   uint8_t code;
   uint16_t mid;
 
-  uint8_t options[COAP_OPTION_PROXY_URI / OPTION_MAP_SIZE + 1]; /* Bitmap to check if option is set */
+  uint8_t options[COAP_OPTION_SIZE1 / OPTION_MAP_SIZE + 1]; /* Bitmap to check if option is set */
 
   coap_content_type_t content_type; /* Parse options once and store; allows setting options in random order  */
   uint32_t max_age;
@@ -256,23 +272,32 @@ typedef struct {
   uint16_t block1_size;
   uint32_t block1_offset;
   uint32_t size;
+  uint32_t size1;
   multi_option_t *uri_query;
   uint8_t if_none_match;
 
   uint16_t payload_len;
   uint8_t *payload;
 
+  coap_option_views_t *views; /* storage for the parsed multi options, NULL to allocate them */
+
+  const char *error_message; /* human-readable reason set when parsing fails */
 } coap_packet_t;
 
 /* Option format serialization*/
+/* Stops the serialization if the buffer cannot hold 'needed' more bytes */
+#define COAP_SERIALIZE_CHECK(needed) \
+    if ((size_t)(option - coap_pkt->buffer) + (needed) > buffer_len) return 0;
 #define COAP_SERIALIZE_INT_OPTION(number, field, text)  \
     if (IS_OPTION(coap_pkt, number)) { \
+      COAP_SERIALIZE_CHECK(COAP_MAX_OPTION_HEADER_LEN + 4) \
       PRINTF(text" [%u]\n", coap_pkt->field); \
       option += coap_serialize_int_option(number, current_number, option, coap_pkt->field); \
       current_number = number; \
     }
 #define COAP_SERIALIZE_BYTE_OPTION(number, field, text)      \
     if (IS_OPTION(coap_pkt, number)) { \
+      COAP_SERIALIZE_CHECK(COAP_MAX_OPTION_HEADER_LEN + coap_pkt->field##_len) \
       PRINTF(text" %u [0x%02X%02X%02X%02X%02X%02X%02X%02X]\n", coap_pkt->field##_len, \
         coap_pkt->field[0], \
         coap_pkt->field[1], \
@@ -288,12 +313,14 @@ typedef struct {
     }
 #define COAP_SERIALIZE_STRING_OPTION(number, field, splitter, text)      \
     if (IS_OPTION(coap_pkt, number)) { \
+      COAP_SERIALIZE_CHECK((COAP_MAX_OPTION_HEADER_LEN + 1) * (coap_pkt->field##_len + 1)) /* worst case split */ \
       PRINTF(text" [%.*s]\n", coap_pkt->field##_len, coap_pkt->field); \
       option += coap_serialize_array_option(number, current_number, option, (uint8_t *) coap_pkt->field, coap_pkt->field##_len, splitter); \
       current_number = number; \
     }
 #define COAP_SERIALIZE_MULTI_OPTION(number, field, text)      \
         if (IS_OPTION(coap_pkt, number)) { \
+          COAP_SERIALIZE_CHECK(coap_multi_option_size(coap_pkt->field)) \
           PRINTF(text); \
           option += coap_serialize_multi_option(number, current_number, option, coap_pkt->field); \
           current_number = number; \
@@ -301,6 +328,7 @@ typedef struct {
 #define COAP_SERIALIZE_ACCEPT_OPTION(number, field, text)  \
     if (IS_OPTION(coap_pkt, number)) { \
       int i; \
+      COAP_SERIALIZE_CHECK(coap_pkt->field##_num * (COAP_MAX_OPTION_HEADER_LEN + 4)) \
       for (i=0; i<coap_pkt->field##_num; ++i) \
       { \
         PRINTF(text" [%u]\n", coap_pkt->field[i]); \
@@ -312,6 +340,7 @@ typedef struct {
     if (IS_OPTION(coap_pkt, number)) \
     { \
       uint32_t block = coap_pkt->field##_num << 4; \
+      COAP_SERIALIZE_CHECK(COAP_MAX_OPTION_HEADER_LEN + 4) \
       PRINTF(text" [%lu%s (%u B/blk)]\n", coap_pkt->field##_num, coap_pkt->field##_more ? "+" : "", coap_pkt->field##_size); \
       if (coap_pkt->field##_more) block |= 0x8; \
       block |= 0xF & coap_log_2(coap_pkt->field##_size/16); \
@@ -320,15 +349,14 @@ typedef struct {
       current_number = number; \
     }
 
-/* To store error code and human-readable payload */
-extern const char *coap_error_message;
-
 uint16_t coap_get_mid(void);
 
 void coap_init_message(void *packet, coap_message_type_t type, uint8_t code, uint16_t mid);
 size_t coap_serialize_get_size(void *packet);
 size_t coap_serialize_message(void *packet, uint8_t *buffer);
+size_t coap_serialize_message_bounded(void *packet, uint8_t *buffer, size_t buffer_len);
 coap_status_t coap_parse_message(void *request, uint8_t *data, uint16_t data_len);
+coap_status_t coap_parse_message_views(void *request, uint8_t *data, uint16_t data_len, coap_option_views_t *views);
 void coap_free_header(void *packet);
 
 char * coap_get_multi_option_as_string(multi_option_t * option);
@@ -394,6 +422,9 @@ int coap_set_header_block1(void *packet, uint32_t num, uint8_t more, uint16_t si
 int coap_get_header_size(void *packet, uint32_t *size);
 int coap_set_header_size(void *packet, uint32_t size);
 
+int coap_get_header_size1(void *packet, uint32_t *size);
+int coap_set_header_size1(void *packet, uint32_t size);
+
 int coap_get_payload(void *packet, const uint8_t **payload);
 int coap_set_payload(void *packet, const void *payload, size_t length);
 
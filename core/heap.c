@@ -0,0 +1,132 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Pairing heap keeping structures ordered by a deadline: the transactions by
+ * retransmission time, the registered clients by end of life...
+ *
+ * The lwm2m_heap_node_t is embedded in the ordered structure and the order is
+ * given by a callback. Insertion is O(1), removal of any node is O(log n)
+ * amortized.
+ */
+
+#include "internals.h"
+
+// both heaps must be detached (no parent nor sibling)
+static lwm2m_heap_node_t * prv_merge(lwm2m_heap_node_t * firstP,
+                                     lwm2m_heap_node_t * secondP,
+                                     heap_before_t beforeFunc)
+{
+    lwm2m_heap_node_t * tempP;
+
+    if (NULL == firstP) return secondP;
+    if (NULL == secondP) return firstP;
+
+    if (beforeFunc(secondP, firstP))
+    {
+        tempP = firstP;
+        firstP = secondP;
+        secondP = tempP;
+    }
+
+    // the root coming later becomes the first child of the other one
+    secondP->prev = firstP;
+    secondP->sibling = firstP->child;
+    if (NULL != firstP->child) firstP->child->prev = secondP;
+    firstP->child = secondP;
+
+    return firstP;
+}
+
+static lwm2m_heap_node_t * prv_mergePairs(lwm2m_heap_node_t * firstP,
+                                          heap_before_t beforeFunc)
+{
+    lwm2m_heap_node_t * pairsP = NULL;
+    lwm2m_heap_node_t * resultP = NULL;
+
+    // first pass: merge the siblings two by two, stacking the results through sibling
+    while (NULL != firstP)
+    {
+        lwm2m_heap_node_t * secondP;
+
+        secondP = firstP->sibling;
+        firstP->prev = NULL;
+        firstP->sibling = NULL;
+        if (NULL != secondP)
+        {
+            lwm2m_heap_node_t * nextP = secondP->sibling;
+
+            secondP->prev = NULL;
+            secondP->sibling = NULL;
+            firstP = prv_merge(firstP, secondP, beforeFunc);
+            secondP = nextP;
+        }
+        firstP->sibling = pairsP;
+        pairsP = firstP;
+        firstP = secondP;
+    }
+
+    // second pass: merge the pairs from the last one
+    while (NULL != pairsP)
+    {
+        lwm2m_heap_node_t * nextP = pairsP->sibling;
+
+        pairsP->sibling = NULL;
+        resultP = prv_merge(resultP, pairsP, beforeFunc);
+        pairsP = nextP;
+    }
+
+    return resultP;
+}
+
+lwm2m_heap_node_t * heap_insert(lwm2m_heap_node_t * rootP,
+                                lwm2m_heap_node_t * nodeP,
+                                heap_before_t beforeFunc)
+{
+    return prv_merge(rootP, nodeP, beforeFunc);
+}
+
+lwm2m_heap_node_t * heap_remove(lwm2m_heap_node_t * rootP,
+                                lwm2m_heap_node_t * nodeP,
+                                heap_before_t beforeFunc)
+{
+    if (rootP == nodeP)
+    {
+        rootP = prv_mergePairs(nodeP->child, beforeFunc);
+    }
+    else if (NULL != nodeP->prev)
+    {
+        if (nodeP->prev->child == nodeP)
+        {
+            nodeP->prev->child = nodeP->sibling;
+        }
+        else
+        {
+            nodeP->prev->sibling = nodeP->sibling;
+        }
+        if (NULL != nodeP->sibling) nodeP->sibling->prev = nodeP->prev;
+
+        rootP = prv_merge(rootP, prv_mergePairs(nodeP->child, beforeFunc), beforeFunc);
+    }
+    // else node is not in the heap
+
+    nodeP->child = NULL;
+    nodeP->sibling = NULL;
+    nodeP->prev = NULL;
+
+    return rootP;
+}
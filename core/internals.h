@@ -213,14 +213,64 @@
 #define LWM2M_URI_MASK_TYPE (uint8_t)0x70
 #define LWM2M_URI_MASK_ID   (uint8_t)0x07
 
+// reassembly of a Block2 response, see management.c
+typedef struct
+{
+    uint8_t *           buffer;
+    size_t              bufferSize;
+    size_t              length;     // end of the furthest block received
+    uint32_t            size2;      // total size announced by the client or 0
+    uint16_t            blockSize;
+    uint16_t            accept;
+    uint32_t            nextNum;    // next block to request
+    uint32_t            lastNum;    // number of the block without the M bit or UINT32_MAX
+    uint32_t            received;   // number of blocks received
+    uint8_t             pending;    // block requests in flight
+    coap_status_t       status;     // first error, NO_ERROR if none
+    lwm2m_media_type_t  format;
+} dm_block2_t;
+
+// payload sent as a Block1 sequence, see management.c
+typedef struct
+{
+    uint8_t *           buffer;     // copy of the payload
+    size_t              length;
+    size_t              offset;     // start of the block in flight
+    size_t              reported;   // bytes acknowledged at the last progress callback
+    uint16_t            blockSize;
+    coap_method_t       method;
+    lwm2m_media_type_t  format;
+} dm_block1_t;
+
 typedef struct
 {
     uint16_t clientID;
     lwm2m_uri_t uri;
     lwm2m_result_callback_t callback;
     void * userData;
+    lwm2m_context_t * contextP;
+    dm_block2_t * block2P;          // not NULL while a Block2 response is reassembled
+    dm_block1_t * block1P;          // not NULL while a Block1 request is sent
 } dm_data_t;
 
+// Outgoing messages are serialized in place in this buffer. Larger ones
+// fall back to a heap buffer sized by coap_serialize_get_size().
+#ifndef LWM2M_SEND_BUFFER_SIZE
+#define LWM2M_SEND_BUFFER_SIZE (REST_MAX_CHUNK_SIZE + 128)
+#endif
+
+// ETag of a read response: version of the object (4 bytes) and Accept option of the request (2 bytes)
+#define LWM2M_ETAG_LEN 6
+
+// storage used by lwm2m_handle_packet(), see lwm2m_context_t::packetScratch
+typedef struct
+{
+    coap_packet_t       message;
+    coap_packet_t       response;
+    coap_option_views_t views;      // options of message, referencing the received buffer
+    uint8_t             sendBuffer[LWM2M_SEND_BUFFER_SIZE];   // used by message_serialize()
+} packet_scratch_t;
+
 typedef enum
 {
     URI_DEPTH_OBJECT,
@@ -243,11 +293,15 @@ typedef struct
 lwm2m_uri_t * uri_decode(char * altPath, multi_option_t *uriPath);
 int uri_getNumber(uint8_t * uriString, size_t uriLength);
 int uri_toString(lwm2m_uri_t * uriP, uint8_t * buffer, size_t bufferLen, uri_depth_t * depthP);
+bool uri_matchPath(const char * uri, multi_option_t * pathP);
 
 // defined in objects.c
 coap_status_t object_readData(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, int * sizeP, lwm2m_data_t ** dataP);
 coap_status_t object_read(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, lwm2m_media_type_t * formatP, uint8_t ** bufferP, size_t * lengthP);
 coap_status_t object_write(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, lwm2m_media_type_t format, uint8_t * buffer, size_t length);
+size_t object_getETag(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, int32_t accept, uint8_t etag[LWM2M_ETAG_LEN]);
+bool object_isBlockWritable(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, lwm2m_media_type_t format);
+coap_status_t object_writeBlock(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, uint32_t offset, uint8_t * buffer, size_t length, bool more);
 coap_status_t object_create(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, lwm2m_media_type_t format, uint8_t * buffer, size_t length);
 coap_status_t object_execute(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, uint8_t * buffer, size_t length);
 coap_status_t object_delete(lwm2m_context_t * contextP, lwm2m_uri_t * uriP);
@@ -264,9 +318,10 @@ coap_status_t object_writeInstance(lwm2m_context_t * contextP, lwm2m_uri_t * uri
 lwm2m_transaction_t * transaction_new(void * sessionH, coap_method_t method, char * altPath, lwm2m_uri_t * uriP, uint16_t mID, uint8_t token_len, uint8_t* token);
 int transaction_send(lwm2m_context_t * contextP, lwm2m_transaction_t * transacP);
 void transaction_free(lwm2m_transaction_t * transacP);
+void transaction_add(lwm2m_context_t * contextP, lwm2m_transaction_t * transacP);
 void transaction_remove(lwm2m_context_t * contextP, lwm2m_transaction_t * transacP);
 bool transaction_handleResponse(lwm2m_context_t * contextP, void * fromSessionH, coap_packet_t * message, coap_packet_t * response);
-void transaction_step(lwm2m_context_t * contextP, time_t currentTime, time_t * timeoutP);
+void transaction_step(lwm2m_context_t * contextP, int64_t currentTime, int64_t * timeoutP);
 
 // defined in management.c
 coap_status_t dm_handleRequest(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, lwm2m_server_t * serverP, coap_packet_t * message, coap_packet_t * response);
@@ -280,6 +335,8 @@ void observe_clear(lwm2m_context_t * contextP, lwm2m_uri_t * uriP);
 bool observe_handleNotify(lwm2m_context_t * contextP, void * fromSessionH, coap_packet_t * message, coap_packet_t * response);
 void observe_remove(lwm2m_observation_t * observationP);
 lwm2m_observed_t * observe_findByUri(lwm2m_context_t * contextP, lwm2m_uri_t * uriP);
+void observe_flushQueue(lwm2m_context_t * contextP, lwm2m_server_t * serverP, time_t currentTime);
+void observe_freeQueue(lwm2m_server_t * serverP);
 
 // defined in registration.c
 coap_status_t registration_handleRequest(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, void * fromSessionH, coap_packet_t * message, coap_packet_t * response);
@@ -290,6 +347,7 @@ void registration_step(lwm2m_context_t * contextP, time_t currentTime, time_t *
 lwm2m_status_t registration_getStatus(lwm2m_context_t * contextP);
 
 // defined in packet.c
+size_t message_serialize(lwm2m_context_t * contextP, coap_packet_t * message, uint8_t ** bufferP);
 coap_status_t message_send(lwm2m_context_t * contextP, coap_packet_t * message, void * sessionH);
 
 // defined in bootstrap.c
@@ -315,9 +373,32 @@ int json_serialize(lwm2m_uri_t * uriP, int size, lwm2m_data_t * tlvP, uint8_t **
 int discover_serialize(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, lwm2m_server_t * serverP, int size, lwm2m_data_t * dataP, uint8_t ** bufferP);
 
 // defined in block1.c
-coap_status_t coap_block1_handler(lwm2m_block1_data_t ** block1Data, uint16_t mid, uint8_t * buffer, size_t length, uint16_t blockSize, uint32_t blockNum, bool blockMore, uint8_t ** outputBuffer, size_t * outputLength);
+coap_status_t coap_block1_handler(lwm2m_block1_data_t ** block1Data, coap_packet_t * message, time_t currentTime, uint8_t ** outputBuffer, size_t * outputLength);
+void block1_step(lwm2m_block1_data_t ** block1Data, time_t currentTime, time_t * timeoutP);
 void free_block1_buffer(lwm2m_block1_data_t * block1Data);
 
+// defined in block2.c
+lwm2m_block2_data_t * block2_find(lwm2m_block2_data_t * block2Data, coap_packet_t * message, time_t currentTime);
+void block2_store(lwm2m_block2_data_t ** pBlock2Data, coap_packet_t * message, coap_packet_t * response, uint8_t * buffer, size_t length, time_t currentTime);
+void block2_step(lwm2m_block2_data_t ** pBlock2Data, time_t currentTime, time_t * timeoutP);
+void block2_free(lwm2m_block2_data_t * block2Data);
+
+// defined in dedup.c
+lwm2m_dedup_data_t * dedup_find(lwm2m_dedup_data_t * dedupData, uint16_t mid, time_t currentTime);
+void dedup_store(lwm2m_dedup_data_t ** pDedupData, uint16_t mid, uint8_t * buffer, size_t length, time_t currentTime);
+void dedup_step(lwm2m_dedup_data_t ** pDedupData, time_t currentTime, time_t * timeoutP);
+void dedup_free(lwm2m_dedup_data_t * dedupData);
+
+// defined in heap.c
+// Returns true if firstP has to come out of the heap before secondP.
+typedef bool (*heap_before_t)(lwm2m_heap_node_t * firstP, lwm2m_heap_node_t * secondP);
+// Returns the structure of type 'type' embedding nodeP as its member 'member'.
+#define HEAP_ENTRY(nodeP, type, member) ((type *)((uint8_t *)(nodeP) - offsetof(type, member)))
+// nodeP must not be in a heap. Returns the new root.
+lwm2m_heap_node_t * heap_insert(lwm2m_heap_node_t * rootP, lwm2m_heap_node_t * nodeP, heap_before_t beforeFunc);
+// Does nothing if nodeP is not in the heap. Returns the new root.
+lwm2m_heap_node_t * heap_remove(lwm2m_heap_node_t * rootP, lwm2m_heap_node_t * nodeP, heap_before_t beforeFunc);
+
 // defined in utils.c
 lwm2m_data_type_t utils_depthToDatatype(uri_depth_t depth);
 lwm2m_binding_t utils_stringToBinding(uint8_t *buffer, size_t length);
@@ -330,6 +411,8 @@ int utils_textToInt(uint8_t * buffer, int length, int64_t * dataP);
 int utils_textToFloat(uint8_t * buffer, int length, double * dataP);
 void utils_copyValue(void * dst, const void * src, size_t len);
 size_t utils_base64Encode(uint8_t * dataP, size_t dataLen, uint8_t * bufferP, size_t bufferLen);
+time_t utils_getTime(void);
+int64_t utils_getTimeMs(void);
 #ifdef LWM2M_CLIENT_MODE
 lwm2m_server_t * utils_findServer(lwm2m_context_t * contextP, void * fromSessionH);
 lwm2m_server_t * utils_findBootstrapServer(lwm2m_context_t * contextP, void * fromSessionH);
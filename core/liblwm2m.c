@@ -69,11 +69,17 @@ lwm2m_context_t * lwm2m_init(void * userData)
     if (NULL != contextP)
     {
         memset(contextP, 0, sizeof(lwm2m_context_t));
+        contextP->packetScratch = lwm2m_malloc(sizeof(packet_scratch_t));
+        if (NULL == contextP->packetScratch)
+        {
+            lwm2m_free(contextP);
+            return NULL;
+        }
         contextP->userData = userData;
 #ifdef ESP8266
         srand(system_get_time()); // @ vs
 #else
-        srand((int)lwm2m_gettime());
+        srand((int)utils_getTime());
 #endif
         contextP->nextMID = rand();
     }
@@ -102,6 +108,9 @@ static void prv_deleteServer(lwm2m_server_t * serverP)
         lwm2m_free(serverP->location);
     }
     free_block1_buffer(serverP->block1Data);
+    block2_free(serverP->block2Data);
+    dedup_free(serverP->dedupData);
+    observe_freeQueue(serverP);
     lwm2m_free(serverP);
 }
 
@@ -121,6 +130,7 @@ static void prv_deleteBootstrapServer(lwm2m_server_t * serverP)
     // TODO should we free location as in prv_deleteServer ?
     // TODO should we parse transaction and observation to remove the ones related to this server ?
     free_block1_buffer(serverP->block1Data);
+    dedup_free(serverP->dedupData);
     lwm2m_free(serverP);
 }
 
@@ -164,6 +174,9 @@ void prv_deleteTransactionList(lwm2m_context_t * context)
 
         transaction = context->transactionList;
         context->transactionList = context->transactionList->next;
+#ifdef LWM2M_WITH_SESSION_REFS
+        lwm2m_session_release(transaction->peerH, context->userData);
+#endif
         transaction_free(transaction);
     }
 }
@@ -197,15 +210,52 @@ void lwm2m_close(lwm2m_context_t * contextP)
         clientP = contextP->clientList;
         contextP->clientList = contextP->clientList->next;
 
+#ifdef LWM2M_WITH_SESSION_REFS
+        if (clientP->sessionH != NULL) lwm2m_session_release(clientP->sessionH, contextP->userData);
+#endif
         registration_freeClient(clientP);
     }
+    if (contextP->clientIdTable != NULL) lwm2m_free(contextP->clientIdTable);
+    if (contextP->clientNameTable != NULL) lwm2m_free(contextP->clientNameTable);
 #endif
 
     prv_deleteTransactionList(contextP);
+    lwm2m_free(contextP->packetScratch);
     lwm2m_free(contextP);
 }
 
+int lwm2m_set_block_size(lwm2m_context_t * contextP,
+                         uint16_t blockSize)
+{
+    LOG_ARG("blockSize: %u", blockSize);
+    // CoAP block sizes are 2^(SZX + 4) with SZX from 0 to 6
+    if (blockSize < 16
+     || blockSize > LWM2M_MAX_BLOCK_SIZE
+     || (blockSize & (blockSize - 1)) != 0)
+    {
+        return COAP_400_BAD_REQUEST;
+    }
+
+    contextP->blockSize = blockSize;
+
+    return COAP_NO_ERROR;
+}
+
 #ifdef LWM2M_CLIENT_MODE
+void lwm2m_set_confirmable_notifications(lwm2m_context_t * contextP,
+                                         bool confirmable)
+{
+    LOG_ARG("confirmable: %d", confirmable);
+    contextP->confirmableNotify = confirmable;
+}
+
+void lwm2m_set_queue_history(lwm2m_context_t * contextP,
+                             bool history)
+{
+    LOG_ARG("history: %d", history);
+    contextP->queueHistory = history;
+}
+
 static int prv_refreshServerList(lwm2m_context_t * contextP)
 {
     lwm2m_server_t * targetP;
@@ -313,6 +363,8 @@ int lwm2m_configure(lwm2m_context_t * contextP,
     for (i = 0; i < numObject; i++)
     {
         objectList[i]->next = NULL;
+        // ETags of this run must not match the ones of a previous run
+        objectList[i]->version = (uint32_t)rand();
         contextP->objectList = (lwm2m_object_t *)LWM2M_LIST_ADD(contextP->objectList, objectList[i]);
     }
 
@@ -328,6 +380,7 @@ int lwm2m_add_object(lwm2m_context_t * contextP,
     targetP = (lwm2m_object_t *)LWM2M_LIST_FIND(contextP->objectList, objectP->objID);
     if (targetP != NULL) return COAP_406_NOT_ACCEPTABLE;
     objectP->next = NULL;
+    objectP->version = (uint32_t)rand();
 
     contextP->objectList = (lwm2m_object_t *)LWM2M_LIST_ADD(contextP->objectList, objectP);
 
@@ -363,12 +416,33 @@ int lwm2m_remove_object(lwm2m_context_t * contextP,
 int lwm2m_step(lwm2m_context_t * contextP,
                time_t * timeoutP)
 {
+    int64_t timeoutMs;
+    int result;
+
+    timeoutMs = (int64_t)*timeoutP * 1000;
+    result = lwm2m_step_ms(contextP, &timeoutMs);
+    *timeoutP = (time_t)((timeoutMs + 999) / 1000);
+
+    return result;
+}
+
+int lwm2m_step_ms(lwm2m_context_t * contextP,
+                  int64_t * timeoutMsP)
+{
+    int64_t currentMs;
     time_t tv_sec;
+    time_t timeout;
+    time_t * timeoutP;
     int result;
 
-    LOG_ARG("timeoutP: %" PRId64, *timeoutP);
-    tv_sec = lwm2m_gettime();
-    if (tv_sec < 0) return COAP_500_INTERNAL_SERVER_ERROR;
+    LOG_ARG("timeoutMsP: %" PRId64, *timeoutMsP);
+    currentMs = utils_getTimeMs();
+    if (currentMs < 0) return COAP_500_INTERNAL_SERVER_ERROR;
+    tv_sec = (time_t)(currentMs / 1000);
+
+    // state machines below work with a resolution of one second
+    timeout = (time_t)((*timeoutMsP + 999) / 1000);
+    timeoutP = &timeout;
 
 #ifdef LWM2M_CLIENT_MODE
     LOG_ARG("State: %s", STR_STATE(contextP->state));
@@ -469,12 +543,36 @@ next_step:
     }
 
     observe_step(contextP, tv_sec, timeoutP);
+
+    {
+        lwm2m_server_t * serverP;
+
+        for (serverP = contextP->serverList ; serverP != NULL ; serverP = serverP->next)
+        {
+            block1_step(&serverP->block1Data, tv_sec, timeoutP);
+            block2_step(&serverP->block2Data, tv_sec, timeoutP);
+            dedup_step(&serverP->dedupData, tv_sec, timeoutP);
+            observe_flushQueue(contextP, serverP, tv_sec);
+        }
+        for (serverP = contextP->bootstrapServerList ; serverP != NULL ; serverP = serverP->next)
+        {
+            block1_step(&serverP->block1Data, tv_sec, timeoutP);
+            dedup_step(&serverP->dedupData, tv_sec, timeoutP);
+        }
+    }
 #endif
 
     registration_step(contextP, tv_sec, timeoutP);
-    transaction_step(contextP, tv_sec, timeoutP);
 
-    LOG_ARG("Final timeoutP: %" PRId64, *timeoutP);
+    if ((int64_t)timeout * 1000 < *timeoutMsP)
+    {
+        int64_t interval = (int64_t)timeout * 1000 - currentMs % 1000;
+
+        *timeoutMsP = interval > 0 ? interval : 0;
+    }
+    transaction_step(contextP, currentMs, timeoutMsP);
+
+    LOG_ARG("Final timeoutMsP: %" PRId64, *timeoutMsP);
 #ifdef LWM2M_CLIENT_MODE
     LOG_ARG("Final state: %s", STR_STATE(contextP->state));
 #endif
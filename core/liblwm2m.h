@@ -113,6 +113,12 @@ int lwm2m_strncmp(const char * s1, const char * s2, size_t n);
 // In case of error, this must return a negative value.
 // Per POSIX specifications, time_t is a signed integer.
 time_t lwm2m_gettime(void);
+#ifdef LWM2M_WITH_MS_CLOCK
+// This function must return the number of milliseconds elapsed since origin.
+// Same constraints as lwm2m_gettime(). When LWM2M_WITH_MS_CLOCK is defined, the core
+// uses this function instead of lwm2m_gettime().
+int64_t lwm2m_gettime_ms(void);
+#endif
 
 #ifdef LWM2M_WITH_LOGS
 // Same usage as C89 printf()
@@ -140,6 +146,30 @@ uint8_t lwm2m_buffer_send(void * sessionH, uint8_t * buffer, size_t length, void
 // Returns true if the two sessions identify the same peer. false otherwise.
 // userData: parameter to lwm2m_init()
 bool lwm2m_session_is_equal(void * session1, void * session2, void * userData);
+#ifdef LWM2M_WITH_SESSION_HASH
+// Hash a session handle
+// Returns a value used to index transactions per peer. Two sessions for which lwm2m_session_is_equal()
+// returns true MUST have the same hash.
+// sessionH: session handle identifying the peer (opaque to the core)
+// userData: parameter to lwm2m_init()
+uint32_t lwm2m_session_hash(void * sessionH, void * userData);
+#endif
+#ifdef LWM2M_WITH_SESSION_REFS
+// Tell that the core keeps a reference to a session, in a registered client or a pending transaction.
+// Each call to lwm2m_session_hold() is balanced by a call to lwm2m_session_release() once the reference
+// is dropped. A session with no reference left is not used by the core anymore.
+// sessionH: session handle identifying the peer (opaque to the core)
+// userData: parameter to lwm2m_init()
+void lwm2m_session_hold(void * sessionH, void * userData);
+void lwm2m_session_release(void * sessionH, void * userData);
+#endif
+#ifdef LWM2M_WITH_SEND_BATCH
+// Tell that several calls to lwm2m_buffer_send() follow, e.g. the notifications due in one step.
+// The platform may hold the datagrams sent until lwm2m_buffer_flush() is called and send them at once.
+// userData: parameter to lwm2m_init()
+void lwm2m_buffer_hold(void * userData);
+void lwm2m_buffer_flush(void * userData);
+#endif
 
 /*
  * Error code
@@ -150,6 +180,7 @@ bool lwm2m_session_is_equal(void * session1, void * session2, void * userData);
 
 #define COAP_201_CREATED                (uint8_t)0x41
 #define COAP_202_DELETED                (uint8_t)0x42
+#define COAP_203_VALID                  (uint8_t)0x43
 #define COAP_204_CHANGED                (uint8_t)0x44
 #define COAP_205_CONTENT                (uint8_t)0x45
 #define COAP_231_CONTINUE               (uint8_t)0x5F
@@ -242,6 +273,17 @@ void lwm2m_list_free(lwm2m_list_t * head);
 #define LWM2M_LIST_FIND(H,I) lwm2m_list_find((lwm2m_list_t *)H, I)
 #define LWM2M_LIST_FREE(H) lwm2m_list_free((lwm2m_list_t *)H)
 
+/*
+ * Node of the pairing heaps used internally to order structures by deadline.
+ * Embedded in the ordered structures, all NULL when not in a heap.
+ */
+typedef struct _lwm2m_heap_node_t
+{
+    struct _lwm2m_heap_node_t * child;   // first child
+    struct _lwm2m_heap_node_t * sibling; // next sibling
+    struct _lwm2m_heap_node_t * prev;    // parent or previous sibling
+} lwm2m_heap_node_t;
+
 /*
  * URI
  *
@@ -390,6 +432,18 @@ int lwm2m_decode_TLV(const uint8_t * buffer, size_t buffer_len, lwm2m_data_type_
  * For the read callback, if *numDataP is not zero, *dataArrayP is pre-allocated
  * and contains the list of resources to read.
  *
+ * The optional block write callback receives opaque resource writes sent with
+ * Block1 one block at a time instead of the whole reassembled payload. offset
+ * is the position of buffer in the resource value and more is false for the
+ * last block. It returns COAP_204_CHANGED when the block was stored.
+ *
+ * An object calling lwm2m_resource_value_changed() for every change of its
+ * values not caused by a server can set reportsChanges. Its read responses
+ * then carry an ETag derived from the object version, which changes on each
+ * write, create, delete or execute and on each call to
+ * lwm2m_resource_value_changed() for the object. A server presenting this ETag
+ * gets 2.03 Valid without payload. Other objects are read on each request.
+ *
  */
 
 typedef struct _lwm2m_object_t lwm2m_object_t;
@@ -400,6 +454,7 @@ typedef uint8_t (*lwm2m_write_callback_t) (uint16_t instanceId, int numData, lwm
 typedef uint8_t (*lwm2m_execute_callback_t) (uint16_t instanceId, uint16_t resourceId, uint8_t * buffer, int length, lwm2m_object_t * objectP);
 typedef uint8_t (*lwm2m_create_callback_t) (uint16_t instanceId, int numData, lwm2m_data_t * dataArray, lwm2m_object_t * objectP);
 typedef uint8_t (*lwm2m_delete_callback_t) (uint16_t instanceId, lwm2m_object_t * objectP);
+typedef uint8_t (*lwm2m_block_write_callback_t) (uint16_t instanceId, uint16_t resourceId, uint32_t offset, uint8_t * buffer, size_t length, bool more, lwm2m_object_t * objectP);
 
 struct _lwm2m_object_t
 {
@@ -412,6 +467,9 @@ struct _lwm2m_object_t
     lwm2m_create_callback_t   createFunc;
     lwm2m_delete_callback_t   deleteFunc;
     lwm2m_discover_callback_t discoverFunc;
+    lwm2m_block_write_callback_t blockWriteFunc;
+    bool           reportsChanges;           // enables ETags, see above
+    uint32_t       version;                  // for internal use only.
     void * userData;
 };
 
@@ -456,17 +514,118 @@ typedef enum
  * LWM2M block1 data
  *
  * Temporary data needed to handle block1 request.
- * Currently support only one block1 request by server.
+ * Transfers are identified by the request method and URI, several can be
+ * in progress with the same server.
  */
 typedef struct _lwm2m_block1_data_ lwm2m_block1_data_t;
 
 struct _lwm2m_block1_data_
 {
-    uint8_t *             block1buffer;     // data buffer
-    size_t                block1bufferSize; // buffer size
-    uint16_t              lastmid;          // mid of the last message received
+    struct _lwm2m_block1_data_ * next;
+    uint8_t               code;                 // method of the request
+    char *                uri;                  // Uri-Path of the request
+    uint8_t *             block1buffer;         // data buffer
+    size_t                block1bufferSize;     // length of the data received so far
+    size_t                block1bufferCapacity; // allocated size of block1buffer
+    uint16_t              lastmid;              // mid of the last message received
+    time_t                lastActivity;         // date of the last block received
+    bool                  complete;             // the last block was received
+};
+
+// Largest payload accepted in a Block1 transfer, also checked against the Size1 option
+#ifndef LWM2M_BLOCK1_MAX_SIZE
+#define LWM2M_BLOCK1_MAX_SIZE (1024*1024)
+#endif
+// Number of Block1 transfers kept per server, the least recently active one is dropped
+#ifndef LWM2M_BLOCK1_MAX_TRANSFERS
+#define LWM2M_BLOCK1_MAX_TRANSFERS 4
+#endif
+// Delay in seconds after which an incomplete Block1 transfer is discarded
+#ifndef LWM2M_BLOCK1_TIMEOUT
+#define LWM2M_BLOCK1_TIMEOUT 120
+#endif
+
+/*
+ * LWM2M block2 data
+ *
+ * Serialized response to a read, kept while the peer retrieves the
+ * following blocks so that it is not rebuilt for each of them.
+ */
+typedef struct _lwm2m_block2_data_ lwm2m_block2_data_t;
+
+struct _lwm2m_block2_data_
+{
+    struct _lwm2m_block2_data_ * next;
+    char *                uri;          // Uri-Path of the request
+    int32_t               accept;       // Accept option of the request or -1 if none
+    uint16_t              contentType;  // content format of the response
+    uint8_t               etagLen;      // ETag of the response, repeated in each block
+    uint8_t               etag[8];
+    uint8_t *             buffer;       // whole response payload
+    size_t                length;
+    time_t                lastActivity; // date of the last block served
+};
+
+// Number of responses cached per server, the least recently used one is dropped
+#ifndef LWM2M_BLOCK2_MAX_RESPONSES
+#define LWM2M_BLOCK2_MAX_RESPONSES 4
+#endif
+// Delay in seconds after which an unused cached response is discarded
+#ifndef LWM2M_BLOCK2_TIMEOUT
+#define LWM2M_BLOCK2_TIMEOUT 60
+#endif
+
+/*
+ * LWM2M deduplication data
+ *
+ * Serialized response to a confirmable request, sent again as is if the peer
+ * retransmits the request because our acknowledgement was lost.
+ */
+typedef struct _lwm2m_dedup_data_ lwm2m_dedup_data_t;
+
+struct _lwm2m_dedup_data_
+{
+    struct _lwm2m_dedup_data_ * next;
+    uint16_t              mid;          // message ID of the request
+    uint8_t *             buffer;       // serialized response
+    size_t                length;
+    time_t                expiry;       // date after which the peer may reuse the message ID
 };
 
+// Number of responses kept per server, the oldest one is dropped
+#ifndef LWM2M_DEDUP_MAX_RESPONSES
+#define LWM2M_DEDUP_MAX_RESPONSES 8
+#endif
+
+/*
+ * LWM2M queued notification
+ *
+ * Notification held while a server in queue mode cannot reach the client,
+ * sent after the next registration or registration update.
+ */
+typedef struct
+{
+    uint8_t *          buffer;      // payload
+    size_t             length;
+    lwm2m_media_type_t format;
+    uint8_t            token[8];    // token of the observation
+    size_t             tokenLen;
+    uint32_t           counter;     // value of the Observe option
+    struct _lwm2m_watcher_ * watcher; // gets the message ID once sent, so that a reset cancels it
+} lwm2m_queued_notify_t;
+
+// Number of notifications held per server in queue mode, the oldest one is dropped
+#ifndef LWM2M_QUEUE_SIZE
+#define LWM2M_QUEUE_SIZE 8
+#endif
+
+// Largest CoAP block size (SZX 6) the library will use, see lwm2m_set_block_size().
+#ifndef LWM2M_MAX_BLOCK_SIZE
+#define LWM2M_MAX_BLOCK_SIZE 1024
+#endif
+// Buffer size needed to receive a block along with its CoAP header
+#define LWM2M_MAX_PACKET_SIZE (LWM2M_MAX_BLOCK_SIZE + 128)
+
 typedef struct _lwm2m_server_
 {
     struct _lwm2m_server_ * next;         // matches lwm2m_list_t::next
@@ -479,7 +638,16 @@ typedef struct _lwm2m_server_
     lwm2m_status_t          status;
     char *                  location;
     bool                    dirty;
-    lwm2m_block1_data_t *   block1Data;   // buffer to handle block1 data, should be replace by a list to support several block1 transfer by server.
+    lwm2m_block1_data_t *   block1Data;   // list of the block1 transfers in progress with this server
+    lwm2m_block2_data_t *   block2Data;   // responses being retrieved by this server with block2
+    lwm2m_dedup_data_t *    dedupData;    // responses to the last confirmable requests of this server
+    uint16_t                blockSize;    // block size last negotiated with this server or 0 if none
+    bool                    notifyPending; // a confirmable notification to this server waits for its acknowledgement
+    struct _lwm2m_watcher_ * heldWatchers; // watchers waiting for this acknowledgement to be evaluated
+    time_t                  awakeUntil;   // queue mode: end of the period during which the server can reach the client
+    lwm2m_queued_notify_t * queue;        // queue mode: ring of LWM2M_QUEUE_SIZE notifications held meanwhile, allocated on first use
+    uint8_t                 queueFirst;
+    uint8_t                 queueCount;
 } lwm2m_server_t;
 
 
@@ -490,6 +658,14 @@ typedef struct _lwm2m_server_
  */
 typedef void (*lwm2m_result_callback_t) (uint16_t clientID, lwm2m_uri_t * uriP, int status, lwm2m_media_type_t format, uint8_t * data, int dataLength, void * userData);
 
+/*
+ * LWM2M progress callback
+ *
+ * Called while a payload larger than the block size is sent to a client, each time
+ * LWM2M_PROGRESS_WINDOW more bytes are acknowledged and when the last block is.
+ */
+typedef void (*lwm2m_progress_callback_t) (uint16_t clientID, lwm2m_uri_t * uriP, size_t acknowledged, size_t total, void * userData);
+
 /*
  * LWM2M Observations
  *
@@ -549,10 +725,51 @@ typedef struct _lwm2m_client_object_
     lwm2m_list_t *           instanceList;
 } lwm2m_client_object_t;
 
+// Last ETag returned by a client for a read
+typedef struct _lwm2m_client_etag_
+{
+    struct _lwm2m_client_etag_ * next;
+    lwm2m_uri_t              uri;
+    uint8_t                  etagLen;
+    uint8_t                  etag[8];
+} lwm2m_client_etag_t;
+
+// Maximum number of ETags remembered for a client, see lwm2m_dm_read_if_changed()
+#ifndef LWM2M_CLIENT_MAX_ETAGS
+#define LWM2M_CLIENT_MAX_ETAGS 8
+#endif
+
+// Maximum number of Block2 responses reassembled at the same time for a client
+#ifndef LWM2M_CLIENT_MAX_BLOCK2
+#define LWM2M_CLIENT_MAX_BLOCK2 2
+#endif
+// Maximum number of block requests in flight for a response of known size
+#ifndef LWM2M_BLOCK2_PIPELINE_DEPTH
+#define LWM2M_BLOCK2_PIPELINE_DEPTH 4
+#endif
+// Largest response the server reassembles
+#ifndef LWM2M_MAX_BLOCK2_SIZE
+#define LWM2M_MAX_BLOCK2_SIZE (1024 * 1024)
+#endif
+// Bytes acknowledged between two calls of the progress callback of Block1 transfers
+#ifndef LWM2M_PROGRESS_WINDOW
+#define LWM2M_PROGRESS_WINDOW 4096
+#endif
+
+// Initial number of buckets of the client tables. Must be a power of two.
+#ifndef LWM2M_CLIENT_TABLE_MIN_SIZE
+#define LWM2M_CLIENT_TABLE_MIN_SIZE 16
+#endif
+
 typedef struct _lwm2m_client_
 {
     struct _lwm2m_client_ * next;       // matches lwm2m_list_t::next
     uint16_t                internalID; // matches lwm2m_list_t::id
+    struct _lwm2m_client_ * prev;
+    struct _lwm2m_client_ * idNext;     // next in the internalID hash bucket
+    struct _lwm2m_client_ * nameNext;   // next in the endpoint name hash bucket
+    uint32_t                nameHash;
+    lwm2m_heap_node_t       heapNode;   // in the lifetime heap
     char *                  name;
     lwm2m_binding_t         binding;
     char *                  msisdn;
@@ -563,6 +780,9 @@ typedef struct _lwm2m_client_
     void *                  sessionH;
     lwm2m_client_object_t * objectList;
     lwm2m_observation_t *   observationList;
+    lwm2m_client_etag_t *   etagList;       // most recent first
+    uint8_t                 block2Count;    // Block2 responses being reassembled
+    uint16_t                blockSize;      // block size last negotiated with this client or 0 if none
 } lwm2m_client_t;
 
 
@@ -572,6 +792,15 @@ typedef struct _lwm2m_client_
  * Adaptation of Erbium's coap_transaction_t
  */
 
+// Number of buckets of the transaction hash tables. Must be a power of two.
+#ifndef LWM2M_TRANSACTION_HASH_SIZE
+#ifdef LWM2M_SERVER_MODE
+#define LWM2M_TRANSACTION_HASH_SIZE 1024
+#else
+#define LWM2M_TRANSACTION_HASH_SIZE 16
+#endif
+#endif
+
 typedef struct _lwm2m_transaction_ lwm2m_transaction_t;
 
 typedef void (*lwm2m_transaction_callback_t) (lwm2m_transaction_t * transacP, void * message);
@@ -583,13 +812,18 @@ struct _lwm2m_transaction_
     void *                peerH;
     uint8_t               ack_received; // indicates, that the ACK was received
     time_t                response_timeout; // timeout to wait for response, if token is used. When 0, use calculated acknowledge timeout.
+    uint32_t ack_timeout;   // initial acknowledge timeout in milliseconds, randomized on first transmission
     uint8_t  retrans_counter;
-    time_t   retrans_time;
+    int64_t  retrans_time;  // in milliseconds
     void * message;
     uint16_t buffer_len;
     uint8_t * buffer;
     lwm2m_transaction_callback_t callback;
     void * userData;
+    lwm2m_transaction_t * prev;      // previous transaction in the context transactionList
+    lwm2m_transaction_t * midNext;   // next transaction in the same message ID bucket
+    lwm2m_transaction_t * tokenNext; // next transaction in the same token bucket
+    lwm2m_heap_node_t     heapNode;  // in the retransmission schedule
 };
 
 /*
@@ -614,16 +848,27 @@ typedef struct _lwm2m_watcher_
         int64_t asInteger;
         double  asFloat;
     } lastValue;
+    struct _lwm2m_observed_ * observed;     // observation the watcher belongs to
+    time_t deadline;                        // next evaluation when in lwm2m_context_t::observeHeap
+    lwm2m_heap_node_t heapNode;
+    bool held;                              // in the heldWatchers list of its server
+    struct _lwm2m_watcher_ * heldNext;
 } lwm2m_watcher_t;
 
 typedef struct _lwm2m_observed_
 {
     struct _lwm2m_observed_ * next;
+    struct _lwm2m_observed_ * bucketNext;   // next in the same lwm2m_context_t::observedTable bucket
 
     lwm2m_uri_t uri;
     lwm2m_watcher_t * watcherList;
 } lwm2m_observed_t;
 
+// Number of buckets indexing the observations by object and instance ID
+#ifndef LWM2M_OBSERVED_TABLE_SIZE
+#define LWM2M_OBSERVED_TABLE_SIZE 16
+#endif
+
 #ifdef LWM2M_CLIENT_MODE
 
 typedef enum
@@ -663,11 +908,23 @@ typedef struct
     lwm2m_server_t *     serverList;
     lwm2m_object_t *     objectList;
     lwm2m_observed_t *   observedList;
+    lwm2m_observed_t *   observedTable[LWM2M_OBSERVED_TABLE_SIZE]; // observedList hashed by object and instance ID
+    lwm2m_heap_node_t *  observeHeap;       // scheduled watchers ordered by deadline
+    bool                 confirmableNotify; // see lwm2m_set_confirmable_notifications()
+    bool                 queueHistory;      // see lwm2m_set_queue_history()
 #endif
 #ifdef LWM2M_SERVER_MODE
-    lwm2m_client_t *        clientList;
+    lwm2m_client_t *        clientList;         // not sorted, use lwm2m_get_client() for lookups
+    lwm2m_client_t **       clientIdTable;      // clients hashed by internalID
+    lwm2m_client_t **       clientNameTable;    // clients hashed by endpoint name
+    size_t                  clientTableSize;
+    size_t                  clientCount;
+    uint16_t                nextClientID;
+    lwm2m_heap_node_t *     clientHeap;         // clients ordered by endOfLife
     lwm2m_result_callback_t monitorCallback;
     void *                  monitorUserData;
+    lwm2m_progress_callback_t progressCallback;
+    void *                  progressUserData;
 #endif
 #ifdef LWM2M_BOOTSTRAP_SERVER_MODE
     lwm2m_bootstrap_callback_t bootstrapCallback;
@@ -675,6 +932,11 @@ typedef struct
 #endif
     uint16_t                nextMID;
     lwm2m_transaction_t *   transactionList;
+    lwm2m_transaction_t *   transactionMidTable[LWM2M_TRANSACTION_HASH_SIZE];
+    lwm2m_transaction_t *   transactionTokenTable[LWM2M_TRANSACTION_HASH_SIZE];
+    lwm2m_heap_node_t *     transactionHeap;    // transactions ordered by retrans_time
+    void *                  packetScratch;      // parsed message and response used by lwm2m_handle_packet()
+    uint16_t                blockSize;          // preferred block size or 0 if not set, see lwm2m_set_block_size()
     void *                  userData;
 } lwm2m_context_t;
 
@@ -686,7 +948,14 @@ void lwm2m_close(lwm2m_context_t * contextP);
 
 // perform any required pending operation and adjust timeoutP to the maximal time interval to wait in seconds.
 int lwm2m_step(lwm2m_context_t * contextP, time_t * timeoutP);
+// same as lwm2m_step() with timeoutMsP in milliseconds.
+int lwm2m_step_ms(lwm2m_context_t * contextP, int64_t * timeoutMsP);
+// set the preferred block size of blockwise transfers: a power of two from 16 to LWM2M_MAX_BLOCK_SIZE.
+// If not set, a client answers with blocks of REST_MAX_CHUNK_SIZE and a server only splits the payloads larger
+// than LWM2M_MAX_BLOCK_SIZE. Peers asking for smaller blocks are served with their size.
+int lwm2m_set_block_size(lwm2m_context_t * contextP, uint16_t blockSize);
 // dispatch received data to liblwm2m
+// Uses only the context, so different contexts can be driven from different threads.
 void lwm2m_handle_packet(lwm2m_context_t * contextP, uint8_t * buffer, int length, void * fromSessionH);
 
 #ifdef LWM2M_CLIENT_MODE
@@ -704,6 +973,14 @@ int lwm2m_remove_object(lwm2m_context_t * contextP, uint16_t id);
 int lwm2m_update_registration(lwm2m_context_t * contextP, uint16_t shortServerID, bool withObjects);
 
 void lwm2m_resource_value_changed(lwm2m_context_t * contextP, lwm2m_uri_t * uriP);
+// send the notifications as confirmable messages. Only one is in flight per server: the changes
+// happening meanwhile are notified with their latest value once it is acknowledged. An observation
+// whose notification is not acknowledged is cancelled. Notifications are non-confirmable by default.
+void lwm2m_set_confirmable_notifications(lwm2m_context_t * contextP, bool confirmable);
+// with servers bound in queue mode, notifications are held while the server cannot reach the client
+// and sent after the next registration update. By default only the latest one of each observation is
+// kept, if history is true all of them are, up to LWM2M_QUEUE_SIZE per server.
+void lwm2m_set_queue_history(lwm2m_context_t * contextP, bool history);
 #endif
 
 #ifdef LWM2M_SERVER_MODE
@@ -715,8 +992,19 @@ void lwm2m_resource_value_changed(lwm2m_context_t * contextP, lwm2m_uri_t * uriP
 // The lwm2m_client_t is present in the lwm2m_context_t's clientList when the callback is called. On a deregistration, it deleted when the callback returns.
 void lwm2m_set_monitoring_callback(lwm2m_context_t * contextP, lwm2m_result_callback_t callback, void * userData);
 
+// Registered clients lookup by internal ID or by Endpoint Name. Return NULL if no such client is registered.
+lwm2m_client_t * lwm2m_get_client(lwm2m_context_t * contextP, uint16_t clientID);
+lwm2m_client_t * lwm2m_get_client_by_name(lwm2m_context_t * contextP, const char * name);
+
+// Progress of the Block1 transfers started by lwm2m_dm_write(), lwm2m_dm_create() or lwm2m_dm_execute()
+// when the payload is larger than the block size.
+void lwm2m_set_progress_callback(lwm2m_context_t * contextP, lwm2m_progress_callback_t callback, void * userData);
+
 // Device Management APIs
 int lwm2m_dm_read(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_result_callback_t callback, void * userData);
+// same as lwm2m_dm_read() but presents the ETag of the last read of this URI: the callback is called
+// with COAP_203_VALID and no data if the value did not change since.
+int lwm2m_dm_read_if_changed(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_result_callback_t callback, void * userData);
 int lwm2m_dm_discover(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_result_callback_t callback, void * userData);
 int lwm2m_dm_write(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_media_type_t format, uint8_t * buffer, int length, lwm2m_result_callback_t callback, void * userData);
 int lwm2m_dm_write_attributes(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_attributes_t * attrP, lwm2m_result_callback_t callback, void * userData);
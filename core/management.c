@@ -159,6 +159,29 @@ static int prv_readAttributes(multi_option_t * query,
     return 0;
 }
 
+/*
+ * Checks the If-Match option of a write. The ETag only has to come from a read
+ * of the current version of the object, whatever the Accept option of this read.
+ */
+static bool prv_checkIfMatch(lwm2m_context_t * contextP,
+                             lwm2m_uri_t * uriP,
+                             coap_packet_t * message)
+{
+    uint8_t etag[LWM2M_ETAG_LEN];
+
+    if (!IS_OPTION(message, COAP_OPTION_IF_MATCH)) return true;
+    // an empty If-Match only requires the target to exist
+    if (message->if_match_len == 0) return true;
+    // the following blocks of a streamed write change the object themselves
+    if (IS_OPTION(message, COAP_OPTION_BLOCK1) && message->block1_num != 0) return true;
+    // unknown objects are reported by the write itself, objects without ETags accept any
+    if (object_getETag(contextP, uriP, -1, etag) == 0) return true;
+
+    // the first four bytes hold the object version
+    return message->if_match_len == LWM2M_ETAG_LEN
+        && memcmp(message->if_match, etag, 4) == 0;
+}
+
 coap_status_t dm_handleRequest(lwm2m_context_t * contextP,
                                 lwm2m_uri_t * uriP,
                                 lwm2m_server_t * serverP,
@@ -195,6 +218,12 @@ coap_status_t dm_handleRequest(lwm2m_context_t * contextP,
 
     // TODO: check ACL
 
+    if ((message->code == COAP_PUT || message->code == COAP_POST)
+     && !prv_checkIfMatch(contextP, uriP, message))
+    {
+        return COAP_412_PRECONDITION_FAILED;
+    }
+
     switch (message->code)
     {
     case COAP_GET:
@@ -246,12 +275,36 @@ coap_status_t dm_handleRequest(lwm2m_context_t * contextP,
             }
             else
             {
+                uint8_t etag[LWM2M_ETAG_LEN];
+                size_t etagLen;
+
                 if (IS_OPTION(message, COAP_OPTION_ACCEPT))
                 {
                     format = utils_convertMediaType(message->accept[0]);
+                    etagLen = object_getETag(contextP, uriP, message->accept[0], etag);
+                }
+                else
+                {
+                    etagLen = object_getETag(contextP, uriP, -1, etag);
                 }
 
-                result = object_read(contextP, uriP, &format, &buffer, &length);
+                if (etagLen != 0
+                 && IS_OPTION(message, COAP_OPTION_ETAG)
+                 && message->etag_len == etagLen
+                 && memcmp(message->etag, etag, etagLen) == 0)
+                {
+                    // the object did not change since the server got this representation
+                    result = COAP_203_VALID;
+                }
+                else
+                {
+                    result = object_read(contextP, uriP, &format, &buffer, &length);
+                }
+                if (etagLen != 0
+                 && (result == COAP_205_CONTENT || result == COAP_203_VALID))
+                {
+                    coap_set_header_etag(response, etag, etagLen);
+                }
             }
             if (COAP_205_CONTENT == result)
             {
@@ -318,6 +371,14 @@ coap_status_t dm_handleRequest(lwm2m_context_t * contextP,
                     result = observe_setParameters(contextP, uriP, serverP, &attr);
                 }
             }
+            else if (IS_OPTION(message, COAP_OPTION_BLOCK1))
+            {
+                // only left set by lwm2m_handle_packet() for objects streaming the write
+                result = object_writeBlock(contextP, uriP,
+                                           message->block1_num * message->block1_size,
+                                           message->payload, message->payload_len,
+                                           message->block1_more);
+            }
             else if (LWM2M_URI_IS_SET_INSTANCE(uriP))
             {
                 result = object_write(contextP, uriP, format, message->payload, message->payload_len);
@@ -360,10 +421,517 @@ coap_status_t dm_handleRequest(lwm2m_context_t * contextP,
 
 #define ID_AS_STRING_MAX_LEN 8
 
+static void prv_resultCallback(lwm2m_transaction_t * transacP, void * message);
+
+static dm_data_t * prv_newData(lwm2m_context_t * contextP,
+                               lwm2m_client_t * clientP,
+                               lwm2m_uri_t * uriP,
+                               lwm2m_result_callback_t callback,
+                               void * userData)
+{
+    dm_data_t * dataP;
+
+    dataP = (dm_data_t *)lwm2m_malloc(sizeof(dm_data_t));
+    if (dataP == NULL) return NULL;
+
+    memcpy(&dataP->uri, uriP, sizeof(lwm2m_uri_t));
+    dataP->clientID = clientP->internalID;
+    dataP->callback = callback;
+    dataP->userData = userData;
+    dataP->contextP = contextP;
+    dataP->block2P = NULL;
+    dataP->block1P = NULL;
+
+    return dataP;
+}
+
+static void prv_freeData(dm_data_t * dataP)
+{
+    if (dataP->block2P != NULL)
+    {
+        lwm2m_client_t * clientP;
+
+        clientP = lwm2m_get_client(dataP->contextP, dataP->clientID);
+        if (clientP != NULL && clientP->block2Count > 0) clientP->block2Count--;
+
+        lwm2m_free(dataP->block2P->buffer);
+        lwm2m_free(dataP->block2P);
+    }
+    if (dataP->block1P != NULL)
+    {
+        lwm2m_free(dataP->block1P->buffer);
+        lwm2m_free(dataP->block1P);
+    }
+    lwm2m_free(dataP);
+}
+
+static lwm2m_client_etag_t * prv_findETag(lwm2m_client_t * clientP,
+                                          lwm2m_uri_t * uriP,
+                                          lwm2m_client_etag_t ** previousP)
+{
+    lwm2m_client_etag_t * etagP;
+    lwm2m_client_etag_t * prevP = NULL;
+
+    for (etagP = clientP->etagList ; etagP != NULL ; etagP = etagP->next)
+    {
+        if (etagP->uri.flag == uriP->flag
+         && etagP->uri.objectId == uriP->objectId
+         && etagP->uri.instanceId == uriP->instanceId
+         && etagP->uri.resourceId == uriP->resourceId)
+        {
+            break;
+        }
+        prevP = etagP;
+    }
+    if (previousP != NULL) *previousP = prevP;
+
+    return etagP;
+}
+
+/*
+ * Remembers the ETag of a read response so that lwm2m_dm_read_if_changed()
+ * can present it. The most recent ETags are kept first in the list.
+ */
+static void prv_updateETag(dm_data_t * dataP,
+                           coap_packet_t * packet)
+{
+    lwm2m_client_t * clientP;
+    lwm2m_client_etag_t * etagP;
+    lwm2m_client_etag_t * prevP;
+
+    if (packet->code != COAP_205_CONTENT && packet->code != COAP_203_VALID) return;
+
+    clientP = lwm2m_get_client(dataP->contextP, dataP->clientID);
+    if (clientP == NULL) return;
+
+    etagP = prv_findETag(clientP, &dataP->uri, &prevP);
+    if (etagP != NULL)
+    {
+        if (prevP == NULL) clientP->etagList = etagP->next;
+        else prevP->next = etagP->next;
+    }
+
+    if (!IS_OPTION(packet, COAP_OPTION_ETAG) || packet->etag_len == 0)
+    {
+        lwm2m_free(etagP);
+        return;
+    }
+
+    if (etagP == NULL)
+    {
+        lwm2m_client_etag_t ** lastP;
+        int count = 0;
+
+        // drop the least recently used ETag
+        lastP = &clientP->etagList;
+        while (*lastP != NULL && (*lastP)->next != NULL)
+        {
+            count++;
+            lastP = &(*lastP)->next;
+        }
+        if (*lastP != NULL && count + 1 >= LWM2M_CLIENT_MAX_ETAGS)
+        {
+            lwm2m_free(*lastP);
+            *lastP = NULL;
+        }
+
+        etagP = (lwm2m_client_etag_t *)lwm2m_malloc(sizeof(lwm2m_client_etag_t));
+        if (etagP == NULL) return;
+        memcpy(&etagP->uri, &dataP->uri, sizeof(lwm2m_uri_t));
+    }
+    etagP->etagLen = MIN(packet->etag_len, sizeof(etagP->etag));
+    memcpy(etagP->etag, packet->etag, etagP->etagLen);
+    etagP->next = clientP->etagList;
+    clientP->etagList = etagP;
+}
+
+static uint16_t prv_getBlockSize(lwm2m_context_t * contextP,
+                                 lwm2m_client_t * clientP)
+{
+    uint16_t blockSize;
+
+    // unless set with lwm2m_set_block_size(), the client picks the size of the blocks
+    blockSize = contextP->blockSize != 0 ? contextP->blockSize : LWM2M_MAX_BLOCK_SIZE;
+    if (clientP->blockSize != 0 && clientP->blockSize < blockSize)
+    {
+        return clientP->blockSize;
+    }
+    return blockSize;
+}
+
+static void prv_block1Progress(dm_data_t * dataP,
+                               size_t acknowledged)
+{
+    lwm2m_context_t * contextP = dataP->contextP;
+    dm_block1_t * block1P = dataP->block1P;
+
+    if (contextP->progressCallback == NULL) return;
+    if (acknowledged < block1P->length
+     && acknowledged - block1P->reported < LWM2M_PROGRESS_WINDOW)
+    {
+        return;
+    }
+
+    block1P->reported = acknowledged;
+    contextP->progressCallback(dataP->clientID, &dataP->uri, acknowledged, block1P->length, contextP->progressUserData);
+}
+
+// returns the transaction_send() result, COAP_500_INTERNAL_SERVER_ERROR if the callback was not called
+static int prv_block1Send(dm_data_t * dataP)
+{
+    dm_block1_t * block1P = dataP->block1P;
+    lwm2m_client_t * clientP;
+    lwm2m_transaction_t * transaction;
+    size_t length;
+
+    clientP = lwm2m_get_client(dataP->contextP, dataP->clientID);
+    if (clientP == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+
+    transaction = transaction_new(clientP->sessionH, block1P->method, clientP->altPath, &dataP->uri, dataP->contextP->nextMID++, 4, NULL);
+    if (transaction == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+
+    length = MIN(block1P->blockSize, block1P->length - block1P->offset);
+    coap_set_header_content_type(transaction->message, block1P->format);
+    coap_set_header_block1(transaction->message,
+                           block1P->offset / block1P->blockSize,
+                           block1P->offset + length < block1P->length,
+                           block1P->blockSize);
+    if (block1P->offset == 0)
+    {
+        coap_set_header_size1(transaction->message, (uint32_t)block1P->length);
+    }
+    coap_set_payload(transaction->message, block1P->buffer + block1P->offset, length);
+    transaction->callback = prv_resultCallback;
+    transaction->userData = (void *)dataP;
+
+    transaction_add(dataP->contextP, transaction);
+
+    return transaction_send(dataP->contextP, transaction);
+}
+
+/*
+ * Sends the next block on a 2.31 Continue. Returns false on the response to
+ * the last block, which is then reported as a regular response.
+ */
+static bool prv_block1Continue(dm_data_t * dataP,
+                               coap_packet_t * packet)
+{
+    dm_block1_t * block1P = dataP->block1P;
+    size_t acknowledged;
+    uint32_t num;
+    uint16_t size;
+    coap_status_t result = COAP_500_INTERNAL_SERVER_ERROR;
+
+    acknowledged = block1P->offset + MIN(block1P->blockSize, block1P->length - block1P->offset);
+
+    if (packet == NULL) return false;
+    if (packet->code != COAP_231_CONTINUE)
+    {
+        if (acknowledged == block1P->length && packet->code < COAP_400_BAD_REQUEST)
+        {
+            prv_block1Progress(dataP, acknowledged);
+        }
+        return false;
+    }
+
+    if (acknowledged < block1P->length
+     && coap_get_header_block1(packet, &num, NULL, &size, NULL)
+     && num == block1P->offset / block1P->blockSize
+     && size <= block1P->blockSize)
+    {
+        if (size < block1P->blockSize)
+        {
+            // the client asks for smaller blocks
+            lwm2m_client_t * clientP;
+
+            clientP = lwm2m_get_client(dataP->contextP, dataP->clientID);
+            if (clientP != NULL) clientP->blockSize = size;
+            block1P->blockSize = size;
+        }
+        block1P->offset = acknowledged;
+        prv_block1Progress(dataP, acknowledged);
+
+        if (COAP_500_INTERNAL_SERVER_ERROR != prv_block1Send(dataP))
+        {
+            // any failure is reported by the transaction callback
+            return true;
+        }
+    }
+    else
+    {
+        LOG_ARG("Unexpected 2.31 for the block at %u", block1P->offset);
+    }
+
+    if (dataP->callback != NULL)
+    {
+        dataP->callback(dataP->clientID,
+                        &dataP->uri,
+                        result,
+                        LWM2M_CONTENT_TEXT, NULL, 0,
+                        dataP->userData);
+    }
+    prv_freeData(dataP);
+
+    return true;
+}
+
+// copies a block of the response at its offset
+static coap_status_t prv_block2Store(dm_block2_t * block2P,
+                                     coap_packet_t * packet)
+{
+    uint32_t num;
+    uint8_t more;
+    uint16_t size;
+    size_t offset;
+
+    if (packet == NULL) return COAP_503_SERVICE_UNAVAILABLE;
+    if (packet->code != COAP_205_CONTENT) return packet->code;
+    if (0 == coap_get_header_block2(packet, &num, &more, &size, NULL)
+     || size != block2P->blockSize
+     || (more && packet->payload_len != size))
+    {
+        return COAP_500_INTERNAL_SERVER_ERROR;
+    }
+
+    offset = (size_t)num * size;
+    if (offset + packet->payload_len > LWM2M_MAX_BLOCK2_SIZE
+     || (block2P->size2 != 0 && offset + packet->payload_len > block2P->size2))
+    {
+        return COAP_413_ENTITY_TOO_LARGE;
+    }
+
+    if (offset + packet->payload_len > block2P->bufferSize)
+    {
+        uint8_t * newBuffer;
+        size_t newSize;
+
+        newSize = 2 * block2P->bufferSize;
+        if (newSize < offset + packet->payload_len) newSize = offset + packet->payload_len;
+        newBuffer = (uint8_t *)lwm2m_malloc(newSize);
+        if (newBuffer == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+        memcpy(newBuffer, block2P->buffer, block2P->length);
+        lwm2m_free(block2P->buffer);
+        block2P->buffer = newBuffer;
+        block2P->bufferSize = newSize;
+    }
+
+    memcpy(block2P->buffer + offset, packet->payload, packet->payload_len);
+    if (offset + packet->payload_len > block2P->length)
+    {
+        block2P->length = offset + packet->payload_len;
+    }
+    if (!more)
+    {
+        if (block2P->lastNum != UINT32_MAX && block2P->lastNum != num) return COAP_500_INTERNAL_SERVER_ERROR;
+        block2P->lastNum = num;
+    }
+    block2P->received++;
+
+    return NO_ERROR;
+}
+
+static coap_status_t prv_block2Request(dm_data_t * dataP,
+                                       uint32_t num)
+{
+    dm_block2_t * block2P = dataP->block2P;
+    lwm2m_client_t * clientP;
+    lwm2m_transaction_t * transaction;
+
+    clientP = lwm2m_get_client(dataP->contextP, dataP->clientID);
+    if (clientP == NULL) return COAP_404_NOT_FOUND;
+
+    transaction = transaction_new(clientP->sessionH, COAP_GET, clientP->altPath, &dataP->uri, dataP->contextP->nextMID++, 4, NULL);
+    if (transaction == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+
+    coap_set_header_accept(transaction->message, block2P->accept);
+    coap_set_header_block2(transaction->message, num, 0, block2P->blockSize);
+    transaction->callback = prv_resultCallback;
+    transaction->userData = (void *)dataP;
+
+    transaction_add(dataP->contextP, transaction);
+    block2P->pending++;
+    if (COAP_500_INTERNAL_SERVER_ERROR == transaction_send(dataP->contextP, transaction))
+    {
+        // the transaction was dropped without calling back
+        block2P->pending--;
+        return COAP_500_INTERNAL_SERVER_ERROR;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ * Requests the next blocks: all the remaining ones up to
+ * LWM2M_BLOCK2_PIPELINE_DEPTH when the client announced the total size,
+ * otherwise one at a time. Reports the result once all the blocks are there
+ * or on the first error, and releases dataP when nothing is in flight.
+ */
+static void prv_block2Step(dm_data_t * dataP)
+{
+    dm_block2_t * block2P = dataP->block2P;
+
+    // holds dataP while the sends may call back synchronously
+    block2P->pending++;
+
+    while (block2P->status == NO_ERROR
+        && (block2P->lastNum == UINT32_MAX || block2P->nextNum <= block2P->lastNum))
+    {
+        if (block2P->size2 != 0)
+        {
+            if (block2P->nextNum > (block2P->size2 - 1) / block2P->blockSize) break;
+            if (block2P->pending > LWM2M_BLOCK2_PIPELINE_DEPTH) break;
+        }
+        else if (block2P->pending > 1) break;
+
+        block2P->status = prv_block2Request(dataP, block2P->nextNum);
+        block2P->nextNum++;
+    }
+
+    block2P->pending--;
+
+    if (dataP->callback != NULL)
+    {
+        if (block2P->status != NO_ERROR)
+        {
+            dataP->callback(dataP->clientID,
+                            &dataP->uri,
+                            block2P->status,
+                            LWM2M_CONTENT_TEXT, NULL, 0,
+                            dataP->userData);
+            dataP->callback = NULL;
+        }
+        else if (block2P->lastNum != UINT32_MAX
+              && block2P->received == block2P->lastNum + 1)
+        {
+            LOG_ARG("Block2 response complete: %u bytes", block2P->length);
+            dataP->callback(dataP->clientID,
+                            &dataP->uri,
+                            COAP_205_CONTENT,
+                            block2P->format,
+                            block2P->buffer,
+                            block2P->length,
+                            dataP->userData);
+            dataP->callback = NULL;
+        }
+    }
+
+    // the callback is cleared once the result is reported
+    if (dataP->callback == NULL && block2P->pending == 0)
+    {
+        prv_freeData(dataP);
+    }
+}
+
+static coap_status_t prv_block2Start(dm_data_t * dataP,
+                                     lwm2m_transaction_t * transacP,
+                                     coap_packet_t * packet)
+{
+    coap_packet_t * request = (coap_packet_t *)transacP->message;
+    lwm2m_client_t * clientP;
+    dm_block2_t * block2P;
+
+    clientP = lwm2m_get_client(dataP->contextP, dataP->clientID);
+    if (clientP == NULL) return COAP_404_NOT_FOUND;
+    if (clientP->block2Count >= LWM2M_CLIENT_MAX_BLOCK2)
+    {
+        LOG_ARG("Client %d: too many Block2 transfers", dataP->clientID);
+        return COAP_503_SERVICE_UNAVAILABLE;
+    }
+    if (IS_OPTION(packet, COAP_OPTION_SIZE) && packet->size > LWM2M_MAX_BLOCK2_SIZE)
+    {
+        return COAP_413_ENTITY_TOO_LARGE;
+    }
+
+    block2P = (dm_block2_t *)lwm2m_malloc(sizeof(dm_block2_t));
+    if (block2P == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+    memset(block2P, 0, sizeof(dm_block2_t));
+
+    block2P->blockSize = packet->block2_size;
+    clientP->blockSize = packet->block2_size;
+    block2P->size2 = IS_OPTION(packet, COAP_OPTION_SIZE) ? packet->size : 0;
+    block2P->bufferSize = 2 * (size_t)block2P->blockSize;
+    if (block2P->bufferSize < block2P->size2) block2P->bufferSize = block2P->size2;
+    block2P->buffer = (uint8_t *)lwm2m_malloc(block2P->bufferSize);
+    if (block2P->buffer == NULL)
+    {
+        lwm2m_free(block2P);
+        return COAP_500_INTERNAL_SERVER_ERROR;
+    }
+    block2P->accept = request->accept_num > 0 ? request->accept[0] : packet->content_type;
+    block2P->format = utils_convertMediaType(packet->content_type);
+    block2P->nextNum = 1;
+    block2P->lastNum = UINT32_MAX;
+
+    dataP->block2P = block2P;
+    clientP->block2Count++;
+
+    block2P->status = prv_block2Store(block2P, packet);
+
+    return NO_ERROR;
+}
+
 static void prv_resultCallback(lwm2m_transaction_t * transacP,
                                void * message)
 {
     dm_data_t * dataP = (dm_data_t *)transacP->userData;
+    coap_packet_t * packet = (coap_packet_t *)message;
+
+    if (dataP->block1P != NULL
+     && prv_block1Continue(dataP, packet))
+    {
+        return;
+    }
+
+    if (dataP->block2P == NULL && packet != NULL)
+    {
+        prv_updateETag(dataP, packet);
+    }
+
+    if (dataP->block2P != NULL)
+    {
+        // response to the request of a following block
+        dataP->block2P->pending--;
+        if (dataP->block2P->status == NO_ERROR)
+        {
+            dataP->block2P->status = prv_block2Store(dataP->block2P, packet);
+        }
+        prv_block2Step(dataP);
+        return;
+    }
+
+    if (packet != NULL
+     && dataP->callback != NULL
+     && packet->code == COAP_205_CONTENT
+     && IS_OPTION(packet, COAP_OPTION_BLOCK2)
+     && packet->block2_num == 0
+     && packet->block2_more)
+    {
+        coap_status_t result;
+
+        // first block: the user callback is called once all of them are received
+        result = prv_block2Start(dataP, transacP, packet);
+        if (result == NO_ERROR)
+        {
+            prv_block2Step(dataP);
+        }
+        else
+        {
+            dataP->callback(dataP->clientID,
+                            &dataP->uri,
+                            result,
+                            LWM2M_CONTENT_TEXT, NULL, 0,
+                            dataP->userData);
+            prv_freeData(dataP);
+        }
+        return;
+    }
+
+    if (dataP->callback == NULL)
+    {
+        // only kept to send the blocks of the request
+        prv_freeData(dataP);
+        return;
+    }
 
     if (message == NULL)
     {
@@ -375,8 +943,6 @@ static void prv_resultCallback(lwm2m_transaction_t * transacP,
     }
     else
     {
-        coap_packet_t * packet = (coap_packet_t *)message;
-
         //if packet is a CREATE response and the instanceId was assigned by the client
         if (packet->code == COAP_201_CREATED
          && packet->location_path != NULL)
@@ -414,7 +980,7 @@ static void prv_resultCallback(lwm2m_transaction_t * transacP,
                         packet->payload_len,
                         dataP->userData);
     }
-    lwm2m_free(dataP);
+    prv_freeData(dataP);
 }
 
 static int prv_makeOperation(lwm2m_context_t * contextP,
@@ -424,57 +990,116 @@ static int prv_makeOperation(lwm2m_context_t * contextP,
                              lwm2m_media_type_t format,
                              uint8_t * buffer,
                              int length,
+                             bool ifChanged,
                              lwm2m_result_callback_t callback,
                              void * userData)
 {
     lwm2m_client_t * clientP;
     lwm2m_transaction_t * transaction;
     dm_data_t * dataP;
+    uint16_t blockSize;
+    bool blockwise = false;
 
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = lwm2m_get_client(contextP, clientID);
     if (clientP == NULL) return COAP_404_NOT_FOUND;
 
     transaction = transaction_new(clientP->sessionH, method, clientP->altPath, uriP, contextP->nextMID++, 4, NULL);
     if (transaction == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
 
+    blockSize = prv_getBlockSize(contextP, clientP);
     if (method == COAP_GET)
     {
         coap_set_header_accept(transaction->message, format);
+        if (ifChanged)
+        {
+            lwm2m_client_etag_t * etagP;
+
+            etagP = prv_findETag(clientP, uriP, NULL);
+            if (etagP != NULL)
+            {
+                coap_set_header_etag(transaction->message, etagP->etag, etagP->etagLen);
+            }
+        }
+        if (blockSize < LWM2M_MAX_BLOCK_SIZE)
+        {
+            // early negotiation of the block size of the response
+            coap_set_header_block2(transaction->message, 0, 0, blockSize);
+        }
     }
     else if (buffer != NULL)
     {
         coap_set_header_content_type(transaction->message, format);
-        // TODO: Take care of fragmentation
-        coap_set_payload(transaction->message, buffer, length);
+        if (length > blockSize)
+        {
+            // the following blocks are sent by prv_resultCallback() on each 2.31 Continue
+            blockwise = true;
+            coap_set_header_block1(transaction->message, 0, 1, blockSize);
+            // announce the total size so the client can allocate it at once
+            coap_set_header_size1(transaction->message, (uint32_t)length);
+            coap_set_payload(transaction->message, buffer, blockSize);
+        }
+        else
+        {
+            coap_set_payload(transaction->message, buffer, length);
+        }
     }
 
-    if (callback != NULL)
+    if (callback != NULL || blockwise)
     {
-        dataP = (dm_data_t *)lwm2m_malloc(sizeof(dm_data_t));
+        dataP = prv_newData(contextP, clientP, uriP, callback, userData);
         if (dataP == NULL)
         {
             transaction_free(transaction);
             return COAP_500_INTERNAL_SERVER_ERROR;
         }
-        memcpy(&dataP->uri, uriP, sizeof(lwm2m_uri_t));
-        dataP->clientID = clientP->internalID;
-        dataP->callback = callback;
-        dataP->userData = userData;
+
+        if (blockwise)
+        {
+            dataP->block1P = (dm_block1_t *)lwm2m_malloc(sizeof(dm_block1_t));
+            if (dataP->block1P != NULL)
+            {
+                memset(dataP->block1P, 0, sizeof(dm_block1_t));
+                dataP->block1P->buffer = (uint8_t *)lwm2m_malloc(length);
+            }
+            if (dataP->block1P == NULL || dataP->block1P->buffer == NULL)
+            {
+                prv_freeData(dataP);
+                transaction_free(transaction);
+                return COAP_500_INTERNAL_SERVER_ERROR;
+            }
+            memcpy(dataP->block1P->buffer, buffer, length);
+            dataP->block1P->length = length;
+            dataP->block1P->blockSize = blockSize;
+            dataP->block1P->method = method;
+            dataP->block1P->format = format;
+            // the first block now refers to the copy
+            coap_set_payload(transaction->message, dataP->block1P->buffer, blockSize);
+        }
 
         transaction->callback = prv_resultCallback;
         transaction->userData = (void *)dataP;
     }
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
+    transaction_add(contextP, transaction);
 
     return transaction_send(contextP, transaction);
 }
 
-int lwm2m_dm_read(lwm2m_context_t * contextP,
-                  uint16_t clientID,
-                  lwm2m_uri_t * uriP,
-                  lwm2m_result_callback_t callback,
-                  void * userData)
+void lwm2m_set_progress_callback(lwm2m_context_t * contextP,
+                                 lwm2m_progress_callback_t callback,
+                                 void * userData)
+{
+    LOG("Entering");
+    contextP->progressCallback = callback;
+    contextP->progressUserData = userData;
+}
+
+static int prv_read(lwm2m_context_t * contextP,
+                    uint16_t clientID,
+                    lwm2m_uri_t * uriP,
+                    bool ifChanged,
+                    lwm2m_result_callback_t callback,
+                    void * userData)
 {
     lwm2m_client_t * clientP;
     lwm2m_media_type_t format;
@@ -482,7 +1107,7 @@ int lwm2m_dm_read(lwm2m_context_t * contextP,
     LOG_ARG("clientID: %d", clientID);
     LOG_URI(uriP);
 
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = lwm2m_get_client(contextP, clientID);
     if (clientP == NULL) return COAP_404_NOT_FOUND;
 
     if (clientP->supportJSON == true)
@@ -498,9 +1123,28 @@ int lwm2m_dm_read(lwm2m_context_t * contextP,
                              COAP_GET,
                              format,
                              NULL, 0,
+                             ifChanged,
                              callback, userData);
 }
 
+int lwm2m_dm_read(lwm2m_context_t * contextP,
+                  uint16_t clientID,
+                  lwm2m_uri_t * uriP,
+                  lwm2m_result_callback_t callback,
+                  void * userData)
+{
+    return prv_read(contextP, clientID, uriP, false, callback, userData);
+}
+
+int lwm2m_dm_read_if_changed(lwm2m_context_t * contextP,
+                             uint16_t clientID,
+                             lwm2m_uri_t * uriP,
+                             lwm2m_result_callback_t callback,
+                             void * userData)
+{
+    return prv_read(contextP, clientID, uriP, true, callback, userData);
+}
+
 int lwm2m_dm_write(lwm2m_context_t * contextP,
                    uint16_t clientID,
                    lwm2m_uri_t * uriP,
@@ -523,6 +1167,7 @@ int lwm2m_dm_write(lwm2m_context_t * contextP,
         return prv_makeOperation(contextP, clientID, uriP,
                                   COAP_PUT,
                                   format, buffer, length,
+                                  false,
                                   callback, userData);
     }
     else
@@ -530,6 +1175,7 @@ int lwm2m_dm_write(lwm2m_context_t * contextP,
         return prv_makeOperation(contextP, clientID, uriP,
                                   COAP_POST,
                                   format, buffer, length,
+                                  false,
                                   callback, userData);
     }
 }
@@ -553,6 +1199,7 @@ int lwm2m_dm_execute(lwm2m_context_t * contextP,
     return prv_makeOperation(contextP, clientID, uriP,
                               COAP_POST,
                               format, buffer, length,
+                              false,
                               callback, userData);
 }
 
@@ -577,6 +1224,7 @@ int lwm2m_dm_create(lwm2m_context_t * contextP,
     return prv_makeOperation(contextP, clientID, uriP,
                               COAP_POST,
                               format, buffer, length,
+                              false,
                               callback, userData);
 }
 
@@ -597,6 +1245,7 @@ int lwm2m_dm_delete(lwm2m_context_t * contextP,
     return prv_makeOperation(contextP, clientID, uriP,
                               COAP_DELETE,
                               LWM2M_CONTENT_TEXT, NULL, 0,
+                              false,
                               callback, userData);
 }
 
@@ -623,7 +1272,7 @@ int lwm2m_dm_write_attributes(lwm2m_context_t * contextP,
     if (ATTR_FLAG_NUMERIC == (attrP->toSet & ATTR_FLAG_NUMERIC)
      && (attrP->lessThan + 2 * attrP->step >= attrP->greaterThan)) return COAP_400_BAD_REQUEST;
 
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = lwm2m_get_client(contextP, clientID);
     if (clientP == NULL) return COAP_404_NOT_FOUND;
 
     transaction = transaction_new(clientP->sessionH, COAP_PUT, clientP->altPath, uriP, contextP->nextMID++, 4, NULL);
@@ -633,16 +1282,12 @@ int lwm2m_dm_write_attributes(lwm2m_context_t * contextP,
     {
         dm_data_t * dataP;
 
-        dataP = (dm_data_t *)lwm2m_malloc(sizeof(dm_data_t));
+        dataP = prv_newData(contextP, clientP, uriP, callback, userData);
         if (dataP == NULL)
         {
             transaction_free(transaction);
             return COAP_500_INTERNAL_SERVER_ERROR;
         }
-        memcpy(&dataP->uri, uriP, sizeof(lwm2m_uri_t));
-        dataP->clientID = clientP->internalID;
-        dataP->callback = callback;
-        dataP->userData = userData;
 
         transaction->callback = prv_resultCallback;
         transaction->userData = (void *)dataP;
@@ -712,31 +1357,31 @@ int lwm2m_dm_write_attributes(lwm2m_context_t * contextP,
     }
     if (attrP->toClear & LWM2M_ATTR_FLAG_MIN_PERIOD)
     {
-        coap_add_multi_option(&(coap_pkt->uri_query), ATTR_MIN_PERIOD_STR, ATTR_MIN_PERIOD_LEN -1, 0);
+        coap_add_multi_option(&(coap_pkt->uri_query), (uint8_t *)ATTR_MIN_PERIOD_STR, ATTR_MIN_PERIOD_LEN -1, 0);
         SET_OPTION(coap_pkt, COAP_OPTION_URI_QUERY);
     }
     if (attrP->toClear & LWM2M_ATTR_FLAG_MAX_PERIOD)
     {
-        coap_add_multi_option(&(coap_pkt->uri_query), ATTR_MAX_PERIOD_STR, ATTR_MAX_PERIOD_LEN - 1, 0);
+        coap_add_multi_option(&(coap_pkt->uri_query), (uint8_t *)ATTR_MAX_PERIOD_STR, ATTR_MAX_PERIOD_LEN - 1, 0);
         SET_OPTION(coap_pkt, COAP_OPTION_URI_QUERY);
     }
     if (attrP->toClear & LWM2M_ATTR_FLAG_GREATER_THAN)
     {
-        coap_add_multi_option(&(coap_pkt->uri_query), ATTR_GREATER_THAN_STR, ATTR_GREATER_THAN_LEN - 1, 0);
+        coap_add_multi_option(&(coap_pkt->uri_query), (uint8_t *)ATTR_GREATER_THAN_STR, ATTR_GREATER_THAN_LEN - 1, 0);
         SET_OPTION(coap_pkt, COAP_OPTION_URI_QUERY);
     }
     if (attrP->toClear & LWM2M_ATTR_FLAG_LESS_THAN)
     {
-        coap_add_multi_option(&(coap_pkt->uri_query), ATTR_LESS_THAN_STR, ATTR_LESS_THAN_LEN - 1, 0);
+        coap_add_multi_option(&(coap_pkt->uri_query), (uint8_t *)ATTR_LESS_THAN_STR, ATTR_LESS_THAN_LEN - 1, 0);
         SET_OPTION(coap_pkt, COAP_OPTION_URI_QUERY);
     }
     if (attrP->toClear & LWM2M_ATTR_FLAG_STEP)
     {
-        coap_add_multi_option(&(coap_pkt->uri_query), ATTR_STEP_STR, ATTR_STEP_LEN - 1, 0);
+        coap_add_multi_option(&(coap_pkt->uri_query), (uint8_t *)ATTR_STEP_STR, ATTR_STEP_LEN - 1, 0);
         SET_OPTION(coap_pkt, COAP_OPTION_URI_QUERY);
     }
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
+    transaction_add(contextP, transaction);
 
     return transaction_send(contextP, transaction);
 }
@@ -753,7 +1398,7 @@ int lwm2m_dm_discover(lwm2m_context_t * contextP,
 
     LOG_ARG("clientID: %d", clientID);
     LOG_URI(uriP);
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = lwm2m_get_client(contextP, clientID);
     if (clientP == NULL) return COAP_404_NOT_FOUND;
 
     transaction = transaction_new(clientP->sessionH, COAP_GET, clientP->altPath, uriP, contextP->nextMID++, 4, NULL);
@@ -763,22 +1408,18 @@ int lwm2m_dm_discover(lwm2m_context_t * contextP,
 
     if (callback != NULL)
     {
-        dataP = (dm_data_t *)lwm2m_malloc(sizeof(dm_data_t));
+        dataP = prv_newData(contextP, clientP, uriP, callback, userData);
         if (dataP == NULL)
         {
             transaction_free(transaction);
             return COAP_500_INTERNAL_SERVER_ERROR;
         }
-        memcpy(&dataP->uri, uriP, sizeof(lwm2m_uri_t));
-        dataP->clientID = clientP->internalID;
-        dataP->callback = callback;
-        dataP->userData = userData;
 
         transaction->callback = prv_resultCallback;
         transaction->userData = (void *)dataP;
     }
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
+    transaction_add(contextP, transaction);
 
     return transaction_send(contextP, transaction);
 }
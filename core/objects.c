@@ -263,6 +263,7 @@ coap_status_t object_write(lwm2m_context_t * contextP,
     if (result == NO_ERROR)
     {
         result = targetP->writeFunc(uriP->instanceId, size, dataP, targetP);
+        targetP->version++;
         lwm2m_data_free(size, dataP);
     }
 
@@ -271,6 +272,82 @@ coap_status_t object_write(lwm2m_context_t * contextP,
     return result;
 }
 
+/*
+ * Builds the ETag of the representation of uriP requested with the given
+ * Accept option (-1 if none). Returns its length or 0 if the object is unknown
+ * or does not report its changes.
+ */
+size_t object_getETag(lwm2m_context_t * contextP,
+                      lwm2m_uri_t * uriP,
+                      int32_t accept,
+                      uint8_t etag[LWM2M_ETAG_LEN])
+{
+    lwm2m_object_t * targetP;
+
+    targetP = (lwm2m_object_t *)LWM2M_LIST_FIND(contextP->objectList, uriP->objectId);
+    if (NULL == targetP || !targetP->reportsChanges) return 0;
+
+    etag[0] = (uint8_t)(targetP->version >> 24);
+    etag[1] = (uint8_t)(targetP->version >> 16);
+    etag[2] = (uint8_t)(targetP->version >> 8);
+    etag[3] = (uint8_t)targetP->version;
+    etag[4] = (uint8_t)(accept >> 8);
+    etag[5] = (uint8_t)accept;
+
+    return LWM2M_ETAG_LEN;
+}
+
+bool object_isBlockWritable(lwm2m_context_t * contextP,
+                            lwm2m_uri_t * uriP,
+                            lwm2m_media_type_t format)
+{
+    lwm2m_object_t * targetP;
+
+    if (format != LWM2M_CONTENT_OPAQUE) return false;
+    if (!LWM2M_URI_IS_SET_RESOURCE(uriP)) return false;
+
+    targetP = (lwm2m_object_t *)LWM2M_LIST_FIND(contextP->objectList, uriP->objectId);
+    if (NULL == targetP) return false;
+
+    return targetP->blockWriteFunc != NULL;
+}
+
+coap_status_t object_writeBlock(lwm2m_context_t * contextP,
+                                lwm2m_uri_t * uriP,
+                                uint32_t offset,
+                                uint8_t * buffer,
+                                size_t length,
+                                bool more)
+{
+    coap_status_t result;
+    lwm2m_object_t * targetP;
+
+    LOG_URI(uriP);
+    LOG_ARG("offset: %u, length: %u, more: %d", offset, length, more);
+    targetP = (lwm2m_object_t *)LWM2M_LIST_FIND(contextP->objectList, uriP->objectId);
+    if (NULL == targetP)
+    {
+        result = COAP_404_NOT_FOUND;
+    }
+    else if (NULL == targetP->blockWriteFunc)
+    {
+        result = COAP_405_METHOD_NOT_ALLOWED;
+    }
+    else
+    {
+        result = targetP->blockWriteFunc(uriP->instanceId, uriP->resourceId, offset, buffer, length, more, targetP);
+        targetP->version++;
+        if (result == COAP_204_CHANGED && more)
+        {
+            result = COAP_231_CONTINUE;
+        }
+    }
+
+    LOG_ARG("result: %u.%2u", (result & 0xFF) >> 5, (result & 0x1F));
+
+    return result;
+}
+
 coap_status_t object_execute(lwm2m_context_t * contextP,
                              lwm2m_uri_t * uriP,
                              uint8_t * buffer,
@@ -284,6 +361,7 @@ coap_status_t object_execute(lwm2m_context_t * contextP,
     if (NULL == targetP->executeFunc) return COAP_405_METHOD_NOT_ALLOWED;
     if (NULL == lwm2m_list_find(targetP->instanceList, uriP->instanceId)) return COAP_404_NOT_FOUND;
 
+    targetP->version++;
     return targetP->executeFunc(uriP->instanceId, uriP->resourceId, buffer, length, targetP);
 }
 
@@ -347,6 +425,7 @@ coap_status_t object_create(lwm2m_context_t * contextP,
 
 exit:
     lwm2m_data_free(size, dataP);
+    targetP->version++;
 
     LOG_ARG("result: %u.%2u", (result & 0xFF) >> 5, (result & 0x1F));
 
@@ -366,6 +445,7 @@ coap_status_t object_delete(lwm2m_context_t * contextP,
 
     LOG("Entering");
 
+    objectP->version++;
     if (LWM2M_URI_IS_SET_INSTANCE(uriP))
     {
         result = objectP->deleteFunc(uriP->instanceId, objectP);
@@ -818,6 +898,7 @@ coap_status_t object_createInstance(lwm2m_context_t * contextP,
         return COAP_405_METHOD_NOT_ALLOWED;
     }
 
+    targetP->version++;
     return targetP->createFunc(lwm2m_list_newId(targetP->instanceList), dataP->value.asChildren.count, dataP->value.asChildren.array, targetP);
 }
 
@@ -836,6 +917,7 @@ coap_status_t object_writeInstance(lwm2m_context_t * contextP,
         return COAP_405_METHOD_NOT_ALLOWED;
     }
 
+    targetP->version++;
     return targetP->writeFunc(dataP->id, dataP->value.asChildren.count, dataP->value.asChildren.array, targetP);
 }
 
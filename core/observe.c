@@ -52,19 +52,37 @@
 
 
 #ifdef LWM2M_CLIENT_MODE
+/*
+ * Observations are also chained in buckets by object and instance ID, object
+ * level observations using LWM2M_MAX_ID as instance ID, so that a value change
+ * only visits the observations it may concern.
+ */
+static lwm2m_observed_t ** prv_getBucket(lwm2m_context_t * contextP,
+                                         uint16_t objectId,
+                                         uint16_t instanceId)
+{
+    return &contextP->observedTable[((uint32_t)objectId * 31 + instanceId) % LWM2M_OBSERVED_TABLE_SIZE];
+}
+
+static lwm2m_observed_t ** prv_getUriBucket(lwm2m_context_t * contextP,
+                                            lwm2m_uri_t * uriP)
+{
+    return prv_getBucket(contextP, uriP->objectId, LWM2M_URI_IS_SET_INSTANCE(uriP) ? uriP->instanceId : LWM2M_MAX_ID);
+}
+
 static lwm2m_observed_t * prv_findObserved(lwm2m_context_t * contextP,
                                            lwm2m_uri_t * uriP)
 {
     lwm2m_observed_t * targetP;
 
-    targetP = contextP->observedList;
+    targetP = *prv_getUriBucket(contextP, uriP);
     while (targetP != NULL
         && (targetP->uri.objectId != uriP->objectId
          || targetP->uri.flag != uriP->flag
          || (LWM2M_URI_IS_SET_INSTANCE(uriP) && targetP->uri.instanceId != uriP->instanceId)
          || (LWM2M_URI_IS_SET_RESOURCE(uriP) && targetP->uri.resourceId != uriP->resourceId)))
     {
-        targetP = targetP->next;
+        targetP = targetP->bucketNext;
     }
 
     return targetP;
@@ -73,6 +91,18 @@ static lwm2m_observed_t * prv_findObserved(lwm2m_context_t * contextP,
 static void prv_unlinkObserved(lwm2m_context_t * contextP,
                                lwm2m_observed_t * observedP)
 {
+    lwm2m_observed_t ** bucketP;
+
+    bucketP = prv_getUriBucket(contextP, &observedP->uri);
+    while (*bucketP != NULL && *bucketP != observedP)
+    {
+        bucketP = &(*bucketP)->bucketNext;
+    }
+    if (*bucketP != NULL)
+    {
+        *bucketP = observedP->bucketNext;
+    }
+
     if (contextP->observedList == observedP)
     {
         contextP->observedList = contextP->observedList->next;
@@ -114,6 +144,7 @@ static lwm2m_watcher_t * prv_getWatcher(lwm2m_context_t * contextP,
                                         lwm2m_server_t * serverP)
 {
     lwm2m_observed_t * observedP;
+    lwm2m_observed_t ** bucketP;
     bool allocatedObserver;
     lwm2m_watcher_t * watcherP;
 
@@ -129,6 +160,9 @@ static lwm2m_watcher_t * prv_getWatcher(lwm2m_context_t * contextP,
         memcpy(&(observedP->uri), uriP, sizeof(lwm2m_uri_t));
         observedP->next = contextP->observedList;
         contextP->observedList = observedP;
+        bucketP = prv_getUriBucket(contextP, uriP);
+        observedP->bucketNext = *bucketP;
+        *bucketP = observedP;
     }
 
     watcherP = prv_findWatcher(observedP, serverP);
@@ -139,6 +173,7 @@ static lwm2m_watcher_t * prv_getWatcher(lwm2m_context_t * contextP,
         {
             if (allocatedObserver == true)
             {
+                prv_unlinkObserved(contextP, observedP);
                 lwm2m_free(observedP);
             }
             return NULL;
@@ -146,6 +181,7 @@ static lwm2m_watcher_t * prv_getWatcher(lwm2m_context_t * contextP,
         memset(watcherP, 0, sizeof(lwm2m_watcher_t));
         watcherP->active = false;
         watcherP->server = serverP;
+        watcherP->observed = observedP;
         watcherP->next = observedP->watcherList;
         observedP->watcherList = watcherP;
     }
@@ -153,6 +189,130 @@ static lwm2m_watcher_t * prv_getWatcher(lwm2m_context_t * contextP,
     return watcherP;
 }
 
+/*
+ * Returns true if the watcher has to wait for the acknowledgement of the
+ * confirmable notification in flight to its server.
+ */
+static bool prv_isBlocked(lwm2m_context_t * contextP,
+                          lwm2m_watcher_t * watcherP)
+{
+    return contextP->confirmableNotify && watcherP->server->notifyPending;
+}
+
+/*
+ * Returns true if the watcher has to be evaluated at some point, the date being
+ * stored in deadlineP: once its minimal period elapsed if its value changed,
+ * or when its maximal period elapses.
+ */
+static bool prv_getDeadline(lwm2m_watcher_t * watcherP,
+                            time_t * deadlineP)
+{
+    bool scheduled = false;
+
+    if (watcherP->active == false) return false;
+
+    if (watcherP->update == true)
+    {
+        *deadlineP = watcherP->lastTime;
+        if (watcherP->parameters != NULL
+         && (watcherP->parameters->toSet & LWM2M_ATTR_FLAG_MIN_PERIOD) != 0)
+        {
+            *deadlineP += watcherP->parameters->minPeriod;
+        }
+        scheduled = true;
+    }
+    if (watcherP->parameters != NULL
+     && (watcherP->parameters->toSet & LWM2M_ATTR_FLAG_MAX_PERIOD) != 0
+     && (scheduled == false || watcherP->lastTime + watcherP->parameters->maxPeriod < *deadlineP))
+    {
+        *deadlineP = watcherP->lastTime + watcherP->parameters->maxPeriod;
+        scheduled = true;
+    }
+
+    return scheduled;
+}
+
+static bool prv_deadlineBefore(lwm2m_heap_node_t * firstP,
+                               lwm2m_heap_node_t * secondP)
+{
+    return HEAP_ENTRY(firstP, lwm2m_watcher_t, heapNode)->deadline < HEAP_ENTRY(secondP, lwm2m_watcher_t, heapNode)->deadline;
+}
+
+/*
+ * Moves the watcher to its place in the heap of the context, not earlier than
+ * notBefore, or to the held list of its server if it has to wait for an
+ * acknowledgement. Watchers with nothing to report are in neither.
+ */
+static void prv_scheduleWatcher(lwm2m_context_t * contextP,
+                                lwm2m_watcher_t * watcherP,
+                                time_t notBefore)
+{
+    time_t deadline;
+
+    contextP->observeHeap = heap_remove(contextP->observeHeap, &watcherP->heapNode, prv_deadlineBefore);
+    if (watcherP->held == true) return;
+    if (prv_getDeadline(watcherP, &deadline) == false) return;
+
+    if (prv_isBlocked(contextP, watcherP))
+    {
+        watcherP->held = true;
+        watcherP->heldNext = watcherP->server->heldWatchers;
+        watcherP->server->heldWatchers = watcherP;
+        return;
+    }
+
+    if (deadline < notBefore) deadline = notBefore;
+    watcherP->deadline = deadline;
+    contextP->observeHeap = heap_insert(contextP->observeHeap, &watcherP->heapNode, prv_deadlineBefore);
+}
+
+/*
+ * Drops the notifications of the watcher held for its server in queue mode,
+ * the following ones keeping their order.
+ */
+static void prv_unqueueNotifications(lwm2m_watcher_t * watcherP)
+{
+    lwm2m_server_t * serverP = watcherP->server;
+    uint8_t count = 0;
+    uint8_t i;
+
+    for (i = 0 ; i < serverP->queueCount ; i++)
+    {
+        lwm2m_queued_notify_t * entryP = serverP->queue + (serverP->queueFirst + i) % LWM2M_QUEUE_SIZE;
+
+        if (entryP->watcher == watcherP)
+        {
+            lwm2m_free(entryP->buffer);
+        }
+        else
+        {
+            if (count != i)
+            {
+                memcpy(serverP->queue + (serverP->queueFirst + count) % LWM2M_QUEUE_SIZE, entryP, sizeof(lwm2m_queued_notify_t));
+            }
+            count++;
+        }
+    }
+    serverP->queueCount = count;
+}
+
+static void prv_freeWatcher(lwm2m_context_t * contextP,
+                            lwm2m_watcher_t * watcherP)
+{
+    prv_unqueueNotifications(watcherP);
+    contextP->observeHeap = heap_remove(contextP->observeHeap, &watcherP->heapNode, prv_deadlineBefore);
+    if (watcherP->held == true)
+    {
+        lwm2m_watcher_t ** heldP;
+
+        heldP = &watcherP->server->heldWatchers;
+        while (*heldP != watcherP) heldP = &(*heldP)->heldNext;
+        *heldP = watcherP->heldNext;
+    }
+    if (watcherP->parameters != NULL) lwm2m_free(watcherP->parameters);
+    lwm2m_free(watcherP);
+}
+
 coap_status_t observe_handleRequest(lwm2m_context_t * contextP,
                                     lwm2m_uri_t * uriP,
                                     lwm2m_server_t * serverP,
@@ -181,7 +341,7 @@ coap_status_t observe_handleRequest(lwm2m_context_t * contextP,
         watcherP->tokenLen = message->token_len;
         memcpy(watcherP->token, message->token, message->token_len);
         watcherP->active = true;
-        watcherP->lastTime = lwm2m_gettime();
+        watcherP->lastTime = utils_getTime();
         if (IS_OPTION(message, COAP_OPTION_ACCEPT))
         {
             watcherP->format = utils_convertMediaType(message->accept[0]);
@@ -207,6 +367,7 @@ coap_status_t observe_handleRequest(lwm2m_context_t * contextP,
         }
 
         coap_set_header_observe(response, watcherP->counter++);
+        prv_scheduleWatcher(contextP, watcherP, 0);
 
         return COAP_205_CONTENT;
 
@@ -246,8 +407,8 @@ void observe_cancel(lwm2m_context_t * contextP,
 
             parentP = observedP->watcherList;
             while (parentP->next != NULL
-                && (parentP->next->lastMid != mid
-                 || lwm2m_session_is_equal(parentP->next->server->sessionH, fromSessionH, contextP->userData)))
+                && ((LWM2M_MAX_ID != mid && parentP->next->lastMid != mid)
+                 || !lwm2m_session_is_equal(parentP->next->server->sessionH, fromSessionH, contextP->userData)))
             {
                 parentP = parentP->next;
             }
@@ -259,8 +420,7 @@ void observe_cancel(lwm2m_context_t * contextP,
         }
         if (targetP != NULL)
         {
-            if (targetP->parameters != NULL) lwm2m_free(targetP->parameters);
-            lwm2m_free(targetP);
+            prv_freeWatcher(contextP, targetP);
             if (observedP->watcherList == NULL)
             {
                 prv_unlinkObserved(contextP, observedP);
@@ -286,15 +446,16 @@ void observe_clear(lwm2m_context_t * contextP,
                 || observedP->uri.instanceId == uriP->instanceId))
         {
             lwm2m_observed_t * nextP;
-            lwm2m_watcher_t * watcherP;
 
             nextP = observedP->next;
 
-            for (watcherP = observedP->watcherList; watcherP != NULL; watcherP = watcherP->next)
+            while (observedP->watcherList != NULL)
             {
-                if (watcherP->parameters != NULL) lwm2m_free(watcherP->parameters);
+                lwm2m_watcher_t * watcherP = observedP->watcherList;
+
+                observedP->watcherList = watcherP->next;
+                prv_freeWatcher(contextP, watcherP);
             }
-            LWM2M_LIST_FREE(observedP->watcherList);
 
             prv_unlinkObserved(contextP, observedP);
             lwm2m_free(observedP);
@@ -403,19 +564,75 @@ coap_status_t observe_setParameters(lwm2m_context_t * contextP,
         }
     }
 
+    prv_scheduleWatcher(contextP, watcherP, 0);
+
     LOG_ARG("Final toSet: %08X, minPeriod: %d, maxPeriod: %d, greaterThan: %f, lessThan: %f, step: %f",
             watcherP->parameters->toSet, watcherP->parameters->minPeriod, watcherP->parameters->maxPeriod, watcherP->parameters->greaterThan, watcherP->parameters->lessThan, watcherP->parameters->step);
 
     return COAP_204_CHANGED;
 }
 
+/*
+ * Sends the notifications held for a server in queue mode, once it can reach
+ * the client again.
+ */
+void observe_flushQueue(lwm2m_context_t * contextP,
+                        lwm2m_server_t * serverP,
+                        time_t currentTime)
+{
+    if (serverP->queueCount == 0 || serverP->awakeUntil <= currentTime) return;
+
+    LOG_ARG("Sending %d queued notifications", serverP->queueCount);
+#ifdef LWM2M_WITH_SEND_BATCH
+    lwm2m_buffer_hold(contextP->userData);
+#endif
+    while (serverP->queueCount != 0)
+    {
+        lwm2m_queued_notify_t * entryP = serverP->queue + serverP->queueFirst;
+        coap_packet_t message[1];
+
+        entryP->watcher->lastMid = contextP->nextMID++;
+        coap_init_message(message, COAP_TYPE_NON, COAP_205_CONTENT, entryP->watcher->lastMid);
+        coap_set_header_content_type(message, entryP->format);
+        coap_set_payload(message, entryP->buffer, entryP->length);
+        coap_set_header_token(message, entryP->token, entryP->tokenLen);
+        coap_set_header_observe(message, entryP->counter);
+        (void)message_send(contextP, message, serverP->sessionH);
+
+        lwm2m_free(entryP->buffer);
+        entryP->buffer = NULL;
+        serverP->queueFirst = (serverP->queueFirst + 1) % LWM2M_QUEUE_SIZE;
+        serverP->queueCount--;
+    }
+    serverP->queueFirst = 0;
+#ifdef LWM2M_WITH_SEND_BATCH
+    lwm2m_buffer_flush(contextP->userData);
+#endif
+}
+
+void observe_freeQueue(lwm2m_server_t * serverP)
+{
+    while (serverP->queueCount != 0)
+    {
+        lwm2m_free(serverP->queue[serverP->queueFirst].buffer);
+        serverP->queueFirst = (serverP->queueFirst + 1) % LWM2M_QUEUE_SIZE;
+        serverP->queueCount--;
+    }
+    if (serverP->queue != NULL)
+    {
+        lwm2m_free(serverP->queue);
+        serverP->queue = NULL;
+    }
+    serverP->queueFirst = 0;
+}
+
 lwm2m_observed_t * observe_findByUri(lwm2m_context_t * contextP,
                                      lwm2m_uri_t * uriP)
 {
     lwm2m_observed_t * targetP;
 
     LOG_URI(uriP);
-    targetP = contextP->observedList;
+    targetP = *prv_getUriBucket(contextP, uriP);
     while (targetP != NULL)
     {
         if (targetP->uri.objectId == uriP->objectId)
@@ -432,83 +649,356 @@ lwm2m_observed_t * observe_findByUri(lwm2m_context_t * contextP,
                  }
              }
         }
-        targetP = targetP->next;
+        targetP = targetP->bucketNext;
     }
 
     LOG("Found nothing");
     return NULL;
 }
 
+static void prv_tagWatchers(lwm2m_context_t * contextP,
+                            lwm2m_observed_t * targetP)
+{
+    lwm2m_watcher_t * watcherP;
+
+    LOG("Found an observation");
+    LOG_URI(&(targetP->uri));
+
+    for (watcherP = targetP->watcherList ; watcherP != NULL ; watcherP = watcherP->next)
+    {
+        if (watcherP->active == true)
+        {
+            LOG("Tagging a watcher");
+            watcherP->update = true;
+            prv_scheduleWatcher(contextP, watcherP, 0);
+        }
+    }
+}
+
 void lwm2m_resource_value_changed(lwm2m_context_t * contextP,
                                   lwm2m_uri_t * uriP)
 {
     lwm2m_observed_t * targetP;
+    lwm2m_object_t * objectP;
 
     LOG_URI(uriP);
-    targetP = contextP->observedList;
-    while (targetP != NULL)
+    // changes the ETag of the object reads
+    objectP = (lwm2m_object_t *)LWM2M_LIST_FIND(contextP->objectList, uriP->objectId);
+    if (objectP != NULL) objectP->version++;
+
+    if (!LWM2M_URI_IS_SET_INSTANCE(uriP))
     {
-        if (targetP->uri.objectId == uriP->objectId)
+        // all the observations of the object are concerned
+        for (targetP = contextP->observedList ; targetP != NULL ; targetP = targetP->next)
         {
-            if (!LWM2M_URI_IS_SET_INSTANCE(uriP)
-             || (targetP->uri.flag & LWM2M_URI_FLAG_INSTANCE_ID) == 0
-             || uriP->instanceId == targetP->uri.instanceId)
+            if (targetP->uri.objectId == uriP->objectId)
             {
-                if (!LWM2M_URI_IS_SET_RESOURCE(uriP)
-                 || (targetP->uri.flag & LWM2M_URI_FLAG_RESOURCE_ID) == 0
-                 || uriP->resourceId == targetP->uri.resourceId)
-                {
-                    lwm2m_watcher_t * watcherP;
+                prv_tagWatchers(contextP, targetP);
+            }
+        }
+        return;
+    }
 
-                    LOG("Found an observation");
-                    LOG_URI(&(targetP->uri));
+    // observations of the whole object
+    for (targetP = *prv_getBucket(contextP, uriP->objectId, LWM2M_MAX_ID) ; targetP != NULL ; targetP = targetP->bucketNext)
+    {
+        if (targetP->uri.objectId == uriP->objectId
+         && !LWM2M_URI_IS_SET_INSTANCE(&targetP->uri))
+        {
+            prv_tagWatchers(contextP, targetP);
+        }
+    }
 
-                    for (watcherP = targetP->watcherList ; watcherP != NULL ; watcherP = watcherP->next)
-                    {
-                        if (watcherP->active == true)
-                        {
-                            LOG("Tagging a watcher");
-                            watcherP->update = true;
-                        }
-                    }
-                }
+    // observations of the instance and of its resources
+    for (targetP = *prv_getBucket(contextP, uriP->objectId, uriP->instanceId) ; targetP != NULL ; targetP = targetP->bucketNext)
+    {
+        if (targetP->uri.objectId == uriP->objectId
+         && LWM2M_URI_IS_SET_INSTANCE(&targetP->uri)
+         && targetP->uri.instanceId == uriP->instanceId
+         && (!LWM2M_URI_IS_SET_RESOURCE(uriP)
+          || !LWM2M_URI_IS_SET_RESOURCE(&targetP->uri)
+          || uriP->resourceId == targetP->uri.resourceId))
+        {
+            prv_tagWatchers(contextP, targetP);
+        }
+    }
+}
+
+static void prv_notifyCallback(lwm2m_transaction_t * transacP,
+                               void * message)
+{
+    lwm2m_context_t * contextP = (lwm2m_context_t *)transacP->userData;
+    lwm2m_server_t * serverP;
+
+    if (message == NULL)
+    {
+        // RFC 7641 section 4.5: the observer is gone
+        LOG_ARG("Notification %u was not acknowledged", transacP->mID);
+        observe_cancel(contextP, transacP->mID, transacP->peerH);
+    }
+
+    serverP = utils_findServer(contextP, transacP->peerH);
+    if (serverP != NULL)
+    {
+        serverP->notifyPending = false;
+        // the changes held meanwhile can be notified
+        while (serverP->heldWatchers != NULL)
+        {
+            lwm2m_watcher_t * watcherP = serverP->heldWatchers;
+
+            serverP->heldWatchers = watcherP->heldNext;
+            watcherP->held = false;
+            prv_scheduleWatcher(contextP, watcherP, 0);
+        }
+    }
+}
+
+static bool prv_isQueueMode(lwm2m_server_t * serverP)
+{
+    return serverP->binding == BINDING_UQ
+        || serverP->binding == BINDING_SQ
+        || serverP->binding == BINDING_UQS;
+}
+
+/*
+ * Holds the notification until the server can reach the client. Unless the
+ * history is kept, it replaces the one already held for the same observation.
+ */
+static void prv_queueNotification(lwm2m_context_t * contextP,
+                                  lwm2m_watcher_t * watcherP,
+                                  uint8_t * buffer,
+                                  size_t length)
+{
+    lwm2m_server_t * serverP = watcherP->server;
+    lwm2m_queued_notify_t * entryP = NULL;
+    uint8_t * copy;
+    int i;
+
+    if (serverP->queue == NULL)
+    {
+        // only the servers in queue mode get one
+        serverP->queue = (lwm2m_queued_notify_t *)lwm2m_malloc(LWM2M_QUEUE_SIZE * sizeof(lwm2m_queued_notify_t));
+        if (serverP->queue == NULL) return;
+        serverP->queueFirst = 0;
+        serverP->queueCount = 0;
+    }
+
+    copy = (uint8_t *)lwm2m_malloc(length);
+    if (copy == NULL) return;
+    memcpy(copy, buffer, length);
+
+    if (!contextP->queueHistory)
+    {
+        for (i = 0 ; i < serverP->queueCount && entryP == NULL ; i++)
+        {
+            lwm2m_queued_notify_t * targetP = serverP->queue + (serverP->queueFirst + i) % LWM2M_QUEUE_SIZE;
+
+            if (targetP->tokenLen == watcherP->tokenLen
+             && memcmp(targetP->token, watcherP->token, watcherP->tokenLen) == 0)
+            {
+                entryP = targetP;
             }
         }
-        targetP = targetP->next;
     }
+    if (entryP == NULL)
+    {
+        if (serverP->queueCount == LWM2M_QUEUE_SIZE)
+        {
+            LOG("Queue full, dropping the oldest notification");
+            lwm2m_free(serverP->queue[serverP->queueFirst].buffer);
+            serverP->queueFirst = (serverP->queueFirst + 1) % LWM2M_QUEUE_SIZE;
+            serverP->queueCount--;
+        }
+        entryP = serverP->queue + (serverP->queueFirst + serverP->queueCount) % LWM2M_QUEUE_SIZE;
+        serverP->queueCount++;
+        memcpy(entryP->token, watcherP->token, watcherP->tokenLen);
+        entryP->tokenLen = watcherP->tokenLen;
+        entryP->watcher = watcherP;
+    }
+    else
+    {
+        lwm2m_free(entryP->buffer);
+    }
+
+    entryP->buffer = copy;
+    entryP->length = length;
+    entryP->format = watcherP->format;
+    entryP->counter = watcherP->counter++;
 }
 
+static void prv_sendNotification(lwm2m_context_t * contextP,
+                                 lwm2m_watcher_t * watcherP,
+                                 uint8_t * buffer,
+                                 size_t length,
+                                 time_t currentTime)
+{
+    lwm2m_transaction_t * transacP = NULL;
+    coap_packet_t message[1];
+    coap_packet_t * messageP = message;
+
+    if (prv_isQueueMode(watcherP->server)
+     && (watcherP->server->awakeUntil <= currentTime || watcherP->server->queueCount != 0))
+    {
+        // also queued when awake so that the held notifications are sent first
+        prv_queueNotification(contextP, watcherP, buffer, length);
+        return;
+    }
+
+    watcherP->lastMid = contextP->nextMID++;
+    if (contextP->confirmableNotify)
+    {
+        transacP = transaction_new(watcherP->server->sessionH, (coap_method_t)COAP_205_CONTENT, NULL, NULL, watcherP->lastMid, 0, NULL);
+    }
+    if (transacP != NULL)
+    {
+        messageP = (coap_packet_t *)transacP->message;
+    }
+    else
+    {
+        coap_init_message(message, COAP_TYPE_NON, COAP_205_CONTENT, watcherP->lastMid);
+    }
+    coap_set_header_content_type(messageP, watcherP->format);
+    coap_set_payload(messageP, buffer, length);
+    coap_set_header_token(messageP, watcherP->token, watcherP->tokenLen);
+    coap_set_header_observe(messageP, watcherP->counter++);
+
+    if (transacP == NULL)
+    {
+        (void)message_send(contextP, message, watcherP->server->sessionH);
+        return;
+    }
+
+    transacP->userData = (void *)contextP;
+    transaction_add(contextP, transacP);
+    // the payload is copied in the transaction buffer by its first transmission
+    if (transaction_send(contextP, transacP) == 0)
+    {
+        // set once sent so that a failure does not cancel the watcher while observe_step() walks them
+        transacP->callback = prv_notifyCallback;
+        watcherP->server->notifyPending = true;
+    }
+}
+
+#define PRV_MAX_PAYLOADS 4
+
+// payload of the notifications of an observation in one format
+typedef struct
+{
+    lwm2m_media_type_t requested;   // format of the watchers
+    lwm2m_media_type_t format;      // format actually used by the serialization
+    uint8_t * buffer;
+    size_t length;
+} notification_payload_t;
+
+/*
+ * Returns the payload in the requested format, serializing it if no other
+ * watcher of the observation requested this format during this step. The
+ * data is read on the first call for observations of instances and objects.
+ */
+static notification_payload_t * prv_getPayload(lwm2m_context_t * contextP,
+                                               lwm2m_uri_t * uriP,
+                                               int * sizeP,
+                                               lwm2m_data_t ** dataP,
+                                               lwm2m_media_type_t format,
+                                               notification_payload_t * payloads,
+                                               int * countP)
+{
+    notification_payload_t * payloadP;
+    int res;
+    int i;
+
+    for (i = 0 ; i < *countP ; i++)
+    {
+        if (payloads[i].requested == format) return payloads + i;
+    }
+
+    if (*dataP == NULL
+     && COAP_205_CONTENT != object_readData(contextP, uriP, sizeP, dataP))
+    {
+        return NULL;
+    }
+
+    if (*countP == PRV_MAX_PAYLOADS)
+    {
+        // unlikely, the last payload is replaced
+        (*countP)--;
+        lwm2m_free(payloads[*countP].buffer);
+    }
+    payloadP = payloads + *countP;
+    payloadP->requested = format;
+    payloadP->format = format;
+    res = lwm2m_data_serialize(uriP, *sizeP, *dataP, &payloadP->format, &payloadP->buffer);
+    if (res < 0) return NULL;
+    payloadP->length = (size_t)res;
+    (*countP)++;
+
+    return payloadP;
+}
+
+/*
+ * Only the observations of the watchers due in the heap are read. All their
+ * watchers are evaluated then rescheduled, the ones which could not be
+ * notified being retried at the next second.
+ */
 void observe_step(lwm2m_context_t * contextP,
                   time_t currentTime,
                   time_t * timeoutP)
 {
-    lwm2m_observed_t * targetP;
+#ifdef LWM2M_WITH_SEND_BATCH
+    bool holding = false;
+#endif
 
     LOG("Entering");
-    for (targetP = contextP->observedList ; targetP != NULL ; targetP = targetP->next)
+    while (contextP->observeHeap != NULL)
     {
+        lwm2m_observed_t * targetP;
         lwm2m_watcher_t * watcherP;
-        uint8_t * buffer = NULL;
-        size_t length = 0;
+        notification_payload_t payloads[PRV_MAX_PAYLOADS];
+        int payloadCount = 0;
         lwm2m_data_t * dataP = NULL;
         int size = 0;
         double floatValue = 0;
         int64_t integerValue = 0;
         bool storeValue = false;
-        coap_packet_t message[1];
-        time_t interval;
+
+        watcherP = HEAP_ENTRY(contextP->observeHeap, lwm2m_watcher_t, heapNode);
+        if (watcherP->deadline > currentTime)
+        {
+            time_t interval;
+
+            interval = watcherP->deadline - currentTime;
+            if (*timeoutP > interval) *timeoutP = interval;
+            break;
+        }
+#ifdef LWM2M_WITH_SEND_BATCH
+        if (holding == false)
+        {
+            lwm2m_buffer_hold(contextP->userData);
+            holding = true;
+        }
+#endif
+        if (prv_isBlocked(contextP, watcherP))
+        {
+            // woken up by the acknowledgement
+            prv_scheduleWatcher(contextP, watcherP, 0);
+            continue;
+        }
+        targetP = watcherP->observed;
 
         LOG_URI(&(targetP->uri));
         if (LWM2M_URI_IS_SET_RESOURCE(&targetP->uri))
         {
-            if (COAP_205_CONTENT != object_readData(contextP, &targetP->uri, &size, &dataP)) continue;
+            if (COAP_205_CONTENT != object_readData(contextP, &targetP->uri, &size, &dataP))
+            {
+                goto schedule;
+            }
             switch (dataP->type)
             {
             case LWM2M_TYPE_INTEGER:
                 if (1 != lwm2m_data_decode_int(dataP, &integerValue))
                 {
                     lwm2m_data_free(size, dataP);
-                    continue;
+                    goto schedule;
                 }
                 storeValue = true;
                 break;
@@ -516,7 +1006,7 @@ void observe_step(lwm2m_context_t * contextP,
                 if (1 != lwm2m_data_decode_float(dataP, &floatValue))
                 {
                     lwm2m_data_free(size, dataP);
-                    continue;
+                    goto schedule;
                 }
                 storeValue = true;
                 break;
@@ -526,7 +1016,7 @@ void observe_step(lwm2m_context_t * contextP,
         }
         for (watcherP = targetP->watcherList ; watcherP != NULL ; watcherP = watcherP->next)
         {
-            if (watcherP->active == true)
+            if (watcherP->active == true && !prv_isBlocked(contextP, watcherP))
             {
                 bool notify = false;
 
@@ -652,8 +1142,6 @@ void observe_step(lwm2m_context_t * contextP,
                         if (watcherP->lastTime + watcherP->parameters->minPeriod > currentTime)
                         {
                             // Minimum Period did not elapse yet
-                            interval = watcherP->lastTime + watcherP->parameters->minPeriod - currentTime;
-                            if (*timeoutP > interval) *timeoutP = interval;
                             notify = false;
                         }
                         else
@@ -680,41 +1168,14 @@ void observe_step(lwm2m_context_t * contextP,
 
                 if (notify == true)
                 {
-                    if (buffer == NULL)
-                    {
-                        if (dataP != NULL)
-                        {
-                            int res;
+                    notification_payload_t * payloadP;
 
-                            res = lwm2m_data_serialize(&targetP->uri, size, dataP, &(watcherP->format), &buffer);
-                            if (res < 0)
-                            {
-                                break;
-                            }
-                            else
-                            {
-                                length = (size_t)res;
-                            }
+                    payloadP = prv_getPayload(contextP, &targetP->uri, &size, &dataP, watcherP->format, payloads, &payloadCount);
+                    if (payloadP == NULL) break;
+                    watcherP->format = payloadP->format;
 
-                        }
-                        else
-                        {
-                            if (COAP_205_CONTENT != object_read(contextP, &targetP->uri, &(watcherP->format), &buffer, &length))
-                            {
-                                buffer = NULL;
-                                break;
-                            }
-                        }
-                        coap_init_message(message, COAP_TYPE_NON, COAP_205_CONTENT, 0);
-                        coap_set_header_content_type(message, watcherP->format);
-                        coap_set_payload(message, buffer, length);
-                    }
                     watcherP->lastTime = currentTime;
-                    watcherP->lastMid = contextP->nextMID++;
-                    message->mid = watcherP->lastMid;
-                    coap_set_header_token(message, watcherP->token, watcherP->tokenLen);
-                    coap_set_header_observe(message, watcherP->counter++);
-                    (void)message_send(contextP, message, watcherP->server->sessionH);
+                    prv_sendNotification(contextP, watcherP, payloadP->buffer, payloadP->length, currentTime);
                     watcherP->update = false;
                 }
 
@@ -734,17 +1195,32 @@ void observe_step(lwm2m_context_t * contextP,
                     }
                 }
 
-                if (watcherP->parameters != NULL && (watcherP->parameters->toSet & LWM2M_ATTR_FLAG_MAX_PERIOD) != 0)
+                if (notify == false
+                 && watcherP->update == true
+                 && (watcherP->parameters == NULL
+                  || (watcherP->parameters->toSet & LWM2M_ATTR_FLAG_MIN_PERIOD) == 0))
                 {
-                    // update timers
-                    interval = watcherP->lastTime + watcherP->parameters->maxPeriod - currentTime;
-                    if (*timeoutP > interval) *timeoutP = interval;
+                    // the new value does not meet the conditions, wait for the next change
+                    watcherP->update = false;
                 }
             }
         }
         if (dataP != NULL) lwm2m_data_free(size, dataP);
-        if (buffer != NULL) lwm2m_free(buffer);
+        while (payloadCount > 0)
+        {
+            payloadCount--;
+            lwm2m_free(payloads[payloadCount].buffer);
+        }
+
+schedule:
+        for (watcherP = targetP->watcherList ; watcherP != NULL ; watcherP = watcherP->next)
+        {
+            prv_scheduleWatcher(contextP, watcherP, currentTime + 1);
+        }
     }
+#ifdef LWM2M_WITH_SEND_BATCH
+    if (holding == true) lwm2m_buffer_flush(contextP->userData);
+#endif
 }
 
 #endif
@@ -837,7 +1313,7 @@ static void prv_obsRequestCallback(lwm2m_transaction_t * transacP,
         observationP->callback(observationP->clientP->internalID,
                                &observationP->uri,
                                0,
-                               packet->content_type, packet->payload, packet->payload_len,
+                               (lwm2m_media_type_t)packet->content_type, packet->payload, packet->payload_len,
                                observationP->userData);
     }
 }
@@ -872,7 +1348,7 @@ static void prv_obsCancelRequestCallback(lwm2m_transaction_t * transacP,
         cancelP->callbackP(cancelP->observationP->clientP->internalID,
                            &cancelP->observationP->uri,
                            0,
-                           packet->content_type, packet->payload, packet->payload_len,
+                           (lwm2m_media_type_t)packet->content_type, packet->payload, packet->payload_len,
                            cancelP->userDataP);
     }
 
@@ -898,7 +1374,7 @@ int lwm2m_observe(lwm2m_context_t * contextP,
 
     if (!LWM2M_URI_IS_SET_INSTANCE(uriP) && LWM2M_URI_IS_SET_RESOURCE(uriP)) return COAP_400_BAD_REQUEST;
 
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = lwm2m_get_client(contextP, clientID);
     if (clientP == NULL) return COAP_404_NOT_FOUND;
 
     for (observationP = clientP->observationList; observationP != NULL; observationP = observationP->next)
@@ -954,7 +1430,7 @@ int lwm2m_observe(lwm2m_context_t * contextP,
     transactionP->callback = prv_obsRequestCallback;
     transactionP->userData = (void *)observationP;
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transactionP);
+    transaction_add(contextP, transactionP);
 
     return transaction_send(contextP, transactionP);
 }
@@ -971,7 +1447,7 @@ int lwm2m_observe_cancel(lwm2m_context_t * contextP,
     LOG_ARG("clientID: %d", clientID);
     LOG_URI(uriP);
 
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = lwm2m_get_client(contextP, clientID);
     if (clientP == NULL) return COAP_404_NOT_FOUND;
 
     observationP = prv_findObservationByURI(clientP, uriP);
@@ -1011,7 +1487,7 @@ int lwm2m_observe_cancel(lwm2m_context_t * contextP,
         transactionP->callback = prv_obsCancelRequestCallback;
         transactionP->userData = (void *)cancelP;
 
-        contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transactionP);
+        transaction_add(contextP, transactionP);
 
         return transaction_send(contextP, transactionP);
     }
@@ -1050,7 +1526,7 @@ bool observe_handleNotify(lwm2m_context_t * contextP,
     clientID = (tokenP[0] << 8) | tokenP[1];
     obsID = (tokenP[2] << 8) | tokenP[3];
 
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = lwm2m_get_client(contextP, clientID);
     if (clientP == NULL) return false;
 
     observationP = (lwm2m_observation_t *)lwm2m_list_find((lwm2m_list_t *)clientP->observationList, obsID);
@@ -1068,7 +1544,7 @@ bool observe_handleNotify(lwm2m_context_t * contextP,
         observationP->callback(clientID,
                                &observationP->uri,
                                (int)count,
-                               message->content_type, message->payload, message->payload_len,
+                               (lwm2m_media_type_t)message->content_type, message->payload, message->payload_len,
                                observationP->userData);
     }
     return true;
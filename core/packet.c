@@ -193,6 +193,137 @@ static coap_status_t handle_request(lwm2m_context_t * contextP,
     return result;
 }
 
+#ifdef LWM2M_CLIENT_MODE
+/*
+ * Returns the server or bootstrap server the session belongs to, NULL if none.
+ */
+static lwm2m_server_t * prv_findPeer(lwm2m_context_t * contextP,
+                                     void * fromSessionH)
+{
+    lwm2m_server_t * serverP;
+
+    serverP = utils_findServer(contextP, fromSessionH);
+#ifdef LWM2M_BOOTSTRAP
+    if (serverP == NULL)
+    {
+        serverP = utils_findBootstrapServer(contextP, fromSessionH);
+    }
+#endif
+
+    return serverP;
+}
+#endif
+
+// block size of the responses unless set with lwm2m_set_block_size()
+static uint16_t prv_getMaxBlockSize(lwm2m_context_t * contextP)
+{
+    return contextP->blockSize != 0 ? contextP->blockSize : REST_MAX_CHUNK_SIZE;
+}
+
+/*
+ * Returns the block size to use with the peer: the size it requested if any,
+ * capped by the context setting, otherwise the one last negotiated with it.
+ */
+static uint16_t prv_negotiateBlockSize(lwm2m_context_t * contextP,
+                                       void * fromSessionH,
+                                       uint16_t requestedSize)
+{
+    uint16_t blockSize = prv_getMaxBlockSize(contextP);
+#ifdef LWM2M_CLIENT_MODE
+    lwm2m_server_t * serverP;
+
+    serverP = prv_findPeer(contextP, fromSessionH);
+    if (serverP != NULL)
+    {
+        if (requestedSize != 0)
+        {
+            serverP->blockSize = MIN(requestedSize, blockSize);
+        }
+        if (serverP->blockSize != 0)
+        {
+            blockSize = MIN(serverP->blockSize, blockSize);
+        }
+        return blockSize;
+    }
+#endif
+    if (requestedSize != 0)
+    {
+        blockSize = MIN(requestedSize, blockSize);
+    }
+
+    return blockSize;
+}
+
+#ifdef LWM2M_CLIENT_MODE
+/*
+ * Returns true if the request is a Write of an opaque resource whose object
+ * consumes Block1 transfers block by block.
+ */
+static bool prv_isStreamedWrite(lwm2m_context_t * contextP,
+                                void * fromSessionH,
+                                coap_packet_t * message)
+{
+    lwm2m_uri_t * uriP;
+    bool result;
+
+    if (message->code != COAP_PUT
+     || IS_OPTION(message, COAP_OPTION_URI_QUERY)
+     || !IS_OPTION(message, COAP_OPTION_CONTENT_TYPE))
+    {
+        return false;
+    }
+    // bootstrap writes are always reassembled
+    if (utils_findServer(contextP, fromSessionH) == NULL) return false;
+
+    uriP = uri_decode(contextP->altPath, message->uri_path);
+    if (uriP == NULL) return false;
+
+    result = (uriP->flag & LWM2M_URI_MASK_TYPE) == LWM2M_URI_FLAG_DM
+          && object_isBlockWritable(contextP, uriP, utils_convertMediaType(message->content_type));
+    lwm2m_free(uriP);
+
+    return result;
+}
+#endif
+
+/*
+ * Sends the response to a request. The response to a confirmable request is
+ * kept to answer its retransmissions.
+ */
+static coap_status_t prv_sendResponse(lwm2m_context_t * contextP,
+                                      coap_packet_t * message,
+                                      coap_packet_t * response,
+                                      void * sessionH)
+{
+    coap_status_t result = COAP_500_INTERNAL_SERVER_ERROR;
+    uint8_t * pktBuffer;
+    size_t pktBufferLen;
+
+    pktBufferLen = message_serialize(contextP, response, &pktBuffer);
+    if (0 != pktBufferLen)
+    {
+        result = lwm2m_buffer_send(sessionH, pktBuffer, pktBufferLen, contextP->userData);
+#ifdef LWM2M_CLIENT_MODE
+        if (message->type == COAP_TYPE_CON)
+        {
+            // the request may have changed the server list, look the peer up again
+            lwm2m_server_t * peerP = prv_findPeer(contextP, sessionH);
+
+            if (peerP != NULL)
+            {
+                dedup_store(&peerP->dedupData, message->mid, pktBuffer, pktBufferLen, utils_getTime());
+            }
+        }
+#endif
+        if (pktBuffer != ((packet_scratch_t *)contextP->packetScratch)->sendBuffer)
+        {
+            lwm2m_free(pktBuffer);
+        }
+    }
+
+    return result;
+}
+
 /* This function is an adaptation of function coap_receive() from Erbium's er-coap-13-engine.c.
  * Erbium is Copyright (c) 2013, Institute for Pervasive Computing, ETH Zurich
  * All rights reserved.
@@ -203,22 +334,51 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
                         void * fromSessionH)
 {
     coap_status_t coap_error_code = NO_ERROR;
-    static coap_packet_t message[1];
-    static coap_packet_t response[1];
+    packet_scratch_t * scratchP = (packet_scratch_t *)contextP->packetScratch;
+    coap_packet_t * message = &(scratchP->message);
+    coap_packet_t * response = &(scratchP->response);
+#ifdef LWM2M_CLIENT_MODE
+    lwm2m_dedup_data_t * duplicateP = NULL;
+#endif
 
     LOG("Entering");
-    coap_error_code = coap_parse_message(message, buffer, (uint16_t)length);
+    coap_error_code = coap_parse_message_views(message, buffer, (uint16_t)length, &(scratchP->views));
     if (coap_error_code == NO_ERROR)
     {
         LOG_ARG("Parsed: ver %u, type %u, tkl %u, code %u.%.2u, mid %u, Content type: %d",
                 message->version, message->type, message->token_len, message->code >> 5, message->code & 0x1F, message->mid, message->content_type);
         LOG_ARG("Payload: %.*s", message->payload_len, message->payload);
+#ifdef LWM2M_CLIENT_MODE
+        if (message->code >= COAP_GET && message->code <= COAP_DELETE
+         && message->type == COAP_TYPE_CON)
+        {
+            lwm2m_server_t * peerP = prv_findPeer(contextP, fromSessionH);
+
+            if (peerP != NULL)
+            {
+                duplicateP = dedup_find(peerP->dedupData, message->mid, utils_getTime());
+            }
+        }
+        if (duplicateP != NULL)
+        {
+            LOG_ARG("Duplicate of request %u, sending the previous response again", message->mid);
+            coap_error_code = lwm2m_buffer_send(fromSessionH, duplicateP->buffer, duplicateP->length, contextP->userData);
+        }
+        else
+#endif
         if (message->code >= COAP_GET && message->code <= COAP_DELETE)
         {
             uint32_t block_num = 0;
-            uint16_t block_size = REST_MAX_CHUNK_SIZE;
+            uint16_t block_size = 0;
             uint32_t block_offset = 0;
+            bool block1_streamed = false;
             int64_t new_offset = 0;
+            uint8_t * payload;
+#ifdef LWM2M_CLIENT_MODE
+            size_t payload_len;
+            lwm2m_server_t * readerP = NULL;
+            lwm2m_block2_data_t * cachedP = NULL;
+#endif
 
             /* prepare response */
             if (message->type == COAP_TYPE_CON)
@@ -241,10 +401,10 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
             /* get offset for blockwise transfers */
             if (coap_get_header_block2(message, &block_num, NULL, &block_size, &block_offset))
             {
-                LOG_ARG("Blockwise: block request %u (%u/%u) @ %u bytes", block_num, block_size, REST_MAX_CHUNK_SIZE, block_offset);
-                block_size = MIN(block_size, REST_MAX_CHUNK_SIZE);
+                LOG_ARG("Blockwise: block request %u (%u/%u) @ %u bytes", block_num, block_size, prv_getMaxBlockSize(contextP), block_offset);
                 new_offset = block_offset;
             }
+            block_size = prv_negotiateBlockSize(contextP, fromSessionH, block_size);
 
             /* handle block1 option */
             if (IS_OPTION(message, COAP_OPTION_BLOCK1))
@@ -252,13 +412,7 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
 #ifdef LWM2M_CLIENT_MODE
                 // get server
                 lwm2m_server_t * serverP;
-                serverP = utils_findServer(contextP, fromSessionH);
-#ifdef LWM2M_BOOTSTRAP
-                if (serverP == NULL)
-                {
-                    serverP = utils_findBootstrapServer(contextP, fromSessionH);
-                }
-#endif
+                serverP = prv_findPeer(contextP, fromSessionH);
                 if (serverP == NULL)
                 {
                     coap_error_code = COAP_500_INTERNAL_SERVER_ERROR;
@@ -273,21 +427,30 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
 
                     // parse block1 header
                     coap_get_header_block1(message, &block1_num, &block1_more, &block1_size, NULL);
-                    LOG_ARG("Blockwise: block1 request NUM %u (SZX %u/ SZX Max%u) MORE %u", block1_num, block1_size, REST_MAX_CHUNK_SIZE, block1_more);
-
-                    // handle block 1
-                    coap_error_code = coap_block1_handler(&serverP->block1Data, message->mid, message->payload, message->payload_len, block1_size, block1_num, block1_more, &complete_buffer, &complete_buffer_size);
+                    LOG_ARG("Blockwise: block1 request NUM %u (SZX %u/ SZX Max%u) MORE %u", block1_num, block1_size, prv_getMaxBlockSize(contextP), block1_more);
 
-                    // if payload is complete, replace it in the coap message.
-                    if (coap_error_code == NO_ERROR)
+                    if (prv_isStreamedWrite(contextP, fromSessionH, message))
                     {
-                        message->payload = complete_buffer;
-                        message->payload_len = complete_buffer_size;
+                        // each block is handed to the object by handle_request()
+                        block1_streamed = true;
                     }
-                    else if (coap_error_code == COAP_231_CONTINUE)
+                    else
                     {
-                        block1_size = MIN(block1_size, REST_MAX_CHUNK_SIZE);
-                        coap_set_header_block1(response,block1_num, block1_more,block1_size);
+                        // handle block 1
+                        coap_error_code = coap_block1_handler(&serverP->block1Data, message, utils_getTime(), &complete_buffer, &complete_buffer_size);
+
+                        // if payload is complete, replace it in the coap message.
+                        if (coap_error_code == NO_ERROR)
+                        {
+                            message->payload = complete_buffer;
+                            message->payload_len = complete_buffer_size;
+                            UNSET_OPTION(message, COAP_OPTION_BLOCK1);
+                        }
+                        else if (coap_error_code == COAP_231_CONTINUE)
+                        {
+                            block1_size = MIN(block1_size, prv_getMaxBlockSize(contextP));
+                            coap_set_header_block1(response,block1_num, block1_more,block1_size);
+                        }
                     }
                 }
 #else
@@ -296,10 +459,43 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
             }
             if (coap_error_code == NO_ERROR)
             {
-                coap_error_code = handle_request(contextP, fromSessionH, message, response);
+#ifdef LWM2M_CLIENT_MODE
+                if (message->code == COAP_GET)
+                {
+                    readerP = utils_findServer(contextP, fromSessionH);
+                    if (readerP != NULL && block_num != 0)
+                    {
+                        cachedP = block2_find(readerP->block2Data, message, utils_getTime());
+                    }
+                }
+                if (cachedP != NULL)
+                {
+                    LOG_ARG("Blockwise: serving block %u from cached response of %u bytes", block_num, cachedP->length);
+                    coap_set_header_content_type(response, cachedP->contentType);
+                    if (cachedP->etagLen != 0)
+                    {
+                        coap_set_header_etag(response, cachedP->etag, cachedP->etagLen);
+                    }
+                    coap_set_payload(response, cachedP->buffer, cachedP->length);
+                }
+                else
+#endif
+                {
+                    coap_error_code = handle_request(contextP, fromSessionH, message, response);
+                    if (block1_streamed && response->code == COAP_231_CONTINUE)
+                    {
+                        coap_set_header_block1(response, message->block1_num, 1, MIN(message->block1_size, prv_getMaxBlockSize(contextP)));
+                    }
+                }
             }
             if (coap_error_code==NO_ERROR)
             {
+                // the payload is sliced below when sent with block2
+                payload = response->payload;
+#ifdef LWM2M_CLIENT_MODE
+                payload_len = response->payload_len;
+#endif
+
                 if ( IS_OPTION(message, COAP_OPTION_BLOCK2) )
                 {
                     /* unchanged new_offset indicates that resource is unaware of blockwise transfer */
@@ -316,6 +512,11 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
                         else
                         {
                             coap_set_header_block2(response, block_num, response->payload_len - block_offset > block_size, block_size);
+                            if (block_num == 0)
+                            {
+                                // lets the peer request the following blocks in parallel
+                                coap_set_header_size(response, response->payload_len);
+                            }
                             coap_set_payload(response, response->payload+block_offset, MIN(response->payload_len - block_offset, block_size));
                         } /* if (valid offset) */
                     }
@@ -327,17 +528,35 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
                         if (response->payload_len > block_size) coap_set_payload(response, response->payload, block_size);
                     } /* if (resource aware of blockwise) */
                 }
-                else if (new_offset!=0)
+                else if (response->payload_len > block_size)
                 {
-                    LOG_ARG("Blockwise: no block option for blockwise resource, using block size %u", REST_MAX_CHUNK_SIZE);
+                    LOG_ARG("Blockwise: response of %u bytes without block option, using block size %u", response->payload_len, block_size);
 
-                    coap_set_header_block2(response, 0, new_offset!=-1, REST_MAX_CHUNK_SIZE);
-                    coap_set_payload(response, response->payload, MIN(response->payload_len, REST_MAX_CHUNK_SIZE));
+                    coap_set_header_block2(response, 0, 1, block_size);
+                    coap_set_header_size(response, response->payload_len);
+                    coap_set_payload(response, response->payload, block_size);
                 } /* if (blockwise request) */
 
-                coap_error_code = message_send(contextP, response, fromSessionH);
+                coap_error_code = prv_sendResponse(contextP, message, response, fromSessionH);
 
-                lwm2m_free(response->payload);
+#ifdef LWM2M_CLIENT_MODE
+                if (cachedP == NULL)
+                {
+                    if (readerP != NULL
+                     && response->code == COAP_205_CONTENT
+                     && payload_len > block_size)
+                    {
+                        // the peer will come back for the following blocks
+                        block2_store(&readerP->block2Data, message, response, payload, payload_len, utils_getTime());
+                    }
+                    else
+                    {
+                        lwm2m_free(payload);
+                    }
+                }
+#else
+                lwm2m_free(payload);
+#endif
                 response->payload = NULL;
                 response->payload_len = 0;
             }
@@ -345,7 +564,7 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
             {
                 if (1 == coap_set_status_code(response, coap_error_code))
                 {
-                    coap_error_code = message_send(contextP, response, fromSessionH);
+                    coap_error_code = prv_sendResponse(contextP, message, response, fromSessionH);
                 }
             }
         }
@@ -397,7 +616,10 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
 
     if (coap_error_code != NO_ERROR && coap_error_code != COAP_IGNORE)
     {
-        LOG_ARG("ERROR %u: %s", coap_error_code, coap_error_message);
+        const char * errorMessage;
+
+        errorMessage = message->error_message != NULL ? message->error_message : "";
+        LOG_ARG("ERROR %u: %s", coap_error_code, errorMessage);
 
         /* Set to sendable error code. */
         if (coap_error_code >= 192)
@@ -406,12 +628,45 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
         }
         /* Reuse input buffer for error message. */
         coap_init_message(message, COAP_TYPE_ACK, coap_error_code, message->mid);
-        coap_set_payload(message, coap_error_message, strlen(coap_error_message));
+        coap_set_payload(message, errorMessage, strlen(errorMessage));
         message_send(contextP, message, fromSessionH);
     }
 }
 
 
+size_t message_serialize(lwm2m_context_t * contextP,
+                         coap_packet_t * message,
+                         uint8_t ** bufferP)
+{
+    packet_scratch_t * scratchP = (packet_scratch_t *)contextP->packetScratch;
+    size_t length;
+    size_t allocLen;
+
+    length = coap_serialize_message_bounded(message, scratchP->sendBuffer, LWM2M_SEND_BUFFER_SIZE);
+    if (length != 0)
+    {
+        *bufferP = scratchP->sendBuffer;
+        return length;
+    }
+
+    // does not fit in the context buffer
+    allocLen = coap_serialize_get_size(message);
+    LOG_ARG("Size to allocate: %d", allocLen);
+    if (allocLen == 0) return 0;
+
+    *bufferP = (uint8_t *)lwm2m_malloc(allocLen);
+    if (*bufferP == NULL) return 0;
+
+    length = coap_serialize_message(message, *bufferP);
+    if (length == 0)
+    {
+        lwm2m_free(*bufferP);
+        *bufferP = NULL;
+    }
+
+    return length;
+}
+
 coap_status_t message_send(lwm2m_context_t * contextP,
                            coap_packet_t * message,
                            void * sessionH)
@@ -419,23 +674,17 @@ coap_status_t message_send(lwm2m_context_t * contextP,
     coap_status_t result = COAP_500_INTERNAL_SERVER_ERROR;
     uint8_t * pktBuffer;
     size_t pktBufferLen = 0;
-    size_t allocLen;
 
     LOG("Entering");
-    allocLen = coap_serialize_get_size(message);
-    LOG_ARG("Size to allocate: %d", allocLen);
-    if (allocLen == 0) return COAP_500_INTERNAL_SERVER_ERROR;
-
-    pktBuffer = (uint8_t *)lwm2m_malloc(allocLen);
-    if (pktBuffer != NULL)
+    pktBufferLen = message_serialize(contextP, message, &pktBuffer);
+    LOG_ARG("message_serialize() returned %d", pktBufferLen);
+    if (0 != pktBufferLen)
     {
-        pktBufferLen = coap_serialize_message(message, pktBuffer);
-        LOG_ARG("coap_serialize_message() returned %d", pktBufferLen);
-        if (0 != pktBufferLen)
+        result = lwm2m_buffer_send(sessionH, pktBuffer, pktBufferLen, contextP->userData);
+        if (pktBuffer != ((packet_scratch_t *)contextP->packetScratch)->sendBuffer)
         {
-            result = lwm2m_buffer_send(sessionH, pktBuffer, pktBufferLen, contextP->userData);
+            lwm2m_free(pktBuffer);
         }
-        lwm2m_free(pktBuffer);
     }
 
     return result;
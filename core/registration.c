@@ -123,7 +123,7 @@ static void prv_handleRegistrationReply(lwm2m_transaction_t * transacP,
 
     if (targetP->status == STATE_REG_PENDING)
     {
-        time_t tv_sec = lwm2m_gettime();
+        time_t tv_sec = utils_getTime();
         if (tv_sec >= 0)
         {
             targetP->registration = tv_sec;
@@ -136,6 +136,8 @@ static void prv_handleRegistrationReply(lwm2m_transaction_t * transacP,
                 lwm2m_free(targetP->location);
             }
             targetP->location = coap_get_multi_option_as_string(packet->location_path);
+            // in queue mode, the server can now reach the client for a while
+            targetP->awakeUntil = tv_sec + (time_t)COAP_MAX_TRANSMIT_WAIT;
 
             LOG("Registration successful");
         }
@@ -198,7 +200,7 @@ static uint8_t prv_register(lwm2m_context_t * contextP,
     transaction->callback = prv_handleRegistrationReply;
     transaction->userData = (void *) server;
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
+    transaction_add(contextP, transaction);
     if (transaction_send(contextP, transaction) != 0) return COAP_500_INTERNAL_SERVER_ERROR;
 
     server->status = STATE_REG_PENDING;
@@ -214,7 +216,7 @@ static void prv_handleRegistrationUpdateReply(lwm2m_transaction_t * transacP,
 
     if (targetP->status == STATE_REG_UPDATE_PENDING)
     {
-        time_t tv_sec = lwm2m_gettime();
+        time_t tv_sec = utils_getTime();
         if (tv_sec >= 0)
         {
             targetP->registration = tv_sec;
@@ -222,6 +224,7 @@ static void prv_handleRegistrationUpdateReply(lwm2m_transaction_t * transacP,
         if (packet != NULL && packet->code == COAP_204_CHANGED)
         {
             targetP->status = STATE_REGISTERED;
+            targetP->awakeUntil = tv_sec + (time_t)COAP_MAX_TRANSMIT_WAIT;
             LOG("Registration update successful");
         }
         else
@@ -259,7 +262,7 @@ static int prv_updateRegistration(lwm2m_context_t * contextP,
     transaction->callback = prv_handleRegistrationUpdateReply;
     transaction->userData = (void *) server;
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
+    transaction_add(contextP, transaction);
 
     if (transaction_send(contextP, transaction) == 0)
     {
@@ -465,7 +468,7 @@ void registration_deregister(lwm2m_context_t * contextP,
     transaction->callback = prv_handleDeregistrationReply;
     transaction->userData = (void *) contextP;
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
+    transaction_add(contextP, transaction);
     if (transaction_send(contextP, transaction) == 0)
     {
         serverP->status = STATE_DEREG_PENDING;
@@ -680,22 +683,22 @@ static int prv_parseLinkAttributes(uint8_t * data,
         if (result == 0) return 0;
 
         if (keyLength == REG_ATTR_TYPE_KEY_LEN
-         && 0 == lwm2m_strncmp(REG_ATTR_TYPE_KEY, data + index + keyStart, keyLength))
+         && 0 == lwm2m_strncmp(REG_ATTR_TYPE_KEY, (char *)data + index + keyStart, keyLength))
         {
             if (isValid == true) return 0; // declared twice
             if (valueLength != REG_ATTR_TYPE_VALUE_LEN
-             || 0 != lwm2m_strncmp(REG_ATTR_TYPE_VALUE, data + index + valueStart, valueLength))
+             || 0 != lwm2m_strncmp(REG_ATTR_TYPE_VALUE, (char *)data + index + valueStart, valueLength))
             {
                 return 0;
             }
             isValid = true;
         }
         else if (keyLength == REG_ATTR_CONTENT_KEY_LEN
-              && 0 == lwm2m_strncmp(REG_ATTR_CONTENT_KEY, data + index + keyStart, keyLength))
+              && 0 == lwm2m_strncmp(REG_ATTR_CONTENT_KEY, (char *)data + index + keyStart, keyLength))
         {
             if (*supportJSON == true) return 0; // declared twice
             if (valueLength == REG_ATTR_CONTENT_JSON_LEN
-             && 0 == lwm2m_strncmp(REG_ATTR_CONTENT_JSON, data + index + valueStart, valueLength))
+             && 0 == lwm2m_strncmp(REG_ATTR_CONTENT_JSON, (char *)data + index + valueStart, valueLength))
             {
                 *supportJSON = true;
             }
@@ -865,18 +868,195 @@ error:
     return NULL;
 }
 
-static lwm2m_client_t * prv_getClientByName(lwm2m_context_t * contextP,
-                                            char * name)
+static uint32_t prv_nameHash(const char * name)
 {
-    lwm2m_client_t * targetP;
+    uint32_t hash = 2166136261u;
 
-    targetP = contextP->clientList;
-    while (targetP != NULL && strcmp(name, targetP->name) != 0)
+    // FNV-1a
+    while (*name != 0)
     {
-        targetP = targetP->next;
+        hash ^= (uint8_t)*name;
+        hash *= 16777619u;
+        name++;
+    }
+
+    return hash;
+}
+
+static bool prv_growClientTables(lwm2m_context_t * contextP)
+{
+    lwm2m_client_t ** idTable;
+    lwm2m_client_t ** nameTable;
+    size_t size;
+    lwm2m_client_t * clientP;
+
+    size = contextP->clientTableSize == 0 ? LWM2M_CLIENT_TABLE_MIN_SIZE : 2 * contextP->clientTableSize;
+
+    idTable = (lwm2m_client_t **)lwm2m_malloc(size * sizeof(lwm2m_client_t *));
+    nameTable = (lwm2m_client_t **)lwm2m_malloc(size * sizeof(lwm2m_client_t *));
+    if (idTable == NULL || nameTable == NULL)
+    {
+        if (idTable != NULL) lwm2m_free(idTable);
+        if (nameTable != NULL) lwm2m_free(nameTable);
+        return false;
     }
+    memset(idTable, 0, size * sizeof(lwm2m_client_t *));
+    memset(nameTable, 0, size * sizeof(lwm2m_client_t *));
 
-    return targetP;
+    for (clientP = contextP->clientList ; clientP != NULL ; clientP = clientP->next)
+    {
+        clientP->idNext = idTable[clientP->internalID & (size - 1)];
+        idTable[clientP->internalID & (size - 1)] = clientP;
+        clientP->nameNext = nameTable[clientP->nameHash & (size - 1)];
+        nameTable[clientP->nameHash & (size - 1)] = clientP;
+    }
+
+    if (contextP->clientIdTable != NULL) lwm2m_free(contextP->clientIdTable);
+    if (contextP->clientNameTable != NULL) lwm2m_free(contextP->clientNameTable);
+    contextP->clientIdTable = idTable;
+    contextP->clientNameTable = nameTable;
+    contextP->clientTableSize = size;
+
+    return true;
+}
+
+static bool prv_expiresBefore(lwm2m_heap_node_t * firstP,
+                              lwm2m_heap_node_t * secondP)
+{
+    return HEAP_ENTRY(firstP, lwm2m_client_t, heapNode)->endOfLife
+         < HEAP_ENTRY(secondP, lwm2m_client_t, heapNode)->endOfLife;
+}
+
+static void prv_unscheduleClient(lwm2m_context_t * contextP,
+                                 lwm2m_client_t * clientP)
+{
+    contextP->clientHeap = heap_remove(contextP->clientHeap, &clientP->heapNode, prv_expiresBefore);
+}
+
+// (re)insert the client in the lifetime heap after a change of endOfLife
+static void prv_scheduleClient(lwm2m_context_t * contextP,
+                               lwm2m_client_t * clientP)
+{
+    prv_unscheduleClient(contextP, clientP);
+    contextP->clientHeap = heap_insert(contextP->clientHeap, &clientP->heapNode, prv_expiresBefore);
+}
+
+// Assigns an internal ID to clientP and inserts it in the client list and tables.
+static bool prv_addClient(lwm2m_context_t * contextP,
+                          lwm2m_client_t * clientP)
+{
+    uint32_t tries;
+
+    if (contextP->clientCount >= LWM2M_MAX_ID) return false;
+
+    if (contextP->clientCount >= contextP->clientTableSize
+     && !prv_growClientTables(contextP)
+     && contextP->clientTableSize == 0)
+    {
+        return false;
+    }
+
+    // LWM2M_MAX_ID is reserved
+    tries = 0;
+    do
+    {
+        clientP->internalID = contextP->nextClientID;
+        contextP->nextClientID = (contextP->nextClientID + 1) % LWM2M_MAX_ID;
+        tries++;
+    } while (lwm2m_get_client(contextP, clientP->internalID) != NULL && tries < LWM2M_MAX_ID);
+    if (tries == LWM2M_MAX_ID) return false;
+
+    clientP->nameHash = prv_nameHash(clientP->name);
+
+    clientP->prev = NULL;
+    clientP->next = contextP->clientList;
+    if (contextP->clientList != NULL) contextP->clientList->prev = clientP;
+    contextP->clientList = clientP;
+
+    clientP->idNext = contextP->clientIdTable[clientP->internalID & (contextP->clientTableSize - 1)];
+    contextP->clientIdTable[clientP->internalID & (contextP->clientTableSize - 1)] = clientP;
+    clientP->nameNext = contextP->clientNameTable[clientP->nameHash & (contextP->clientTableSize - 1)];
+    contextP->clientNameTable[clientP->nameHash & (contextP->clientTableSize - 1)] = clientP;
+    contextP->clientCount++;
+
+    return true;
+}
+
+static void prv_removeClient(lwm2m_context_t * contextP,
+                             lwm2m_client_t * clientP)
+{
+    lwm2m_client_t ** linkP;
+
+    if (clientP->prev != NULL) clientP->prev->next = clientP->next;
+    else contextP->clientList = clientP->next;
+    if (clientP->next != NULL) clientP->next->prev = clientP->prev;
+
+    linkP = &(contextP->clientIdTable[clientP->internalID & (contextP->clientTableSize - 1)]);
+    while (*linkP != clientP) linkP = &((*linkP)->idNext);
+    *linkP = clientP->idNext;
+
+    linkP = &(contextP->clientNameTable[clientP->nameHash & (contextP->clientTableSize - 1)]);
+    while (*linkP != clientP) linkP = &((*linkP)->nameNext);
+    *linkP = clientP->nameNext;
+
+    prv_unscheduleClient(contextP, clientP);
+
+#ifdef LWM2M_WITH_SESSION_REFS
+    if (clientP->sessionH != NULL) lwm2m_session_release(clientP->sessionH, contextP->userData);
+#endif
+
+    clientP->next = NULL;
+    clientP->prev = NULL;
+    contextP->clientCount--;
+}
+
+static void prv_setClientSession(lwm2m_context_t * contextP,
+                                 lwm2m_client_t * clientP,
+                                 void * sessionH)
+{
+#ifdef LWM2M_WITH_SESSION_REFS
+    // hold first in case the session does not change
+    if (sessionH != NULL) lwm2m_session_hold(sessionH, contextP->userData);
+    if (clientP->sessionH != NULL) lwm2m_session_release(clientP->sessionH, contextP->userData);
+#else
+    (void)contextP;
+#endif
+    clientP->sessionH = sessionH;
+}
+
+lwm2m_client_t * lwm2m_get_client(lwm2m_context_t * contextP,
+                                  uint16_t clientID)
+{
+    lwm2m_client_t * clientP;
+
+    if (contextP->clientTableSize == 0) return NULL;
+
+    clientP = contextP->clientIdTable[clientID & (contextP->clientTableSize - 1)];
+    while (clientP != NULL && clientP->internalID != clientID)
+    {
+        clientP = clientP->idNext;
+    }
+
+    return clientP;
+}
+
+lwm2m_client_t * lwm2m_get_client_by_name(lwm2m_context_t * contextP,
+                                          const char * name)
+{
+    lwm2m_client_t * clientP;
+    uint32_t hash;
+
+    if (contextP->clientTableSize == 0) return NULL;
+
+    hash = prv_nameHash(name);
+    clientP = contextP->clientNameTable[hash & (contextP->clientTableSize - 1)];
+    while (clientP != NULL
+        && (clientP->nameHash != hash || strcmp(name, clientP->name) != 0))
+    {
+        clientP = clientP->nameNext;
+    }
+
+    return clientP;
 }
 
 void registration_freeClient(lwm2m_client_t * clientP)
@@ -894,6 +1074,14 @@ void registration_freeClient(lwm2m_client_t * clientP)
         clientP->observationList = clientP->observationList->next;
         lwm2m_free(targetP);
     }
+    while (clientP->etagList != NULL)
+    {
+        lwm2m_client_etag_t * etagP;
+
+        etagP = clientP->etagList;
+        clientP->etagList = clientP->etagList->next;
+        lwm2m_free(etagP);
+    }
     lwm2m_free(clientP);
 }
 
@@ -909,7 +1097,7 @@ static int prv_getLocationString(uint16_t id,
     if (result < 0) return 0;
     index = result;
 
-    result = utils_intToText(id, location + index, MAX_LOCATION_LENGTH - index);
+    result = utils_intToText(id, (uint8_t *)location + index, MAX_LOCATION_LENGTH - index);
     if (result == 0) return 0;
 
     return index + result;
@@ -925,7 +1113,7 @@ coap_status_t registration_handleRequest(lwm2m_context_t * contextP,
     time_t tv_sec;
 
     LOG_URI(uriP);
-    tv_sec = lwm2m_gettime();
+    tv_sec = utils_getTime();
     if (tv_sec < 0) return COAP_500_INTERNAL_SERVER_ERROR;
 
     switch(message->code)
@@ -947,8 +1135,8 @@ coap_status_t registration_handleRequest(lwm2m_context_t * contextP,
         {
             return COAP_400_BAD_REQUEST;
         }
-        if (message->content_type != LWM2M_CONTENT_LINK
-         && message->content_type != LWM2M_CONTENT_TEXT)
+        if ((lwm2m_media_type_t)message->content_type != LWM2M_CONTENT_LINK
+         && (lwm2m_media_type_t)message->content_type != LWM2M_CONTENT_TEXT)
         {
             return COAP_400_BAD_REQUEST;
         }
@@ -998,7 +1186,7 @@ coap_status_t registration_handleRequest(lwm2m_context_t * contextP,
                 lifetime = LWM2M_DEFAULT_LIFETIME;
             }
 
-            clientP = prv_getClientByName(contextP, name);
+            clientP = lwm2m_get_client_by_name(contextP, name);
             if (clientP != NULL)
             {
                 // we reset this registration
@@ -1020,8 +1208,16 @@ coap_status_t registration_handleRequest(lwm2m_context_t * contextP,
                     return COAP_500_INTERNAL_SERVER_ERROR;
                 }
                 memset(clientP, 0, sizeof(lwm2m_client_t));
-                clientP->internalID = lwm2m_list_newId((lwm2m_list_t *)contextP->clientList);
-                contextP->clientList = (lwm2m_client_t *)LWM2M_LIST_ADD(contextP->clientList, clientP);
+                clientP->name = name;
+                if (!prv_addClient(contextP, clientP))
+                {
+                    lwm2m_free(clientP);
+                    lwm2m_free(name);
+                    lwm2m_free(altPath);
+                    if (msisdn != NULL) lwm2m_free(msisdn);
+                    prv_freeClientObjectList(objects);
+                    return COAP_500_INTERNAL_SERVER_ERROR;
+                }
             }
             clientP->name = name;
             clientP->binding = binding;
@@ -1031,15 +1227,18 @@ coap_status_t registration_handleRequest(lwm2m_context_t * contextP,
             clientP->lifetime = lifetime;
             clientP->endOfLife = tv_sec + lifetime;
             clientP->objectList = objects;
-            clientP->sessionH = fromSessionH;
+            prv_setClientSession(contextP, clientP, fromSessionH);
+            prv_scheduleClient(contextP, clientP);
 
             if (prv_getLocationString(clientP->internalID, location) == 0)
             {
+                prv_removeClient(contextP, clientP);
                 registration_freeClient(clientP);
                 return COAP_500_INTERNAL_SERVER_ERROR;
             }
             if (coap_set_header_location_path(response, location) == 0)
             {
+                prv_removeClient(contextP, clientP);
                 registration_freeClient(clientP);
                 return COAP_500_INTERNAL_SERVER_ERROR;
             }
@@ -1052,7 +1251,7 @@ coap_status_t registration_handleRequest(lwm2m_context_t * contextP,
             break;
 
         case LWM2M_URI_FLAG_OBJECT_ID:
-            clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, uriP->objectId);
+            clientP = lwm2m_get_client(contextP, uriP->objectId);
             if (clientP == NULL) return COAP_404_NOT_FOUND;
 
             // Endpoint client name MUST NOT be present
@@ -1077,7 +1276,7 @@ coap_status_t registration_handleRequest(lwm2m_context_t * contextP,
                 clientP->lifetime = lifetime;
             }
             // client IP address, port or MSISDN may have changed
-            clientP->sessionH = fromSessionH;
+            prv_setClientSession(contextP, clientP, fromSessionH);
 
             if (objects != NULL)
             {
@@ -1126,6 +1325,7 @@ coap_status_t registration_handleRequest(lwm2m_context_t * contextP,
             }
 
             clientP->endOfLife = tv_sec + clientP->lifetime;
+            prv_scheduleClient(contextP, clientP);
 
             if (contextP->monitorCallback != NULL)
             {
@@ -1146,12 +1346,13 @@ coap_status_t registration_handleRequest(lwm2m_context_t * contextP,
 
         if ((uriP->flag & LWM2M_URI_MASK_ID) != LWM2M_URI_FLAG_OBJECT_ID) return COAP_400_BAD_REQUEST;
 
-        contextP->clientList = (lwm2m_client_t *)LWM2M_LIST_RM(contextP->clientList, uriP->objectId, &clientP);
+        clientP = lwm2m_get_client(contextP, uriP->objectId);
         if (clientP == NULL) return COAP_400_BAD_REQUEST;
         if (contextP->monitorCallback != NULL)
         {
             contextP->monitorCallback(clientP->internalID, NULL, COAP_202_DELETED, LWM2M_CONTENT_TEXT, NULL, 0, contextP->monitorUserData);
         }
+        prv_removeClient(contextP, clientP);
         registration_freeClient(clientP);
         result = COAP_202_DELETED;
     }
@@ -1245,33 +1446,28 @@ void registration_step(lwm2m_context_t * contextP,
     lwm2m_client_t * clientP;
 
     LOG("Entering");
-    // monitor clients lifetime
-    clientP = contextP->clientList;
-    while (clientP != NULL)
+    // monitor clients lifetime, only the expired ones are visited
+    while (contextP->clientHeap != NULL)
     {
-        lwm2m_client_t * nextP = clientP->next;
-
-        if (clientP->endOfLife <= currentTime)
-        {
-            if (contextP->monitorCallback != NULL)
-            {
-                contextP->monitorCallback(clientP->internalID, NULL, COAP_202_DELETED, LWM2M_CONTENT_TEXT, NULL, 0, contextP->monitorUserData);
-            }
-            contextP->clientList = (lwm2m_client_t *)LWM2M_LIST_RM(contextP->clientList, clientP->internalID, NULL);
-            registration_freeClient(clientP);
-        }
-        else
+        clientP = HEAP_ENTRY(contextP->clientHeap, lwm2m_client_t, heapNode);
+        if (clientP->endOfLife > currentTime)
         {
             time_t interval;
 
             interval = clientP->endOfLife - currentTime;
-
             if (*timeoutP > interval)
             {
                 *timeoutP = interval;
             }
+            break;
         }
-        clientP = nextP;
+
+        if (contextP->monitorCallback != NULL)
+        {
+            contextP->monitorCallback(clientP->internalID, NULL, COAP_202_DELETED, LWM2M_CONTENT_TEXT, NULL, 0, contextP->monitorUserData);
+        }
+        prv_removeClient(contextP, clientP);
+        registration_freeClient(clientP);
     }
 #endif
 
@@ -108,11 +108,11 @@ Contains code snippets which are:
 
 
 /*
- * Modulo mask (+1 and +0.5 for rounding) for a random number to get the tick number for the random
- * retransmission time between COAP_RESPONSE_TIMEOUT and COAP_RESPONSE_TIMEOUT*COAP_RESPONSE_RANDOM_FACTOR.
+ * Modulo (+1 for rounding) for a random number to get the initial retransmission time in milliseconds
+ * between COAP_RESPONSE_TIMEOUT and COAP_RESPONSE_TIMEOUT*COAP_ACK_RANDOM_FACTOR (rfc7252 section 4.8).
  */
-#define COAP_RESPONSE_TIMEOUT_TICKS         (CLOCK_SECOND * COAP_RESPONSE_TIMEOUT)
-#define COAP_RESPONSE_TIMEOUT_BACKOFF_MASK  ((CLOCK_SECOND * COAP_RESPONSE_TIMEOUT * (COAP_RESPONSE_RANDOM_FACTOR - 1)) + 1.5)
+#define COAP_RESPONSE_TIMEOUT_MS            (COAP_RESPONSE_TIMEOUT * 1000)
+#define COAP_RESPONSE_TIMEOUT_BACKOFF_MOD   ((int)(COAP_RESPONSE_TIMEOUT_MS * (COAP_ACK_RANDOM_FACTOR - 1)) + 1)
 
 static int prv_checkFinished(lwm2m_transaction_t * transacP,
                              coap_packet_t * receivedMessage)
@@ -218,7 +218,7 @@ lwm2m_transaction_t * transaction_new(void * sessionH,
         else {
             // generate a token
             uint8_t temp_token[COAP_TOKEN_LEN];
-            time_t tv_sec = lwm2m_gettime();
+            time_t tv_sec = utils_getTime();
 
             // initialize first 6 bytes, leave the last 2 random
             temp_token[0] = mID;
@@ -249,11 +249,177 @@ void transaction_free(lwm2m_transaction_t * transacP)
     lwm2m_free(transacP);
 }
 
+static uint32_t prv_sessionHash(lwm2m_context_t * contextP,
+                                void * sessionH)
+{
+#ifdef LWM2M_WITH_SESSION_HASH
+    return lwm2m_session_hash(sessionH, contextP->userData);
+#else
+    (void)contextP;
+    (void)sessionH;
+    return 0;
+#endif
+}
+
+static uint32_t prv_midHash(lwm2m_context_t * contextP,
+                            void * sessionH,
+                            uint16_t mID)
+{
+    return (prv_sessionHash(contextP, sessionH) ^ mID) & (LWM2M_TRANSACTION_HASH_SIZE - 1);
+}
+
+static uint32_t prv_tokenHash(lwm2m_context_t * contextP,
+                              void * sessionH,
+                              const uint8_t * token,
+                              int tokenLen)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ prv_sessionHash(contextP, sessionH);
+    int i;
+
+    for (i = 0 ; i < tokenLen ; i++)
+    {
+        hash ^= token[i];
+        hash *= 16777619u;
+    }
+
+    return hash & (LWM2M_TRANSACTION_HASH_SIZE - 1);
+}
+
+static lwm2m_transaction_t * prv_findByMid(lwm2m_context_t * contextP,
+                                           void * fromSessionH,
+                                           uint16_t mID)
+{
+    lwm2m_transaction_t * transacP;
+
+    transacP = contextP->transactionMidTable[prv_midHash(contextP, fromSessionH, mID)];
+    while (NULL != transacP)
+    {
+        if (transacP->mID == mID
+         && !transacP->ack_received
+         && lwm2m_session_is_equal(fromSessionH, transacP->peerH, contextP->userData) == true)
+        {
+            return transacP;
+        }
+        transacP = transacP->midNext;
+    }
+
+    return NULL;
+}
+
+static lwm2m_transaction_t * prv_findByToken(lwm2m_context_t * contextP,
+                                             void * fromSessionH,
+                                             coap_packet_t * message)
+{
+    lwm2m_transaction_t * transacP;
+    const uint8_t * token;
+    int len;
+
+    len = coap_get_header_token(message, &token);
+    if (len <= 0) return NULL;
+
+    transacP = contextP->transactionTokenTable[prv_tokenHash(contextP, fromSessionH, token, len)];
+    while (NULL != transacP)
+    {
+        if (prv_checkFinished(transacP, message)
+         && lwm2m_session_is_equal(fromSessionH, transacP->peerH, contextP->userData) == true)
+        {
+            return transacP;
+        }
+        transacP = transacP->tokenNext;
+    }
+
+    return NULL;
+}
+
+static bool prv_retransmitsBefore(lwm2m_heap_node_t * firstP,
+                                  lwm2m_heap_node_t * secondP)
+{
+    return HEAP_ENTRY(firstP, lwm2m_transaction_t, heapNode)->retrans_time
+         < HEAP_ENTRY(secondP, lwm2m_transaction_t, heapNode)->retrans_time;
+}
+
+static void prv_unschedule(lwm2m_context_t * contextP,
+                           lwm2m_transaction_t * transacP)
+{
+    contextP->transactionHeap = heap_remove(contextP->transactionHeap, &transacP->heapNode, prv_retransmitsBefore);
+}
+
+// (re)insert the transaction in the retransmission schedule after a change of retrans_time
+static void prv_schedule(lwm2m_context_t * contextP,
+                         lwm2m_transaction_t * transacP)
+{
+    prv_unschedule(contextP, transacP);
+    contextP->transactionHeap = heap_insert(contextP->transactionHeap, &transacP->heapNode, prv_retransmitsBefore);
+}
+
+void transaction_add(lwm2m_context_t * contextP,
+                     lwm2m_transaction_t * transacP)
+{
+    coap_packet_t * message = (coap_packet_t *)transacP->message;
+    uint32_t hash;
+
+    LOG_ARG("mID: %d", transacP->mID);
+
+#ifdef LWM2M_WITH_SESSION_REFS
+    lwm2m_session_hold(transacP->peerH, contextP->userData);
+#endif
+
+    transacP->prev = NULL;
+    transacP->next = contextP->transactionList;
+    if (NULL != transacP->next) transacP->next->prev = transacP;
+    contextP->transactionList = transacP;
+
+    hash = prv_midHash(contextP, transacP->peerH, transacP->mID);
+    transacP->midNext = contextP->transactionMidTable[hash];
+    contextP->transactionMidTable[hash] = transacP;
+
+    transacP->tokenNext = NULL;
+    if (IS_OPTION(message, COAP_OPTION_TOKEN) && message->token_len > 0)
+    {
+        hash = prv_tokenHash(contextP, transacP->peerH, message->token, message->token_len);
+        transacP->tokenNext = contextP->transactionTokenTable[hash];
+        contextP->transactionTokenTable[hash] = transacP;
+    }
+
+    prv_schedule(contextP, transacP);
+}
+
 void transaction_remove(lwm2m_context_t * contextP,
                         lwm2m_transaction_t * transacP)
 {
+    coap_packet_t * message = (coap_packet_t *)transacP->message;
+    lwm2m_transaction_t ** bucketP;
+
     LOG("Entering");
-    contextP->transactionList = (lwm2m_transaction_t *) LWM2M_LIST_RM(contextP->transactionList, transacP->mID, NULL);
+
+    if (NULL != transacP->prev)
+    {
+        transacP->prev->next = transacP->next;
+    }
+    else if (contextP->transactionList == transacP)
+    {
+        contextP->transactionList = transacP->next;
+    }
+    if (NULL != transacP->next) transacP->next->prev = transacP->prev;
+
+    bucketP = &contextP->transactionMidTable[prv_midHash(contextP, transacP->peerH, transacP->mID)];
+    while (NULL != *bucketP && *bucketP != transacP) bucketP = &(*bucketP)->midNext;
+    if (NULL != *bucketP) *bucketP = transacP->midNext;
+
+    if (IS_OPTION(message, COAP_OPTION_TOKEN) && message->token_len > 0)
+    {
+        bucketP = &contextP->transactionTokenTable[prv_tokenHash(contextP, transacP->peerH, message->token, message->token_len)];
+        while (NULL != *bucketP && *bucketP != transacP) bucketP = &(*bucketP)->tokenNext;
+        if (NULL != *bucketP) *bucketP = transacP->tokenNext;
+    }
+
+    prv_unschedule(contextP, transacP);
+
+#ifdef LWM2M_WITH_SESSION_REFS
+    lwm2m_session_release(transacP->peerH, contextP->userData);
+#endif
+
     transaction_free(transacP);
 }
 
@@ -262,80 +428,72 @@ bool transaction_handleResponse(lwm2m_context_t * contextP,
                                  coap_packet_t * message,
                                  coap_packet_t * response)
 {
-    bool found = false;
     bool reset = false;
-    lwm2m_transaction_t * transacP;
+    lwm2m_transaction_t * transacP = NULL;
 
     LOG("Entering");
-    transacP = contextP->transactionList;
 
-    while (NULL != transacP)
+    if ((COAP_TYPE_ACK == message->type) || (COAP_TYPE_RST == message->type))
     {
-        if (lwm2m_session_is_equal(fromSessionH, transacP->peerH, contextP->userData) == true)
+        transacP = prv_findByMid(contextP, fromSessionH, message->mid);
+        if (NULL != transacP)
         {
-            if (!transacP->ack_received)
-            {
-                if ((COAP_TYPE_ACK == message->type) || (COAP_TYPE_RST == message->type))
-                {
-                    if (transacP->mID == message->mid)
-	                {
-    	                found = true;
-        	            transacP->ack_received = true;
-            	        reset = COAP_TYPE_RST == message->type;
-            	    }
-                }
-            }
+            transacP->ack_received = true;
+            reset = COAP_TYPE_RST == message->type;
 
-            if (reset || prv_checkFinished(transacP, message))
+            if (!reset && !prv_checkFinished(transacP, message))
             {
-                // HACK: If a message is sent from the monitor callback,
-                // it will arrive before the registration ACK.
-                // So we resend transaction that were denied for authentication reason.
-                if (!reset)
-                {
-                    if (COAP_TYPE_CON == message->type && NULL != response)
-                    {
-                        coap_init_message(response, COAP_TYPE_ACK, 0, message->mid);
-                        message_send(contextP, response, fromSessionH);
-                    }
-                
-	                if ((COAP_401_UNAUTHORIZED == message->code) && (COAP_MAX_RETRANSMIT > transacP->retrans_counter))
-    	            {
-        	            transacP->ack_received = false;
-            	        transacP->retrans_time += COAP_RESPONSE_TIMEOUT;
-                	    return true;
-                	}
-				}       
-                if (transacP->callback != NULL)
+                // the response is not piggybacked: wait for the separate one
+                int64_t currentMs = utils_getTimeMs();
+                if (0 <= currentMs)
                 {
-                    transacP->callback(transacP, message);
-                }
-                transaction_remove(contextP, transacP);
-                return true;
-            }
-            // if we found our guy, exit
-            if (found)
-            {
-                time_t tv_sec = lwm2m_gettime();
-                if (0 <= tv_sec)
-                {
-                    transacP->retrans_time = tv_sec;
+                    transacP->retrans_time = currentMs;
                 }
                 if (transacP->response_timeout)
                 {
-                    transacP->retrans_time += transacP->response_timeout;
+                    transacP->retrans_time += (int64_t)transacP->response_timeout * 1000;
                 }
                 else
                 {
-                    transacP->retrans_time += COAP_RESPONSE_TIMEOUT * transacP->retrans_counter;
+                    transacP->retrans_time += (int64_t)transacP->ack_timeout * transacP->retrans_counter;
                 }
+                prv_schedule(contextP, transacP);
                 return true;
             }
         }
+    }
 
-        transacP = transacP->next;
+    if (NULL == transacP)
+    {
+        transacP = prv_findByToken(contextP, fromSessionH, message);
+        if (NULL == transacP) return false;
     }
-    return false;
+
+    // HACK: If a message is sent from the monitor callback,
+    // it will arrive before the registration ACK.
+    // So we resend transaction that were denied for authentication reason.
+    if (!reset)
+    {
+        if (COAP_TYPE_CON == message->type && NULL != response)
+        {
+            coap_init_message(response, COAP_TYPE_ACK, 0, message->mid);
+            message_send(contextP, response, fromSessionH);
+        }
+
+        if ((COAP_401_UNAUTHORIZED == message->code) && (COAP_MAX_RETRANSMIT > transacP->retrans_counter))
+        {
+            transacP->ack_received = false;
+            transacP->retrans_time += transacP->ack_timeout;
+            prv_schedule(contextP, transacP);
+            return true;
+        }
+    }
+    if (transacP->callback != NULL)
+    {
+        transacP->callback(transacP, message);
+    }
+    transaction_remove(contextP, transacP);
+    return true;
 }
 
 int transaction_send(lwm2m_context_t * contextP,
@@ -346,17 +504,27 @@ int transaction_send(lwm2m_context_t * contextP,
     LOG("Entering");
     if (transacP->buffer == NULL)
     {
-        transacP->buffer_len = coap_serialize_get_size(transacP->message);
-        if (transacP->buffer_len == 0) return COAP_500_INTERNAL_SERVER_ERROR;
+        size_t allocLen;
 
-        transacP->buffer = (uint8_t*)lwm2m_malloc(transacP->buffer_len);
-        if (transacP->buffer == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+        // kept for the retransmissions: serialized straight into its own buffer
+        // rather than into the context one
+        allocLen = coap_serialize_get_size(transacP->message);
+        if (allocLen == 0)
+        {
+            transaction_remove(contextP, transacP);
+            return COAP_500_INTERNAL_SERVER_ERROR;
+        }
+
+        transacP->buffer = (uint8_t*)lwm2m_malloc(allocLen);
+        if (transacP->buffer == NULL)
+        {
+            transaction_remove(contextP, transacP);
+            return COAP_500_INTERNAL_SERVER_ERROR;
+        }
 
-        transacP->buffer_len = coap_serialize_message(transacP->message, transacP->buffer);
+        transacP->buffer_len = coap_serialize_message_bounded(transacP->message, transacP->buffer, allocLen);
         if (transacP->buffer_len == 0)
         {
-            lwm2m_free(transacP->buffer);
-            transacP->buffer = NULL;
             transaction_remove(contextP, transacP);
             return COAP_500_INTERNAL_SERVER_ERROR;
         }
@@ -364,14 +532,16 @@ int transaction_send(lwm2m_context_t * contextP,
 
     if (!transacP->ack_received)
     {
-        long unsigned timeout = 0;
+        int64_t timeout = 0;
 
         if (0 == transacP->retrans_counter)
         {
-            time_t tv_sec = lwm2m_gettime();
-            if (0 <= tv_sec)
+            int64_t currentMs = utils_getTimeMs();
+            if (0 <= currentMs)
             {
-                transacP->retrans_time = tv_sec + COAP_RESPONSE_TIMEOUT;
+                // randomized so that peers do not retransmit in lockstep
+                transacP->ack_timeout = COAP_RESPONSE_TIMEOUT_MS + (rand() % COAP_RESPONSE_TIMEOUT_BACKOFF_MOD);
+                transacP->retrans_time = currentMs + transacP->ack_timeout;
                 transacP->retrans_counter = 1;
                 timeout = 0;
             }
@@ -382,7 +552,7 @@ int transaction_send(lwm2m_context_t * contextP,
         }
         else
         {
-            timeout = COAP_RESPONSE_TIMEOUT << (transacP->retrans_counter - 1);
+            timeout = (int64_t)transacP->ack_timeout << (transacP->retrans_counter - 1);
         }
 
         if (COAP_MAX_RETRANSMIT + 1 >= transacP->retrans_counter)
@@ -408,51 +578,46 @@ int transaction_send(lwm2m_context_t * contextP,
         return -1;
     }
 
+    prv_schedule(contextP, transacP);
+
     return 0;
 }
 
 void transaction_step(lwm2m_context_t * contextP,
-                      time_t currentTime,
-                      time_t * timeoutP)
+                      int64_t currentTime,
+                      int64_t * timeoutP)
 {
     lwm2m_transaction_t * transacP;
 
     LOG("Entering");
-    transacP = contextP->transactionList;
-    while (transacP != NULL)
+    // only the transactions which are due are visited, the earliest being at the top of the heap
+    while (NULL != contextP->transactionHeap)
     {
-        // transaction_send() may remove transaction from the linked list
-        lwm2m_transaction_t * nextP = transacP->next;
-        int removed = 0;
-
-        if (transacP->retrans_time <= currentTime)
-        {
-            removed = transaction_send(contextP, transacP);
-        }
-
-        if (0 == removed)
+        transacP = HEAP_ENTRY(contextP->transactionHeap, lwm2m_transaction_t, heapNode);
+        if (transacP->retrans_time > currentTime)
         {
-            time_t interval;
+            int64_t interval = transacP->retrans_time - currentTime;
 
-            if (transacP->retrans_time > currentTime)
-            {
-                interval = transacP->retrans_time - currentTime;
-            }
-            else
+            if (*timeoutP > interval)
             {
-                interval = 1;
+                *timeoutP = interval;
             }
+            break;
+        }
 
-            if (*timeoutP > interval)
+        if (0 == transaction_send(contextP, transacP))
+        {
+            if (transacP->retrans_time <= currentTime)
             {
-                *timeoutP = interval;
+                // we are late, retry at the next step
+                transacP->retrans_time = currentTime + 1000;
+                prv_schedule(contextP, transacP);
             }
         }
         else
         {
-            *timeoutP = 1;
+            // transaction_send() removed the transaction
+            if (*timeoutP > 1000) *timeoutP = 1000;
         }
-
-        transacP = nextP;
     }
 }
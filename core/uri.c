@@ -327,3 +327,19 @@ int uri_toString(lwm2m_uri_t * uriP,
 
     return head;
 }
+
+bool uri_matchPath(const char * uri,
+                   multi_option_t * pathP)
+{
+    size_t i = 0;
+
+    for ( ; pathP != NULL ; pathP = pathP->next)
+    {
+        if (uri[i] != '/') return false;
+        i++;
+        if (strncmp(uri + i, (char *)pathP->data, pathP->len) != 0) return false;
+        i += pathP->len;
+    }
+
+    return uri[i] == 0;
+}
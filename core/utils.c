@@ -538,6 +538,32 @@ size_t utils_base64Encode(uint8_t * dataP,
     return result_len;
 }
 
+time_t utils_getTime(void)
+{
+#ifdef LWM2M_WITH_MS_CLOCK
+    int64_t currentMs = lwm2m_gettime_ms();
+
+    if (currentMs < 0) return -1;
+
+    return (time_t)(currentMs / 1000);
+#else
+    return lwm2m_gettime();
+#endif
+}
+
+int64_t utils_getTimeMs(void)
+{
+#ifdef LWM2M_WITH_MS_CLOCK
+    return lwm2m_gettime_ms();
+#else
+    time_t tv_sec = lwm2m_gettime();
+
+    if (tv_sec < 0) return -1;
+
+    return (int64_t)tv_sec * 1000;
+#endif
+}
+
 lwm2m_data_type_t utils_depthToDatatype(uri_depth_t depth)
 {
     switch (depth)
@@ -29,6 +29,9 @@ set(WAKAAMA_SOURCES
     ${WAKAAMA_SOURCES_DIR}/json.c
     ${WAKAAMA_SOURCES_DIR}/discover.c
     ${WAKAAMA_SOURCES_DIR}/block1.c
+    ${WAKAAMA_SOURCES_DIR}/block2.c
+    ${WAKAAMA_SOURCES_DIR}/dedup.c
+    ${WAKAAMA_SOURCES_DIR}/heap.c
     ${WAKAAMA_SOURCES_DIR}/internals.h
 	${CORE_HEADERS}
     ${EXT_SOURCES})
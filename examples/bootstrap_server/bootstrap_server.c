@@ -64,10 +64,9 @@ typedef struct
 } internal_data_t;
 
 /*
- * ensure sync with: er_coap_13.h COAP_MAX_PACKET_SIZE!
- * or internals.h LWM2M_MAX_PACKET_SIZE!
+ * large enough for a block of the biggest negotiable size
  */
-#define MAX_PACKET_SIZE 198
+#define MAX_PACKET_SIZE LWM2M_MAX_PACKET_SIZE
 
 static int g_quit = 0;
 
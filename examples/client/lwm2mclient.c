@@ -61,6 +61,7 @@
 #include "lwm2mclient.h"
 #include "liblwm2m.h"
 #include "commandline.h"
+#include "eventloop.h"
 #ifdef WITH_TINYDTLS
 #include "dtlsconnection.h"
 #else
@@ -84,7 +85,7 @@
 
 #include <assert.h>
 
-#define MAX_PACKET_SIZE 1024
+#define MAX_PACKET_SIZE LWM2M_MAX_PACKET_SIZE
 #define DEFAULT_SERVER_IPV6 "[::1]"
 #define DEFAULT_SERVER_IPV4 "127.0.0.1"
 
@@ -108,6 +109,7 @@ typedef struct
     lwm2m_context_t * lwm2mH;
 #else
     connection_t * connList;
+    connection_batch_t * batch;     // datagrams sent by one lwm2m_step() go out with one sendmmsg()
 #endif
     int addressFamily;
 } client_data_t;
@@ -255,6 +257,7 @@ void * lwm2m_connect_server(uint16_t secObjInstID,
         fprintf(stderr, "Connection creation failed.\r\n");
     }
     else {
+        newConnP->batch = dataP->batch;
         dataP->connList = newConnP;
     }
 
@@ -307,6 +310,18 @@ void lwm2m_close_connection(void * sessionH,
     }
 }
 
+#ifdef LWM2M_WITH_SEND_BATCH
+void lwm2m_buffer_hold(void * userData)
+{
+    connection_batch_hold(((client_data_t *)userData)->batch);
+}
+
+void lwm2m_buffer_flush(void * userData)
+{
+    connection_batch_flush(((client_data_t *)userData)->batch);
+}
+#endif
+
 static void prv_output_servers(char * buffer,
                                void * user_data)
 {
@@ -747,6 +762,8 @@ void print_usage(void)
     fprintf(stdout, "  -t TIME\tSet the lifetime of the Client. Default: 300\r\n");
     fprintf(stdout, "  -b\t\tBootstrap requested.\r\n");
     fprintf(stdout, "  -c\t\tChange battery level over time.\r\n");
+    fprintf(stdout, "  -B SIZE\tSet the preferred block size, a power of two from 16 to %d.\r\n", LWM2M_MAX_BLOCK_SIZE);
+    fprintf(stdout, "  -C\t\tSend confirmable notifications.\r\n");
 #ifdef WITH_TINYDTLS
     fprintf(stdout, "  -i STRING\tSet the device management or bootstrap server PSK identity. If not set use none secure mode\r\n");
     fprintf(stdout, "  -s HEXSTRING\tSet the device management or bootstrap server Pre-Shared-Key. If not set use none secure mode\r\n");
@@ -759,6 +776,7 @@ int main(int argc, char *argv[])
     client_data_t data;
     int result;
     lwm2m_context_t * lwm2mH = NULL;
+    eventloop_t * loopP;
     int i;
 //    const char * localPort = "56830";
     const char * localPort = "0";
@@ -767,12 +785,14 @@ int main(int argc, char *argv[])
 //    char * name = "testlwm2mclient";
     char * name;
     assert(asprintf(&name, "client_%ld", time(NULL)));
+    int blockSize = 0;
     int lifetime = 300;
     int batterylevelchanging = 0;
     time_t reboot_time = 0;
     int opt;
     bool bootstrapRequested = false;
     bool serverPortChanged = false;
+    bool confirmableNotify = false;
 
 #ifdef LWM2M_BOOTSTRAP
     lwm2m_client_state_t previousState = STATE_INITIAL;
@@ -835,6 +855,22 @@ int main(int argc, char *argv[])
         case 'c':
             batterylevelchanging = 1;
             break;
+        case 'C':
+            confirmableNotify = true;
+            break;
+        case 'B':
+            opt++;
+            if (opt >= argc)
+            {
+                print_usage();
+                return 0;
+            }
+            if (1 != sscanf(argv[opt], "%d", &blockSize))
+            {
+                print_usage();
+                return 0;
+            }
+            break;
         case 't':
             opt++;
             if (opt >= argc)
@@ -930,6 +966,26 @@ int main(int argc, char *argv[])
         fprintf(stderr, "Failed to open socket: %d %s\r\n", errno, strerror(errno));
         return -1;
     }
+#ifndef WITH_TINYDTLS
+    data.batch = connection_batch_new(data.sock);
+    if (data.batch == NULL)
+    {
+        fprintf(stderr, "Failed to allocate the send batch\r\n");
+        return -1;
+    }
+#endif
+
+    /*
+     * The loop waits on the socket and STDIN with epoll, with a timer armed from the next deadline of liblwm2m
+     */
+    loopP = eventloop_new();
+    if (loopP == NULL
+     || 0 != eventloop_add_fd(loopP, data.sock)
+     || 0 != eventloop_add_fd(loopP, STDIN_FILENO))
+    {
+        fprintf(stderr, "Failed to create the event loop: %d %s\r\n", errno, strerror(errno));
+        return -1;
+    }
 
     /*
      * Now the main function fill an array with each object, this list will be later passed to liblwm2m.
@@ -1078,6 +1134,14 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    if (blockSize != 0
+     && (blockSize > UINT16_MAX || COAP_NO_ERROR != lwm2m_set_block_size(lwm2mH, (uint16_t)blockSize)))
+    {
+        fprintf(stderr, "Invalid block size %d\r\n", blockSize);
+        return -1;
+    }
+    lwm2m_set_confirmable_notifications(lwm2mH, confirmableNotify);
+
 #ifdef WITH_TINYDTLS
     data.lwm2mH = lwm2mH;
 #endif
@@ -1116,7 +1180,7 @@ int main(int argc, char *argv[])
     while (0 == g_quit)
     {
         struct timeval tv;
-        fd_set readfds;
+        int64_t timeoutMs;
 
         lwm2m_uri_t uri;
         lwm2m_stringToUri("/3303/0/5700", sizeof("/3303/0/5700"), &uri);
@@ -1156,17 +1220,14 @@ int main(int argc, char *argv[])
         }
         tv.tv_usec = 0;
 
-        FD_ZERO(&readfds);
-        FD_SET(data.sock, &readfds);
-        FD_SET(STDIN_FILENO, &readfds);
-
         /*
          * This function does two things:
          *  - first it does the work needed by liblwm2m (eg. (re)sending some packets).
          *  - Secondly it adjusts the timeout value (default 60s) depending on the state of the transaction
          *    (eg. retransmission) and the time between the next operation
          */
-        result = lwm2m_step(lwm2mH, &(tv.tv_sec));
+        timeoutMs = (int64_t)tv.tv_sec * 1000;
+        result = lwm2m_step_ms(lwm2mH, &timeoutMs);
         fprintf(stdout, " -> State: ");
         switch (lwm2mH->state)
         {
@@ -1209,16 +1270,16 @@ int main(int argc, char *argv[])
         update_bootstrap_info(&previousState, lwm2mH);
 #endif
         /*
-         * This part will set up an interruption until an event happen on SDTIN or the socket until "tv" timed out (set
+         * This part will set up an interruption until an event happen on SDTIN or the socket until "timeoutMs" elapsed (set
          * with the precedent function)
          */
-        result = select(FD_SETSIZE, &readfds, NULL, NULL, &tv);
+        result = eventloop_wait(loopP, timeoutMs);
 
         if (result < 0)
         {
             if (errno != EINTR)
             {
-              fprintf(stderr, "Error in select(): %d %s\r\n", errno, strerror(errno));
+              fprintf(stderr, "Error in eventloop_wait(): %d %s\r\n", errno, strerror(errno));
             }
         }
         else if (result > 0)
@@ -1229,7 +1290,7 @@ int main(int argc, char *argv[])
             /*
              * If an event happens on the socket
              */
-            if (FD_ISSET(data.sock, &readfds))
+            if (eventloop_is_ready(loopP, data.sock))
             {
                 struct sockaddr_storage addr;
                 socklen_t addrLen;
@@ -1301,7 +1362,7 @@ int main(int argc, char *argv[])
             /*
              * If the event happened on the SDTIN
              */
-            else if (FD_ISSET(STDIN_FILENO, &readfds))
+            else if (eventloop_is_ready(loopP, STDIN_FILENO))
             {
                 numBytes = read(STDIN_FILENO, buffer, MAX_PACKET_SIZE - 1);
 
@@ -1340,8 +1401,12 @@ int main(int argc, char *argv[])
 #endif
         lwm2m_close(lwm2mH);
     }
+    eventloop_free(loopP);
     close(data.sock);
     connection_free(data.connList);
+#ifndef WITH_TINYDTLS
+    connection_batch_free(data.batch);
+#endif
 
     clean_security_object(objArray[0]);
     lwm2m_free(objArray[0]);
@@ -57,6 +57,8 @@ typedef struct
     uint8_t state;
     bool supported;
     uint8_t result;
+    FILE * package;      // package received with Block1, stored block by block
+    size_t packageSize;
 } firmware_data_t;
 
 
@@ -175,6 +177,58 @@ static uint8_t prv_firmware_write(uint16_t instanceId,
     return result;
 }
 
+static uint8_t prv_firmware_block_write(uint16_t instanceId,
+                                        uint16_t resourceId,
+                                        uint32_t offset,
+                                        uint8_t * buffer,
+                                        size_t length,
+                                        bool more,
+                                        lwm2m_object_t * objectP)
+{
+    firmware_data_t * data = (firmware_data_t*)(objectP->userData);
+
+    // this is a single instance object
+    if (instanceId != 0)
+    {
+        return COAP_404_NOT_FOUND;
+    }
+
+    if (resourceId != RES_M_PACKAGE)
+    {
+        return COAP_405_METHOD_NOT_ALLOWED;
+    }
+
+    if (offset == 0)
+    {
+        // new package, drop the previous one
+        if (data->package != NULL) fclose(data->package);
+        data->package = tmpfile();
+        if (data->package == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+        data->packageSize = 0;
+    }
+    else if (data->package == NULL || offset > data->packageSize)
+    {
+        // missing block
+        return COAP_408_REQ_ENTITY_INCOMPLETE;
+    }
+
+    // a retransmitted block is written again at the same place
+    if (fseek(data->package, offset, SEEK_SET) != 0
+     || fwrite(buffer, 1, length, data->package) != length)
+    {
+        return COAP_500_INTERNAL_SERVER_ERROR;
+    }
+    if (offset + length > data->packageSize) data->packageSize = offset + length;
+
+    if (!more)
+    {
+        fflush(data->package);
+        fprintf(stdout, "\n\t FIRMWARE PACKAGE RECEIVED: %lu bytes\r\n\n", (unsigned long)data->packageSize);
+    }
+
+    return COAP_204_CHANGED;
+}
+
 static uint8_t prv_firmware_execute(uint16_t instanceId,
                                     uint16_t resourceId,
                                     uint8_t * buffer,
@@ -219,8 +273,8 @@ void display_firmware_object(lwm2m_object_t * object)
     fprintf(stdout, "  /%u: Firmware object:\r\n", object->objID);
     if (NULL != data)
     {
-        fprintf(stdout, "    state: %u, supported: %s, result: %u\r\n",
-                data->state, data->supported?"true":"false", data->result);
+        fprintf(stdout, "    state: %u, supported: %s, result: %u, package: %lu bytes\r\n",
+                data->state, data->supported?"true":"false", data->result, (unsigned long)data->packageSize);
     }
 #endif
 }
@@ -267,6 +321,7 @@ lwm2m_object_t * get_object_firmware(void)
         firmwareObj->readFunc    = prv_firmware_read;
         firmwareObj->writeFunc   = prv_firmware_write;
         firmwareObj->executeFunc = prv_firmware_execute;
+        firmwareObj->blockWriteFunc = prv_firmware_block_write;
         firmwareObj->userData    = lwm2m_malloc(sizeof(firmware_data_t));
 
         /*
@@ -277,6 +332,8 @@ lwm2m_object_t * get_object_firmware(void)
             ((firmware_data_t*)firmwareObj->userData)->state = 1;
             ((firmware_data_t*)firmwareObj->userData)->supported = false;
             ((firmware_data_t*)firmwareObj->userData)->result = 0;
+            ((firmware_data_t*)firmwareObj->userData)->package = NULL;
+            ((firmware_data_t*)firmwareObj->userData)->packageSize = 0;
         }
         else
         {
@@ -292,6 +349,9 @@ void free_object_firmware(lwm2m_object_t * objectP)
 {
     if (NULL != objectP->userData)
     {
+        firmware_data_t * data = (firmware_data_t *)objectP->userData;
+
+        if (NULL != data->package) fclose(data->package);
         lwm2m_free(objectP->userData);
         objectP->userData = NULL;
     }
@@ -83,7 +83,7 @@ extern char * get_server_uri(lwm2m_object_t * objectP, uint16_t secObjInstID);
 extern lwm2m_object_t * get_test_object(void);
 extern void free_test_object(lwm2m_object_t * object);
 
-#define MAX_PACKET_SIZE 1024
+#define MAX_PACKET_SIZE LWM2M_MAX_PACKET_SIZE
 
 int g_reboot = 0;
 static int g_quit = 0;
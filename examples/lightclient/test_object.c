@@ -374,6 +374,8 @@ lwm2m_object_t * get_test_object(void)
         testObj->createFunc = prv_create;
         testObj->deleteFunc = prv_delete;
         testObj->discoverFunc = prv_discover;
+        // values only change on requests from the servers
+        testObj->reportsChanges = true;
     }
 
     return testObj;
@@ -1,4 +1,5 @@
 #include <ugeneric.h>
+#include <errno.h>
 #include <unistd.h>
 #include "glue.h"
 
@@ -87,32 +88,29 @@ lwm2m_client_t *find_device_by_id(const char *device_id,
                                   lwm2m_context_t *lwm2m_ctx,
                                   pthread_mutex_t *lwm2m_lock)
 {
-    for (lwm2m_client_t *c = lwm2m_ctx->clientList; c; c = c->next)
-    {
-        if (strcmp(c->name, device_id) == 0)
-        {
-            return c;
-        }
-    }
-
-    return NULL;
+    return lwm2m_get_client_by_name(lwm2m_ctx, device_id);
 }
 
-uvector_t *lwm2m_get_devices(lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock)
+void lwm2m_append_devices(uvector_t *devices, lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock)
 {
-    uvector_t *v = uvector_create();
     pthread_mutex_lock(lwm2m_lock);
     for (lwm2m_client_t *c = lwm2m_ctx->clientList; c; c = c->next)
     {
-        uvector_append(v, G_STR(ustring_dup(c->name)));
+        uvector_append(devices, G_STR(ustring_dup(c->name)));
     }
     pthread_mutex_unlock(lwm2m_lock);
+}
 
-    return v;
+void wake_lwm2m_thread(int wake_fd)
+{
+    uint64_t one = 1;
+
+    // EAGAIN means the counter is saturated, a wakeup is pending anyway
+    UASSERT_PERROR(write(wake_fd, &one, sizeof(one)) == sizeof(one) || errno == EAGAIN);
 }
 
 int lwm2m_write_sensor(const char *device_id, const char *sensor_id,
-                       lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock,
+                       lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock, int wake_fd,
                        char **data, size_t *data_size)
 {
 
@@ -120,7 +118,7 @@ int lwm2m_write_sensor(const char *device_id, const char *sensor_id,
 
 int lwm2m_read_sensor(const char *device_id, const char *sensor_id,
                       lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock,
-                      int terminate_fd,
+                      int wake_fd, int terminate_fd, bool if_changed,
                       lwm2m_read_response_t **response, size_t *response_size)
 {
     lwm2m_uri_t uri;
@@ -135,13 +133,6 @@ int lwm2m_read_sensor(const char *device_id, const char *sensor_id,
         goto not_found;
     }
 
-    lwm2m_client_t *c = find_device_by_id(device_id, lwm2m_ctx, lwm2m_lock);
-    if (!c)
-    {
-        ret = 1;
-        goto not_found;
-    }
-
     // Timeout for response is hardcoded in transaction.c and there is no
     // way to configure it. Timeout should be greater than CoAP timeout. If
     // data consumer timeouts it means we are screwed as lwm2m library
@@ -150,7 +141,22 @@ int lwm2m_read_sensor(const char *device_id, const char *sensor_id,
     dc = data_consumer_create((struct timeval){.tv_sec = 120}, terminate_fd);
 
     pthread_mutex_lock(lwm2m_lock); //---------------------------------------
-    ret = lwm2m_dm_read(lwm2m_ctx, c->internalID, &uri, read_callback, dc);
+    // The client is looked up under the lock it is used with: the shard
+    // thread frees it as soon as the device deregisters or expires.
+    lwm2m_client_t *c = find_device_by_id(device_id, lwm2m_ctx, lwm2m_lock);
+    if (!c)
+    {
+        ret = 1;
+    }
+    else if (if_changed)
+    {
+        // lets the device answer 2.03 Valid without payload if the value did not change
+        ret = lwm2m_dm_read_if_changed(lwm2m_ctx, c->internalID, &uri, read_callback, dc);
+    }
+    else
+    {
+        ret = lwm2m_dm_read(lwm2m_ctx, c->internalID, &uri, read_callback, dc);
+    }
     pthread_mutex_unlock(lwm2m_lock); // ------------------------------------
 
     if (ret != 0)
@@ -158,6 +164,9 @@ int lwm2m_read_sensor(const char *device_id, const char *sensor_id,
         goto not_found;
     }
 
+    // the request is only sent by the next lwm2m_step() of the shard thread
+    wake_lwm2m_thread(wake_fd);
+
     data_consumer_wait_for_data(dc);
 
     if (dc->data)
@@ -194,6 +203,7 @@ const char *status_to_str(int status)
         CODE_TO_STRING(COAP_IGNORE);
         CODE_TO_STRING(COAP_201_CREATED);
         CODE_TO_STRING(COAP_202_DELETED);
+        CODE_TO_STRING(COAP_203_VALID);
         CODE_TO_STRING(COAP_204_CHANGED);
         CODE_TO_STRING(COAP_205_CONTENT);
         CODE_TO_STRING(COAP_400_BAD_REQUEST);
@@ -30,20 +30,25 @@ void data_consumer_wait_for_data(data_consumer_t *dc);
 void data_consumer_destroy(data_consumer_t *dc);
 
 
+// Must be called with lwm2m_lock held, the client is only valid until it is released.
 lwm2m_client_t *find_device_by_id(const char *device_id,
                                   lwm2m_context_t *lwm2m_ctx,
                                   pthread_mutex_t *lwm2m_lock);
 
+// Wakes up the thread running lwm2m_step() on the context so that it sends
+// the requests queued by another thread and recomputes its timeout.
+void wake_lwm2m_thread(int wake_fd);
+
 int lwm2m_read_sensor(const char *device_id, const char *sensor_id,
                       lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock,
-                      int terminate_fd,
+                      int wake_fd, int terminate_fd, bool if_changed,
                       lwm2m_read_response_t **data, size_t *response_size);
 
 int lwm2m_write_sensor(const char *device_id, const char *sensor_id,
-                       lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock,
+                       lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock, int wake_fd,
                        char **data, size_t *data_size);
 
-uvector_t *lwm2m_get_devices(lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock);
+void lwm2m_append_devices(uvector_t *devices, lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock);
 const char *status_to_str(int status);
 
 #endif
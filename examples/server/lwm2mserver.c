@@ -80,18 +80,20 @@
 #include "db.h"
 #include "rest.h"
 #include "poller.h"
-
-#define MAX_PACKET_SIZE 1024
+#include "glue.h"
+#include "shard.h"
 
 volatile sig_atomic_t g_quit = 0;
 
 typedef struct {
     lwm2m_context_t *lwm2m_context;
     pthread_mutex_t *lwm2m_lock;
+    int wake_fd;
     const char *poll_sensors;
     int poll_interval;
     sqlite3 *db;
-    udict_t *pollers; // {'device_id': poller_ptr}
+    udict_t *pollers; // {'device_id': poller_ptr}, shared by all the shards
+    pthread_mutex_t *pollers_lock;
 } monitor_callback_data_t;
 
 void destroy_poller(void *ptr)
@@ -760,6 +762,20 @@ syntax_error:
     fprintf(stdout, "Syntax error !");
 }
 
+static void prv_progress_callback(uint16_t clientID,
+                                  lwm2m_uri_t *uriP,
+                                  size_t acknowledged,
+                                  size_t total,
+                                  void *userData)
+{
+    fprintf(stdout, "\r\nClient #%d /%d", clientID, uriP->objectId);
+    if (LWM2M_URI_IS_SET_INSTANCE(uriP))
+        fprintf(stdout, "/%d", uriP->instanceId);
+    if (LWM2M_URI_IS_SET_RESOURCE(uriP))
+        fprintf(stdout, "/%d", uriP->resourceId);
+    fprintf(stdout, " : %zu/%zu bytes sent\r\n", acknowledged, total);
+}
+
 static void prv_monitor_callback(uint16_t clientID,
                                  lwm2m_uri_t *uriP,
                                  int status,
@@ -774,7 +790,7 @@ static void prv_monitor_callback(uint16_t clientID,
     ugeneric_t p;
 
     lwm2m_context_t *lwm2mH = mcd->lwm2m_context;
-    lwm2m_client_t *targetP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)lwm2mH->clientList, clientID);
+    lwm2m_client_t *targetP = lwm2m_get_client(lwm2mH, clientID);
     UASSERT(targetP);
 
     /*
@@ -796,11 +812,12 @@ static void prv_monitor_callback(uint16_t clientID,
 
         if (mcd->poll_sensors)
         {
+            pthread_mutex_lock(mcd->pollers_lock);
             if (!udict_has_key(mcd->pollers, G_STR(targetP->name)))
             {
                 poller_t *poller = poller_create(targetP->name, mcd->poll_sensors,
                                                  mcd->db, lwm2mH, mcd->lwm2m_lock,
-                                                 mcd->poll_interval);
+                                                 mcd->wake_fd, mcd->poll_interval);
                 poller_start(poller);
                 udict_put(mcd->pollers, G_STR(ustring_dup(targetP->name)), G_PTR(poller));
             }
@@ -808,6 +825,7 @@ static void prv_monitor_callback(uint16_t clientID,
             {
                 printf("Device %s is already connected, poller is already running for it.", targetP->name);
             }
+            pthread_mutex_unlock(mcd->pollers_lock);
         }
         else
         {
@@ -819,7 +837,9 @@ static void prv_monitor_callback(uint16_t clientID,
     case COAP_202_DELETED:
         fprintf(stdout, "\r\nClient #%d unregistered.\r\n", clientID);
 
+        pthread_mutex_lock(mcd->pollers_lock);
         p = udict_pop(mcd->pollers, G_STR(targetP->name), G_NULL);
+        pthread_mutex_unlock(mcd->pollers_lock);
         UASSERT(!G_IS_NULL(p));
         // Can not delete here as lwm2m lock is acquired and destroy_poller may deadlock on joining thread
         // holding this lock, need to invent something different ...
@@ -857,6 +877,8 @@ void handle_sigint(int signum)
 #define REST_PORT_STR "8888"
 #define POLL_INTERVAL 5
 #define POLL_INTERVAL_STR "5"
+#define SHARD_COUNT 1
+#define SHARD_COUNT_STR "1"
 
 void print_usage(void)
 {
@@ -868,6 +890,8 @@ void print_usage(void)
     fprintf(stdout, "  -h PORT\t\tSet the local TCP port of the REST server. Default: "REST_PORT_STR"\r\n");
     fprintf(stdout, "  -s id1,id2,...\tCSV list of sensor IDs to poll.\r\n");
     fprintf(stdout, "  -i TIME\t\tPolling interval (seconds). Default: "POLL_INTERVAL_STR"\r\n");
+    fprintf(stdout, "  -t COUNT\t\tNumber of worker threads, each serving its own share of the clients.\r\n");
+    fprintf(stdout, "\t\t\tInteractive commands apply to the clients of the first worker. Default: "SHARD_COUNT_STR"\r\n");
     fprintf(stdout, "  --db-path\t\tDatabase file. Default: "DB_PATH"\r\n");
     fprintf(stdout, "  --wipe-db\t\tWipe DB on start-up if flag is provided.\r\n");
     fprintf(stdout, "  --mock-db\t\tMock some DB data compiled in the application.\r\n");
@@ -876,12 +900,12 @@ void print_usage(void)
 
 int main(int argc, char *argv[])
 {
-    int sock;
     fd_set readfds;
-    struct timeval tv;
     int result;
-    lwm2m_context_t * lwm2mH = NULL;
-    connection_t * connList = NULL;
+    shard_pool_t * shards = NULL;
+    shard_t * firstShard;
+    int stopFd;
+    int shardCount = SHARD_COUNT;
     int addressFamily = AF_INET;
     int opt;
     const char * localPort = LWM2M_STANDARD_PORT_STR;
@@ -1002,6 +1026,20 @@ int main(int argc, char *argv[])
                 }
                 poll_interval = atoi(argv[opt]);
                 break;
+            case 't':
+                opt++;
+                if (opt >= argc)
+                {
+                    print_usage();
+                    return 0;
+                }
+                shardCount = atoi(argv[opt]);
+                if (shardCount < 1)
+                {
+                    print_usage();
+                    return 0;
+                }
+                break;
             case '-':
             {
                 switch (argv[opt][2])
@@ -1081,66 +1119,54 @@ int main(int argc, char *argv[])
         get_samples(db, "dummy_device", "dummy_sensor", 0, 100);
     }
 
-    sock = create_socket(localPort, addressFamily);
-    if (sock < 0)
-    {
-        fprintf(stderr, "Error opening socket: %d\r\n", errno);
-        return -1;
-    }
-
-    lwm2mH = lwm2m_init(NULL);
-    if (NULL == lwm2mH)
-    {
-        fprintf(stderr, "lwm2m_init() failed\r\n");
-        return -1;
-    }
+    shards = shard_pool_create(shardCount, localPort, addressFamily);
+    firstShard = shard_pool_get_at(shards, 0);
+    stopFd = shard_pool_get_stop_fd(shards);
 
     signal(SIGINT, handle_sigint);
 
     for (int i = 0 ; commands[i].name != NULL ; i++)
     {
-        commands[i].userData = (void *)lwm2mH;
+        commands[i].userData = (void *)firstShard->lwm2m_ctx;
     }
     fprintf(stdout, "> "); fflush(stdout);
 
-    pthread_mutex_t lwm2m_lock;
-    pthread_mutex_init(&lwm2m_lock, NULL);
+    pthread_mutex_t pollers_lock;
+    pthread_mutex_init(&pollers_lock, NULL);
 
     udict_t *pollers = udict_create();
     udict_set_void_destroyer(pollers, destroy_poller);
-    monitor_callback_data_t mcd = {
-        .lwm2m_context = lwm2mH,
-        .lwm2m_lock = &lwm2m_lock,
-        .db = db,
-        .poll_interval = poll_interval,
-        .poll_sensors = poll_sensors,
-        .pollers = pollers,
-    };
-    lwm2m_set_monitoring_callback(lwm2mH, prv_monitor_callback, &mcd);
+    monitor_callback_data_t *mcds = umalloc(shardCount * sizeof(monitor_callback_data_t));
+    for (int i = 0 ; i < shardCount ; i++)
+    {
+        shard_t *shard = shard_pool_get_at(shards, i);
+
+        mcds[i] = (monitor_callback_data_t) {
+            .lwm2m_context = shard->lwm2m_ctx,
+            .lwm2m_lock = &shard->lwm2m_lock,
+            .wake_fd = shard->wake_fd,
+            .db = db,
+            .poll_interval = poll_interval,
+            .poll_sensors = poll_sensors,
+            .pollers = pollers,
+            .pollers_lock = &pollers_lock,
+        };
+        lwm2m_set_monitoring_callback(shard->lwm2m_ctx, prv_monitor_callback, &mcds[i]);
+        lwm2m_set_progress_callback(shard->lwm2m_ctx, prv_progress_callback, NULL);
+    }
 
     /* httpd */
-    httpd_t *httpd = start_httpd(rest_port, lwm2mH, &lwm2m_lock, db);
+    httpd_t *httpd = start_httpd(rest_port, shards, db);
+
+    shard_pool_start(shards);
 
     while (0 == g_quit)
     {
         FD_ZERO(&readfds);
-        FD_SET(sock, &readfds);
         FD_SET(STDIN_FILENO, &readfds);
+        FD_SET(stopFd, &readfds);
 
-        tv.tv_sec = 60;
-        tv.tv_usec = 0;
-
-        pthread_mutex_lock(&lwm2m_lock);
-        result = lwm2m_step(lwm2mH, &(tv.tv_sec));
-        pthread_mutex_unlock(&lwm2m_lock);
-
-        if (result != 0)
-        {
-            fprintf(stderr, "lwm2m_step() failed: 0x%X\r\n", result);
-            return -1;
-        }
-
-        result = select(FD_SETSIZE, &readfds, 0, 0, &tv);
+        result = select(MAX(STDIN_FILENO, stopFd) + 1, &readfds, 0, 0, NULL);
 
         if ( result < 0 )
         {
@@ -1154,57 +1180,10 @@ int main(int argc, char *argv[])
             uint8_t buffer[MAX_PACKET_SIZE];
             int numBytes;
 
-            if (FD_ISSET(sock, &readfds))
+            if (FD_ISSET(stopFd, &readfds))
             {
-                struct sockaddr_storage addr;
-                socklen_t addrLen;
-
-                addrLen = sizeof(addr);
-                numBytes = recvfrom(sock, buffer, MAX_PACKET_SIZE, 0, (struct sockaddr *)&addr, &addrLen);
-
-                if (numBytes == -1)
-                {
-                    fprintf(stderr, "Error in recvfrom(): %d\r\n", errno);
-                }
-                else
-                {
-                    char s[INET6_ADDRSTRLEN];
-                    in_port_t port;
-                    connection_t * connP;
-
-                    s[0] = 0;
-                    if (AF_INET == addr.ss_family)
-                    {
-                        struct sockaddr_in *saddr = (struct sockaddr_in *)&addr;
-                        inet_ntop(saddr->sin_family, &saddr->sin_addr, s, INET6_ADDRSTRLEN);
-                        port = saddr->sin_port;
-                    }
-                    else if (AF_INET6 == addr.ss_family)
-                    {
-                        struct sockaddr_in6 *saddr = (struct sockaddr_in6 *)&addr;
-                        inet_ntop(saddr->sin6_family, &saddr->sin6_addr, s, INET6_ADDRSTRLEN);
-                        port = saddr->sin6_port;
-                    }
-
-                    fprintf(stderr, "%d bytes received from [%s]:%hu\r\n", numBytes, s, ntohs(port));
-                    output_buffer(stderr, buffer, numBytes, 0);
-
-                    connP = connection_find(connList, &addr, addrLen);
-                    if (connP == NULL)
-                    {
-                        connP = connection_new_incoming(connList, sock, (struct sockaddr *)&addr, addrLen);
-                        if (connP != NULL)
-                        {
-                            connList = connP;
-                        }
-                    }
-                    if (connP != NULL)
-                    {
-                        pthread_mutex_lock(&lwm2m_lock);
-                        lwm2m_handle_packet(lwm2mH, buffer, numBytes, connP);
-                        pthread_mutex_unlock(&lwm2m_lock);
-                    }
-                }
+                // a worker failed
+                g_quit = 2;
             }
             else if (FD_ISSET(STDIN_FILENO, &readfds))
             {
@@ -1213,7 +1192,10 @@ int main(int argc, char *argv[])
                 if (numBytes > 1)
                 {
                     buffer[numBytes] = 0;
+                    pthread_mutex_lock(&firstShard->lwm2m_lock);
                     handle_command(commands, (char*)buffer);
+                    pthread_mutex_unlock(&firstShard->lwm2m_lock);
+                    wake_lwm2m_thread(firstShard->wake_fd);
                     fprintf(stdout, "\r\n");
                 }
                 if (g_quit == 0)
@@ -1228,14 +1210,15 @@ int main(int argc, char *argv[])
             }
         }
     }
+    shard_pool_stop(shards);
     udict_destroy(pollers);
 
     stop_httpd(httpd);
     sqlite3_close(db);
 
-    lwm2m_close(lwm2mH);
-    close(sock);
-    connection_free(connList);
+    shard_pool_destroy(shards);
+    ufree(mcds);
+    pthread_mutex_destroy(&pollers_lock);
 
 
 #ifdef MEMORY_TRACE
@@ -11,6 +11,7 @@ struct poller_opaq {
     uvector_t *sensors;
     pthread_mutex_t *lwm2m_lock;
     lwm2m_context_t *lwm2m_ctx;
+    int wake_fd;
     struct timeval interval;
     int terminate_read_fd;
     int terminate_write_fd;
@@ -23,6 +24,11 @@ static char *extract_sample(const lwm2m_read_response_t *response)
     {
         UASSERT(response->fmt == LWM2M_CONTENT_JSON);
     }
+    else if (response->status == COAP_203_VALID)
+    {
+        // value unchanged since the last poll
+        return NULL;
+    }
     else
     {
         fprintf(stderr, "device replied with error: %s\n", status_to_str(response->status));
@@ -78,19 +84,17 @@ static void poller_poll(poller_t *p)
         size_t response_size;
 
         printf("poll %s/%s\n", p->device_id, G_AS_STR(s[j]));
-        if (lwm2m_read_sensor(p->device_id, G_AS_STR(s[j]), p->lwm2m_ctx, p->lwm2m_lock, p->terminate_read_fd, &response, &response_size) == 0)
+        if (lwm2m_read_sensor(p->device_id, G_AS_STR(s[j]), p->lwm2m_ctx, p->lwm2m_lock, p->wake_fd, p->terminate_read_fd, true, &response, &response_size) == 0)
         {
-            if (response_size)
+            // a 2.03 Valid response comes without payload
+            char *sample = extract_sample(response);
+            if (sample)
             {
-                char *sample = extract_sample(response);
-                if (sample)
-                {
-                    save_sensor(p->db, p->device_id, G_AS_STR(s[j]), "TBD[name]", "TBD[unit]");
-                    insert_sample(p->db, p->device_id, G_AS_STR(s[j]), sample, time(NULL));
-                    ufree(sample);
-                }
-                ufree(response);
+                save_sensor(p->db, p->device_id, G_AS_STR(s[j]), "TBD[name]", "TBD[unit]");
+                insert_sample(p->db, p->device_id, G_AS_STR(s[j]), sample, time(NULL));
+                ufree(sample);
             }
+            ufree(response);
         }
         else
         {
@@ -132,7 +136,7 @@ static void *loop(void *data)
 }
 
 poller_t *poller_create(const char *device_id, const char *sensors_str, sqlite3 *db, lwm2m_context_t *lwm2m_ctx,
-                        pthread_mutex_t *lwm2m_lock, int interval)
+                        pthread_mutex_t *lwm2m_lock, int wake_fd, int interval)
 {
     UASSERT_INPUT(sensors_str);
     UASSERT_INPUT(db);
@@ -150,6 +154,7 @@ poller_t *poller_create(const char *device_id, const char *sensors_str, sqlite3
     p->db = db;
     p->lwm2m_lock = lwm2m_lock;
     p->lwm2m_ctx = lwm2m_ctx;
+    p->wake_fd = wake_fd;
     p->interval.tv_sec = interval;
     p->interval.tv_usec = 0;
     p->sensors = ustring_split(sensors_str, ",");
@@ -8,7 +8,7 @@
 
 typedef struct poller_opaq poller_t;
 poller_t *poller_create(const char *device_id, const char *sensors_str, sqlite3 *db, lwm2m_context_t *lwm2m_ctx,
-                        pthread_mutex_t *lwm2m_lock, int interval);
+                        pthread_mutex_t *lwm2m_lock, int wake_fd, int interval);
 void poller_destroy(poller_t *p);
 void poller_start(poller_t *p);
 
@@ -11,8 +11,7 @@
 
 struct httpd_opaq {
     struct MHD_Daemon *httpd;
-    lwm2m_context_t *lwm2m_ctx;
-    pthread_mutex_t *lwm2m_lock;
+    shard_pool_t *shards;
     sqlite3 *db;
 };
 
@@ -31,16 +30,14 @@ static int get_sensor_value(httpd_t *httpd, struct MHD_Connection *cn, const cha
 static int set_sensor_value(httpd_t *httpd, struct MHD_Connection *cn, const char *device_id, const char *sensor_id);
 static int get_sensor_statistics(httpd_t *httpd, struct MHD_Connection *cn, const char *device_id, const char *sensor_id, time_t from, time_t to);
 
-httpd_t *start_httpd(int port, lwm2m_context_t *lwm2m_ctx, pthread_mutex_t *lwm2m_lock, sqlite3 *db)
+httpd_t *start_httpd(int port, shard_pool_t *shards, sqlite3 *db)
 {
-    UASSERT(lwm2m_ctx);
-    UASSERT(lwm2m_lock);
+    UASSERT(shards);
     UASSERT(db);
 
     httpd_t *httpd = umalloc(sizeof(*httpd));
 
-    httpd->lwm2m_ctx = lwm2m_ctx;
-    httpd->lwm2m_lock = lwm2m_lock;
+    httpd->shards = shards;
     httpd->db = db;
 
     httpd->httpd = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION,
@@ -252,7 +249,13 @@ static int get_devices_list(httpd_t *httpd, struct MHD_Connection *cn)
 {
     int ret = 0;
     udict_t *td = udict_create();
-    uvector_t *v = lwm2m_get_devices(httpd->lwm2m_ctx, httpd->lwm2m_lock);
+    uvector_t *v = uvector_create();
+
+    for (size_t i = 0; i < shard_pool_get_size(httpd->shards); i++)
+    {
+        shard_t *s = shard_pool_get_at(httpd->shards, i);
+        lwm2m_append_devices(v, s->lwm2m_ctx, &s->lwm2m_lock);
+    }
 
     udict_put(td, G_CSTR("data"), G_VECTOR(v));
 
@@ -269,16 +272,22 @@ static int get_sensors_list(httpd_t *httpd, struct MHD_Connection *cn, const cha
 
     printf("Getting sensors list for %s\n", device_id);
 
-    lwm2m_client_t *c = find_device_by_id(device_id, httpd->lwm2m_ctx, httpd->lwm2m_lock);
+    shard_t *s = shard_pool_find_device(httpd->shards, device_id);
+    if (!s)
+    {
+        return respond_404(cn, NULL);
+    }
 
+    pthread_mutex_lock(&s->lwm2m_lock);
+    lwm2m_client_t *c = find_device_by_id(device_id, s->lwm2m_ctx, &s->lwm2m_lock);
     if (!c)
     {
+        pthread_mutex_unlock(&s->lwm2m_lock);
         return respond_404(cn, NULL);
     }
 
     udict_t *d = udict_create();
     uvector_t *sensors = uvector_create();
-    pthread_mutex_lock(httpd->lwm2m_lock);
     for (lwm2m_client_object_t *obj = c->objectList; obj; obj = obj->next)
     {
         if (obj->instanceList == NULL)
@@ -295,7 +304,7 @@ static int get_sensors_list(httpd_t *httpd, struct MHD_Connection *cn, const cha
             }
         }
     }
-    pthread_mutex_unlock(httpd->lwm2m_lock);
+    pthread_mutex_unlock(&s->lwm2m_lock);
 
     udict_put(d, G_CSTR("data"), G_VECTOR(sensors));
 
@@ -304,7 +313,6 @@ static int get_sensors_list(httpd_t *httpd, struct MHD_Connection *cn, const cha
     udict_destroy(d);
     ufree(str);
 
-    pthread_mutex_unlock(httpd->lwm2m_lock);
     return ret;
 }
 
@@ -314,7 +322,13 @@ static int get_sensor_value(httpd_t *httpd, struct MHD_Connection *cn, const cha
     size_t response_size = 0;
     int ret = 0;
 
-    if (lwm2m_read_sensor(device_id, sensor_id, httpd->lwm2m_ctx, httpd->lwm2m_lock, -1, &response, &response_size) != 0)
+    shard_t *s = shard_pool_find_device(httpd->shards, device_id);
+    if (!s)
+    {
+        return respond_404(cn, NULL);
+    }
+
+    if (lwm2m_read_sensor(device_id, sensor_id, s->lwm2m_ctx, &s->lwm2m_lock, s->wake_fd, -1, false, &response, &response_size) != 0)
     {
         return respond_404(cn, NULL);
     }
@@ -379,7 +393,8 @@ invalid_json:
 static int set_sensor_value(httpd_t *httpd, struct MHD_Connection *cn, const char *device_id, const char *sensor_id)
 {
     /*
-    if (lwm2m_write_sensor(device_id, sensor_id, httpd->lwm2m_ctx, httpd->lwm2m_lock, &response, &response_size) != 0)
+    shard_t *s = shard_pool_find_device(httpd->shards, device_id);
+    if (lwm2m_write_sensor(device_id, sensor_id, s->lwm2m_ctx, &s->lwm2m_lock, s->wake_fd, &response, &response_size) != 0)
     {
         return respond_404(cn, NULL);
     }
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <ugeneric.h>
+
+#include "commandline.h"
+#include "eventloop.h"
+#include "glue.h"
+#include "shard.h"
+
+#ifndef LWM2M_WITH_SESSION_REFS
+#error "idle connection eviction relies on LWM2M_WITH_SESSION_REFS"
+#endif
+
+struct shard_pool_opaq {
+    size_t count;
+    shard_t *shards;
+    int stop_read_fd;
+    int stop_write_fd;
+};
+
+static void shard_request_stop(shard_pool_t *pool)
+{
+    // never read, so that the descriptor stays readable for every worker
+    UASSERT_PERROR(write(pool->stop_write_fd, "stop", sizeof("stop")) != -1);
+}
+
+// Must be called with the shard lock held.
+static void shard_handle_datagram(shard_t *s, connection_packet_t *packet)
+{
+    struct sockaddr_storage *addr = &packet->addr;
+    char str[INET6_ADDRSTRLEN];
+    in_port_t port = 0;
+    connection_t *conn;
+
+    str[0] = 0;
+    if (AF_INET == addr->ss_family)
+    {
+        struct sockaddr_in *saddr = (struct sockaddr_in *)addr;
+        inet_ntop(saddr->sin_family, &saddr->sin_addr, str, INET6_ADDRSTRLEN);
+        port = saddr->sin_port;
+    }
+    else if (AF_INET6 == addr->ss_family)
+    {
+        struct sockaddr_in6 *saddr = (struct sockaddr_in6 *)addr;
+        inet_ntop(saddr->sin6_family, &saddr->sin6_addr, str, INET6_ADDRSTRLEN);
+        port = saddr->sin6_port;
+    }
+
+    fprintf(stderr, "[shard %d] %zu bytes received from [%s]:%hu\r\n", s->index, packet->length, str, ntohs(port));
+    output_buffer(stderr, packet->buffer, packet->length, 0);
+
+    conn = conntable_find(s->conns, (struct sockaddr *)addr, packet->addrLen);
+    if (conn == NULL)
+    {
+        conn = connection_new_incoming(NULL, s->sock, (struct sockaddr *)addr, packet->addrLen);
+        if (conn != NULL)
+        {
+            conn->batch = s->batch;
+            if (conntable_add(s->conns, (struct sockaddr *)addr, packet->addrLen, conn) != 0)
+            {
+                connection_free(conn);
+                conn = NULL;
+            }
+        }
+    }
+    if (conn != NULL)
+    {
+        lwm2m_handle_packet(s->lwm2m_ctx, packet->buffer, packet->length, conn);
+    }
+}
+
+// Called with the shard lock held. Connections still used by a registered
+// client or a pending transaction are kept.
+static bool shard_conn_evictable(void *conn, void *user_data)
+{
+    return ((connection_t *)conn)->refCount == 0;
+}
+
+static void shard_conn_release(void *conn, void *user_data)
+{
+    connection_free(conn);
+}
+
+static void *shard_thread(void *arg)
+{
+    shard_t *s = arg;
+    int stop_fd = s->pool->stop_read_fd;
+
+    eventloop_t *loop = eventloop_new();
+    UASSERT(loop);
+    UASSERT_PERROR(eventloop_add_fd(loop, s->sock) == 0);
+    UASSERT_PERROR(eventloop_add_fd(loop, stop_fd) == 0);
+    UASSERT_PERROR(eventloop_add_fd(loop, s->wake_fd) == 0);
+
+    while (true)
+    {
+        int64_t timeout_ms = 60000;
+        int result;
+
+        pthread_mutex_lock(&s->lwm2m_lock);
+        result = lwm2m_step_ms(s->lwm2m_ctx, &timeout_ms);
+        conntable_evict(s->conns, time(NULL));
+        pthread_mutex_unlock(&s->lwm2m_lock);
+
+        if (result != 0)
+        {
+            fprintf(stderr, "[shard %d] lwm2m_step() failed: 0x%X\r\n", s->index, result);
+            shard_request_stop(s->pool);
+            break;
+        }
+
+        // sleeps until the next retransmission or registration expiry
+        result = eventloop_wait(loop, timeout_ms);
+        if (result < 0)
+        {
+            if (errno != EINTR)
+            {
+                fprintf(stderr, "[shard %d] Error in eventloop_wait(): %d\r\n", s->index, errno);
+            }
+            continue;
+        }
+
+        if (eventloop_is_ready(loop, stop_fd))
+        {
+            break;
+        }
+
+        if (eventloop_is_ready(loop, s->wake_fd))
+        {
+            // another thread queued requests: they are sent by the
+            // lwm2m_step() at the top of the loop
+            uint64_t count;
+            UASSERT_PERROR(read(s->wake_fd, &count, sizeof(count)) == sizeof(count) || errno == EAGAIN);
+        }
+
+        if (eventloop_is_ready(loop, s->sock))
+        {
+            // Drain the datagrams already queued on the socket with one
+            // syscall; the responses are sent together once all of them
+            // have been handled.
+            pthread_mutex_lock(&s->lwm2m_lock);
+            int count = connection_batch_receive(s->batch);
+            if (count < 0)
+            {
+                fprintf(stderr, "[shard %d] Error receiving datagrams: %d\r\n", s->index, errno);
+            }
+            for (int i = 0; i < count; i++)
+            {
+                shard_handle_datagram(s, &s->batch->rx[i]);
+            }
+            int failed = connection_batch_flush(s->batch);
+            pthread_mutex_unlock(&s->lwm2m_lock);
+
+            if (failed)
+            {
+                fprintf(stderr, "[shard %d] %d datagrams could not be sent\r\n", s->index, failed);
+            }
+        }
+    }
+
+    eventloop_free(loop);
+
+    return NULL;
+}
+
+shard_pool_t *shard_pool_create(size_t count, const char *port, int address_family)
+{
+    UASSERT(count > 0);
+
+    shard_pool_t *pool = umalloc(sizeof(*pool));
+    pool->count = count;
+    pool->shards = umalloc(count * sizeof(shard_t));
+
+    int stop_pipe[2];
+    UASSERT_PERROR(pipe(stop_pipe) != -1);
+    pool->stop_read_fd = stop_pipe[0];
+    pool->stop_write_fd = stop_pipe[1];
+
+    for (size_t i = 0; i < count; i++)
+    {
+        shard_t *s = &pool->shards[i];
+
+        s->index = (int)i;
+        s->pool = pool;
+        s->conns = conntable_new(SHARD_CONN_IDLE_TIMEOUT, shard_conn_evictable, shard_conn_release, s);
+        UASSERT(s->conns);
+
+        s->sock = create_reuseport_socket(port, address_family);
+        if (s->sock < 0)
+        {
+            fprintf(stderr, "Error opening socket for shard %zu: %d\r\n", i, errno);
+            abort();
+        }
+
+        s->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        UASSERT_PERROR(s->wake_fd != -1);
+
+        s->batch = connection_batch_new(s->sock);
+        if (s->batch == NULL)
+        {
+            fprintf(stderr, "Error allocating datagram batch for shard %zu\r\n", i);
+            abort();
+        }
+
+        s->lwm2m_ctx = lwm2m_init(NULL);
+        if (s->lwm2m_ctx == NULL)
+        {
+            fprintf(stderr, "lwm2m_init() failed for shard %zu\r\n", i);
+            abort();
+        }
+
+        pthread_mutex_init(&s->lwm2m_lock, NULL);
+    }
+
+    return pool;
+}
+
+void shard_pool_start(shard_pool_t *pool)
+{
+    for (size_t i = 0; i < pool->count; i++)
+    {
+        UASSERT(pthread_create(&pool->shards[i].thread, NULL, shard_thread, &pool->shards[i]) == 0);
+    }
+}
+
+void shard_pool_stop(shard_pool_t *pool)
+{
+    shard_request_stop(pool);
+    for (size_t i = 0; i < pool->count; i++)
+    {
+        pthread_join(pool->shards[i].thread, NULL);
+    }
+}
+
+void shard_pool_destroy(shard_pool_t *pool)
+{
+    for (size_t i = 0; i < pool->count; i++)
+    {
+        shard_t *s = &pool->shards[i];
+
+        lwm2m_close(s->lwm2m_ctx);
+        close(s->sock);
+        close(s->wake_fd);
+        conntable_free(s->conns);
+        connection_batch_free(s->batch);
+        pthread_mutex_destroy(&s->lwm2m_lock);
+    }
+
+    close(pool->stop_read_fd);
+    close(pool->stop_write_fd);
+    ufree(pool->shards);
+    ufree(pool);
+}
+
+size_t shard_pool_get_size(const shard_pool_t *pool)
+{
+    return pool->count;
+}
+
+shard_t *shard_pool_get_at(shard_pool_t *pool, size_t index)
+{
+    UASSERT(index < pool->count);
+
+    return &pool->shards[index];
+}
+
+int shard_pool_get_stop_fd(const shard_pool_t *pool)
+{
+    return pool->stop_read_fd;
+}
+
+shard_t *shard_pool_find_device(shard_pool_t *pool, const char *device_id)
+{
+    for (size_t i = 0; i < pool->count; i++)
+    {
+        shard_t *s = &pool->shards[i];
+
+        pthread_mutex_lock(&s->lwm2m_lock);
+        lwm2m_client_t *c = find_device_by_id(device_id, s->lwm2m_ctx, &s->lwm2m_lock);
+        pthread_mutex_unlock(&s->lwm2m_lock);
+
+        if (c)
+        {
+            return s;
+        }
+    }
+
+    return NULL;
+}
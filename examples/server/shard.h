@@ -0,0 +1,46 @@
+#ifndef __SHARD_H
+#define __SHARD_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <liblwm2m.h>
+#include "connection.h"
+#include "conntable.h"
+
+#define MAX_PACKET_SIZE LWM2M_MAX_PACKET_SIZE
+// peers silent for that long (seconds) and not registered are forgotten
+#define SHARD_CONN_IDLE_TIMEOUT 300
+
+typedef struct shard_pool_opaq shard_pool_t;
+
+// A worker thread owning its own LWM2M context and UDP socket. All the
+// sockets of a pool are bound to the same port with SO_REUSEPORT, the
+// kernel then dispatches each peer to a shard by hashing its address.
+typedef struct {
+    int index;
+    int sock;
+    int wake_fd; // eventfd written by the other threads after queueing requests on lwm2m_ctx
+    pthread_t thread;
+    pthread_mutex_t lwm2m_lock;
+    lwm2m_context_t *lwm2m_ctx;
+    conntable_t *conns;
+    connection_batch_t *batch;
+    shard_pool_t *pool;
+} shard_t;
+
+shard_pool_t *shard_pool_create(size_t count, const char *port, int address_family);
+void shard_pool_start(shard_pool_t *pool);
+void shard_pool_stop(shard_pool_t *pool);
+void shard_pool_destroy(shard_pool_t *pool);
+
+size_t shard_pool_get_size(const shard_pool_t *pool);
+shard_t *shard_pool_get_at(shard_pool_t *pool, size_t index);
+// Readable when the pool is stopping, either on request or because a worker failed.
+int shard_pool_get_stop_fd(const shard_pool_t *pool);
+
+// Returns the shard the device identified by its endpoint name is registered to, NULL if none.
+// The device may be gone once the shard lock is released: callers look it up
+// again under the lock before using it.
+shard_t *shard_pool_find_device(shard_pool_t *pool, const char *device_id);
+
+#endif
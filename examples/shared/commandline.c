@@ -429,6 +429,7 @@ static const char* prv_status_to_string(int status)
     CODE_TO_STRING(COAP_IGNORE);
     CODE_TO_STRING(COAP_201_CREATED);
     CODE_TO_STRING(COAP_202_DELETED);
+    CODE_TO_STRING(COAP_203_VALID);
     CODE_TO_STRING(COAP_204_CHANGED);
     CODE_TO_STRING(COAP_205_CONTENT);
     CODE_TO_STRING(COAP_400_BAD_REQUEST);
@@ -16,15 +16,22 @@
  *    
  *******************************************************************************/
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for recvmmsg() and sendmmsg()
+#endif
+
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <ctype.h>
 #include "connection.h"
 
 // from commandline.c
 void output_buffer(FILE * stream, uint8_t * buffer, int length, int indent);
 
-int create_socket(const char * portStr, int addressFamily)
+static int prv_create_socket(const char * portStr,
+                             int addressFamily,
+                             bool reusePort)
 {
     int s = -1;
     struct addrinfo hints;
@@ -44,6 +51,16 @@ int create_socket(const char * portStr, int addressFamily)
     for(p = res ; p != NULL && s == -1 ; p = p->ai_next)
     {
         s = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (s >= 0 && reusePort)
+        {
+            int enable = 1;
+
+            if (-1 == setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)))
+            {
+                close(s);
+                s = -1;
+            }
+        }
         if (s >= 0)
         {
             if (-1 == bind(s, p->ai_addr, p->ai_addrlen))
@@ -59,6 +76,16 @@ int create_socket(const char * portStr, int addressFamily)
     return s;
 }
 
+int create_socket(const char * portStr, int addressFamily)
+{
+    return prv_create_socket(portStr, addressFamily, false);
+}
+
+int create_reuseport_socket(const char * portStr, int addressFamily)
+{
+    return prv_create_socket(portStr, addressFamily, true);
+}
+
 connection_t * connection_find(connection_t * connList,
                                struct sockaddr_storage * addr,
                                size_t addrLen)
@@ -92,6 +119,8 @@ connection_t * connection_new_incoming(connection_t * connList,
         connP->sock = sock;
         memcpy(&(connP->addr), addr, addrLen);
         connP->addrLen = addrLen;
+        connP->batch = NULL;
+        connP->refCount = 0;
         connP->next = connList;
     }
 
@@ -190,6 +219,28 @@ int connection_send(connection_t *connP,
     output_buffer(stderr, buffer, length, 0);
 #endif
 
+    if (connP->batch != NULL
+     && connP->batch->queuing
+     && connP->batch->sock == connP->sock
+     && length <= CONNECTION_MAX_PACKET_SIZE)
+    {
+        connection_packet_t * packetP;
+
+        if (connP->batch->txCount == CONNECTION_BATCH_SIZE)
+        {
+            connection_batch_flush(connP->batch);
+            connP->batch->queuing = true;
+        }
+        packetP = connP->batch->tx + connP->batch->txCount;
+        memcpy(packetP->buffer, buffer, length);
+        packetP->length = length;
+        memcpy(&(packetP->addr), &(connP->addr), connP->addrLen);
+        packetP->addrLen = connP->addrLen;
+        connP->batch->txCount++;
+
+        return 0;
+    }
+
     offset = 0;
     while (offset != length)
     {
@@ -200,6 +251,158 @@ int connection_send(connection_t *connP,
     return 0;
 }
 
+connection_batch_t * connection_batch_new(int sock)
+{
+    connection_batch_t * batchP;
+
+    batchP = (connection_batch_t *)malloc(sizeof(connection_batch_t));
+    if (batchP != NULL)
+    {
+        batchP->sock = sock;
+        batchP->queuing = false;
+        batchP->rxCount = 0;
+        batchP->txCount = 0;
+    }
+
+    return batchP;
+}
+
+void connection_batch_free(connection_batch_t * batchP)
+{
+    free(batchP);
+}
+
+void connection_batch_hold(connection_batch_t * batchP)
+{
+    batchP->queuing = true;
+}
+
+#ifdef MSG_WAITFORONE
+
+int connection_batch_receive(connection_batch_t * batchP)
+{
+    struct mmsghdr msgs[CONNECTION_BATCH_SIZE];
+    struct iovec iovecs[CONNECTION_BATCH_SIZE];
+    int i;
+    int nbMsg;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0 ; i < CONNECTION_BATCH_SIZE ; i++)
+    {
+        iovecs[i].iov_base = batchP->rx[i].buffer;
+        iovecs[i].iov_len = CONNECTION_MAX_PACKET_SIZE;
+        msgs[i].msg_hdr.msg_iov = iovecs + i;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &(batchP->rx[i].addr);
+        msgs[i].msg_hdr.msg_namelen = sizeof(batchP->rx[i].addr);
+    }
+
+    // block for the first datagram only, then take what is already queued
+    nbMsg = recvmmsg(batchP->sock, msgs, CONNECTION_BATCH_SIZE, MSG_WAITFORONE, NULL);
+    if (nbMsg < 0)
+    {
+        batchP->rxCount = 0;
+        return -1;
+    }
+
+    for (i = 0 ; i < nbMsg ; i++)
+    {
+        batchP->rx[i].length = msgs[i].msg_len;
+        batchP->rx[i].addrLen = msgs[i].msg_hdr.msg_namelen;
+    }
+    batchP->rxCount = nbMsg;
+    batchP->queuing = true;
+
+    return nbMsg;
+}
+
+int connection_batch_flush(connection_batch_t * batchP)
+{
+    struct mmsghdr msgs[CONNECTION_BATCH_SIZE];
+    struct iovec iovecs[CONNECTION_BATCH_SIZE];
+    int i;
+    int offset;
+    int nbFailed;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0 ; i < batchP->txCount ; i++)
+    {
+        iovecs[i].iov_base = batchP->tx[i].buffer;
+        iovecs[i].iov_len = batchP->tx[i].length;
+        msgs[i].msg_hdr.msg_iov = iovecs + i;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &(batchP->tx[i].addr);
+        msgs[i].msg_hdr.msg_namelen = batchP->tx[i].addrLen;
+    }
+
+    nbFailed = 0;
+    offset = 0;
+    while (offset < batchP->txCount)
+    {
+        int nbSent;
+
+        nbSent = sendmmsg(batchP->sock, msgs + offset, batchP->txCount - offset, 0);
+        if (nbSent < 0)
+        {
+            if (errno == EINTR) continue;
+            // datagrams are independent, drop the one in error and go on
+            fprintf(stderr, "Error in sendmmsg(): %d\r\n", errno);
+            nbFailed++;
+            nbSent = 1;
+        }
+        offset += nbSent;
+    }
+
+    batchP->txCount = 0;
+    batchP->queuing = false;
+
+    return nbFailed;
+}
+
+#else
+
+int connection_batch_receive(connection_batch_t * batchP)
+{
+    int numBytes;
+
+    batchP->rx[0].addrLen = sizeof(batchP->rx[0].addr);
+    numBytes = recvfrom(batchP->sock, batchP->rx[0].buffer, CONNECTION_MAX_PACKET_SIZE, 0,
+                        (struct sockaddr *)&(batchP->rx[0].addr), &(batchP->rx[0].addrLen));
+    if (numBytes < 0)
+    {
+        batchP->rxCount = 0;
+        return -1;
+    }
+    batchP->rx[0].length = numBytes;
+    batchP->rxCount = 1;
+    batchP->queuing = true;
+
+    return 1;
+}
+
+int connection_batch_flush(connection_batch_t * batchP)
+{
+    int i;
+    int nbFailed;
+
+    nbFailed = 0;
+    for (i = 0 ; i < batchP->txCount ; i++)
+    {
+        if (-1 == sendto(batchP->sock, batchP->tx[i].buffer, batchP->tx[i].length, 0,
+                         (struct sockaddr *)&(batchP->tx[i].addr), batchP->tx[i].addrLen))
+        {
+            nbFailed++;
+        }
+    }
+
+    batchP->txCount = 0;
+    batchP->queuing = false;
+
+    return nbFailed;
+}
+
+#endif
+
 uint8_t lwm2m_buffer_send(void * sessionH,
                           uint8_t * buffer,
                           size_t length,
@@ -228,3 +431,26 @@ bool lwm2m_session_is_equal(void * session1,
 {
     return (session1 == session2);
 }
+
+#ifdef LWM2M_WITH_SESSION_HASH
+uint32_t lwm2m_session_hash(void * sessionH,
+                            void * userData)
+{
+    // sessions are compared by address in lwm2m_session_is_equal()
+    return (uint32_t)((uintptr_t)sessionH >> 4);
+}
+#endif
+
+#ifdef LWM2M_WITH_SESSION_REFS
+void lwm2m_session_hold(void * sessionH,
+                        void * userData)
+{
+    ((connection_t *)sessionH)->refCount++;
+}
+
+void lwm2m_session_release(void * sessionH,
+                           void * userData)
+{
+    ((connection_t *)sessionH)->refCount--;
+}
+#endif
@@ -34,15 +34,45 @@
 #define LWM2M_BSSERVER_PORT_STR "5685"
 #define LWM2M_BSSERVER_PORT      5685
 
+#define CONNECTION_MAX_PACKET_SIZE  LWM2M_MAX_PACKET_SIZE
+#define CONNECTION_BATCH_SIZE       16
+
+typedef struct
+{
+    uint8_t                 buffer[CONNECTION_MAX_PACKET_SIZE];
+    size_t                  length;
+    struct sockaddr_storage addr;
+    socklen_t               addrLen;
+} connection_packet_t;
+
+/*
+ * Datagrams received with a single recvmmsg() and datagrams to send with a
+ * single sendmmsg(). Between connection_batch_receive() and
+ * connection_batch_flush(), connection_send() on a connection attached to the
+ * batch only queues the datagram.
+ */
+typedef struct
+{
+    int                     sock;
+    bool                    queuing;
+    int                     rxCount;
+    connection_packet_t     rx[CONNECTION_BATCH_SIZE];
+    int                     txCount;
+    connection_packet_t     tx[CONNECTION_BATCH_SIZE];
+} connection_batch_t;
+
 typedef struct _connection_t
 {
     struct _connection_t *  next;
     int                     sock;
     struct sockaddr_in6     addr;
     size_t                  addrLen;
+    connection_batch_t *    batch;
+    int                     refCount;   // references held by the LWM2M core, see lwm2m_session_hold()
 } connection_t;
 
 int create_socket(const char * portStr, int ai_family);
+int create_reuseport_socket(const char * portStr, int ai_family);
 
 connection_t * connection_find(connection_t * connList, struct sockaddr_storage * addr, size_t addrLen);
 connection_t * connection_new_incoming(connection_t * connList, int sock, struct sockaddr * addr, size_t addrLen);
@@ -52,4 +82,13 @@ void connection_free(connection_t * connList);
 
 int connection_send(connection_t *connP, uint8_t * buffer, size_t length);
 
+connection_batch_t * connection_batch_new(int sock);
+void connection_batch_free(connection_batch_t * batchP);
+// queues the datagrams sent until connection_batch_flush() without receiving first
+void connection_batch_hold(connection_batch_t * batchP);
+// returns the number of datagrams stored in batchP->rx or -1 in case of error
+int connection_batch_receive(connection_batch_t * batchP);
+// sends the queued datagrams, returns the number of datagrams which could not be sent
+int connection_batch_flush(connection_batch_t * batchP);
+
 #endif
@@ -0,0 +1,263 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "conntable.h"
+
+#define CONNTABLE_MIN_BUCKETS 64
+
+typedef struct _conntable_entry_t
+{
+    struct _conntable_entry_t * hashNext;
+    struct _conntable_entry_t * lruPrev;
+    struct _conntable_entry_t * lruNext;
+    uint32_t                    hash;
+    time_t                      lastSeen;
+    struct sockaddr_storage     addr;
+    size_t                      addrLen;
+    void *                      connP;
+} conntable_entry_t;
+
+struct _conntable_t
+{
+    conntable_entry_t **    buckets;
+    size_t                  bucketCount;
+    size_t                  count;
+    // least recently active first
+    conntable_entry_t *     lruHead;
+    conntable_entry_t *     lruTail;
+    time_t                  idleTimeout;
+    conntable_evictable_t   evictableCb;
+    conntable_release_t     releaseCb;
+    void *                  userData;
+};
+
+static uint32_t prv_hash(const struct sockaddr * addr,
+                         size_t addrLen)
+{
+    const uint8_t * bytes = (const uint8_t *)addr;
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    // FNV-1a on the whole address, as connections are compared with memcmp()
+    for (i = 0 ; i < addrLen ; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void prv_lruUnlink(conntable_t * tableP,
+                          conntable_entry_t * entryP)
+{
+    if (entryP->lruPrev != NULL) entryP->lruPrev->lruNext = entryP->lruNext;
+    else tableP->lruHead = entryP->lruNext;
+    if (entryP->lruNext != NULL) entryP->lruNext->lruPrev = entryP->lruPrev;
+    else tableP->lruTail = entryP->lruPrev;
+}
+
+static void prv_lruAppend(conntable_t * tableP,
+                          conntable_entry_t * entryP)
+{
+    entryP->lruNext = NULL;
+    entryP->lruPrev = tableP->lruTail;
+    if (tableP->lruTail != NULL) tableP->lruTail->lruNext = entryP;
+    else tableP->lruHead = entryP;
+    tableP->lruTail = entryP;
+}
+
+static void prv_touch(conntable_t * tableP,
+                      conntable_entry_t * entryP,
+                      time_t now)
+{
+    entryP->lastSeen = now;
+    if (entryP != tableP->lruTail)
+    {
+        prv_lruUnlink(tableP, entryP);
+        prv_lruAppend(tableP, entryP);
+    }
+}
+
+static int prv_resize(conntable_t * tableP,
+                      size_t bucketCount)
+{
+    conntable_entry_t ** buckets;
+    size_t i;
+
+    buckets = (conntable_entry_t **)calloc(bucketCount, sizeof(conntable_entry_t *));
+    if (buckets == NULL) return -1;
+
+    for (i = 0 ; i < tableP->bucketCount ; i++)
+    {
+        while (tableP->buckets[i] != NULL)
+        {
+            conntable_entry_t * entryP = tableP->buckets[i];
+
+            tableP->buckets[i] = entryP->hashNext;
+            entryP->hashNext = buckets[entryP->hash % bucketCount];
+            buckets[entryP->hash % bucketCount] = entryP;
+        }
+    }
+    free(tableP->buckets);
+    tableP->buckets = buckets;
+    tableP->bucketCount = bucketCount;
+
+    return 0;
+}
+
+static void prv_remove(conntable_t * tableP,
+                       conntable_entry_t * entryP)
+{
+    conntable_entry_t ** linkP;
+
+    linkP = &(tableP->buckets[entryP->hash % tableP->bucketCount]);
+    while (*linkP != entryP) linkP = &((*linkP)->hashNext);
+    *linkP = entryP->hashNext;
+
+    prv_lruUnlink(tableP, entryP);
+    tableP->count--;
+}
+
+conntable_t * conntable_new(time_t idleTimeout,
+                            conntable_evictable_t evictableCb,
+                            conntable_release_t releaseCb,
+                            void * userData)
+{
+    conntable_t * tableP;
+
+    tableP = (conntable_t *)calloc(1, sizeof(conntable_t));
+    if (tableP == NULL) return NULL;
+
+    if (0 != prv_resize(tableP, CONNTABLE_MIN_BUCKETS))
+    {
+        free(tableP);
+        return NULL;
+    }
+    tableP->idleTimeout = idleTimeout;
+    tableP->evictableCb = evictableCb;
+    tableP->releaseCb = releaseCb;
+    tableP->userData = userData;
+
+    return tableP;
+}
+
+void conntable_free(conntable_t * tableP)
+{
+    while (tableP->lruHead != NULL)
+    {
+        conntable_entry_t * entryP = tableP->lruHead;
+
+        tableP->lruHead = entryP->lruNext;
+        if (tableP->releaseCb != NULL) tableP->releaseCb(entryP->connP, tableP->userData);
+        free(entryP);
+    }
+    free(tableP->buckets);
+    free(tableP);
+}
+
+void * conntable_find(conntable_t * tableP,
+                      const struct sockaddr * addr,
+                      size_t addrLen)
+{
+    conntable_entry_t * entryP;
+    uint32_t hash;
+
+    hash = prv_hash(addr, addrLen);
+    for (entryP = tableP->buckets[hash % tableP->bucketCount] ; entryP != NULL ; entryP = entryP->hashNext)
+    {
+        if (entryP->hash == hash
+         && entryP->addrLen == addrLen
+         && memcmp(&(entryP->addr), addr, addrLen) == 0)
+        {
+            prv_touch(tableP, entryP, time(NULL));
+            return entryP->connP;
+        }
+    }
+
+    return NULL;
+}
+
+int conntable_add(conntable_t * tableP,
+                  const struct sockaddr * addr,
+                  size_t addrLen,
+                  void * connP)
+{
+    conntable_entry_t * entryP;
+
+    if (addrLen > sizeof(entryP->addr)) return -1;
+
+    if (tableP->count >= 2 * tableP->bucketCount)
+    {
+        // keeps the previous buckets if the allocation fails
+        prv_resize(tableP, 2 * tableP->bucketCount);
+    }
+
+    entryP = (conntable_entry_t *)malloc(sizeof(conntable_entry_t));
+    if (entryP == NULL) return -1;
+
+    memcpy(&(entryP->addr), addr, addrLen);
+    entryP->addrLen = addrLen;
+    entryP->connP = connP;
+    entryP->hash = prv_hash(addr, addrLen);
+    entryP->lastSeen = time(NULL);
+
+    entryP->hashNext = tableP->buckets[entryP->hash % tableP->bucketCount];
+    tableP->buckets[entryP->hash % tableP->bucketCount] = entryP;
+    prv_lruAppend(tableP, entryP);
+    tableP->count++;
+
+    return 0;
+}
+
+size_t conntable_count(conntable_t * tableP)
+{
+    return tableP->count;
+}
+
+size_t conntable_evict(conntable_t * tableP,
+                       time_t now)
+{
+    size_t evicted = 0;
+
+    if (tableP->idleTimeout <= 0) return 0;
+
+    while (tableP->lruHead != NULL
+        && tableP->lruHead->lastSeen + tableP->idleTimeout <= now)
+    {
+        conntable_entry_t * entryP = tableP->lruHead;
+
+        if (tableP->evictableCb != NULL
+         && !tableP->evictableCb(entryP->connP, tableP->userData))
+        {
+            // still in use: check it again after another idle period
+            prv_touch(tableP, entryP, now);
+            continue;
+        }
+
+        prv_remove(tableP, entryP);
+        if (tableP->releaseCb != NULL) tableP->releaseCb(entryP->connP, tableP->userData);
+        free(entryP);
+        evicted++;
+    }
+
+    return evicted;
+}
@@ -0,0 +1,53 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+#ifndef CONNTABLE_H_
+#define CONNTABLE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/socket.h>
+
+/*
+ * Connections indexed by peer address, for servers handling many peers.
+ * The table does not know about the connection type, so it can hold
+ * connection_t as well as dtls_connection_t.
+ *
+ * Connections are kept in least recently used order. A connection no
+ * packet was received from for idleTimeout seconds is evicted by
+ * conntable_evict(), unless evictableCb refuses it.
+ */
+typedef struct _conntable_t conntable_t;
+
+// Tells if an idle connection can be released, e.g. it is not used by a registered client.
+typedef bool (*conntable_evictable_t)(void * connP, void * userData);
+// Releases a connection evicted or left in the table when it is freed.
+typedef void (*conntable_release_t)(void * connP, void * userData);
+
+conntable_t * conntable_new(time_t idleTimeout, conntable_evictable_t evictableCb, conntable_release_t releaseCb, void * userData);
+void conntable_free(conntable_t * tableP);
+
+// Returns the connection for this address or NULL, and marks it as active.
+void * conntable_find(conntable_t * tableP, const struct sockaddr * addr, size_t addrLen);
+int conntable_add(conntable_t * tableP, const struct sockaddr * addr, size_t addrLen, void * connP);
+size_t conntable_count(conntable_t * tableP);
+
+// Releases the connections idle since more than idleTimeout. Returns the number of evicted connections.
+size_t conntable_evict(conntable_t * tableP, time_t now);
+
+#endif
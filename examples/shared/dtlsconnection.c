@@ -636,3 +636,12 @@ bool lwm2m_session_is_equal(void * session1,
 {
     return (session1 == session2);
 }
+
+#ifdef LWM2M_WITH_SESSION_HASH
+uint32_t lwm2m_session_hash(void * sessionH,
+                            void * userData)
+{
+    // sessions are compared by address in lwm2m_session_is_equal()
+    return (uint32_t)((uintptr_t)sessionH >> 4);
+}
+#endif
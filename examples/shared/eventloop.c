@@ -0,0 +1,159 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "eventloop.h"
+
+struct _eventloop_t
+{
+    int                 epollFd;
+    int                 timerFd;
+    int                 readyCount;
+    struct epoll_event  ready[EVENTLOOP_MAX_EVENTS];
+};
+
+eventloop_t * eventloop_new(void)
+{
+    eventloop_t * loopP;
+
+    loopP = (eventloop_t *)malloc(sizeof(eventloop_t));
+    if (loopP == NULL) return NULL;
+
+    loopP->readyCount = 0;
+    loopP->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (loopP->epollFd < 0)
+    {
+        free(loopP);
+        return NULL;
+    }
+
+    loopP->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (loopP->timerFd < 0
+     || 0 != eventloop_add_fd(loopP, loopP->timerFd))
+    {
+        eventloop_free(loopP);
+        return NULL;
+    }
+
+    return loopP;
+}
+
+void eventloop_free(eventloop_t * loopP)
+{
+    if (loopP->timerFd >= 0) close(loopP->timerFd);
+    close(loopP->epollFd);
+    free(loopP);
+}
+
+int eventloop_add_fd(eventloop_t * loopP,
+                     int fd)
+{
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+
+    return epoll_ctl(loopP->epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int eventloop_remove_fd(eventloop_t * loopP,
+                        int fd)
+{
+    int i;
+
+    // forget about a pending readiness
+    for (i = 0 ; i < loopP->readyCount ; i++)
+    {
+        if (loopP->ready[i].data.fd == fd) loopP->ready[i].data.fd = -1;
+    }
+
+    return epoll_ctl(loopP->epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static int prv_armTimer(eventloop_t * loopP,
+                        int64_t timeoutMs)
+{
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    if (timeoutMs == 0)
+    {
+        // a zero it_value disarms the timer
+        spec.it_value.tv_nsec = 1;
+    }
+    else if (timeoutMs > 0)
+    {
+        spec.it_value.tv_sec = timeoutMs / 1000;
+        spec.it_value.tv_nsec = (timeoutMs % 1000) * 1000000;
+    }
+
+    return timerfd_settime(loopP->timerFd, 0, &spec, NULL);
+}
+
+int eventloop_wait(eventloop_t * loopP,
+                   int64_t timeoutMs)
+{
+    int nbEvents;
+    int nbReady;
+    int i;
+
+    loopP->readyCount = 0;
+    if (0 != prv_armTimer(loopP, timeoutMs)) return -1;
+
+    nbEvents = epoll_wait(loopP->epollFd, loopP->ready, EVENTLOOP_MAX_EVENTS, -1);
+    if (nbEvents < 0) return -1;
+    loopP->readyCount = nbEvents;
+
+    nbReady = 0;
+    for (i = 0 ; i < nbEvents ; i++)
+    {
+        if (loopP->ready[i].data.fd == loopP->timerFd)
+        {
+            uint64_t expirations;
+
+            // clear the expiration count, the timer is rearmed on next wait
+            if (read(loopP->timerFd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) return -1;
+            loopP->ready[i].data.fd = -1;
+        }
+        else
+        {
+            nbReady++;
+        }
+    }
+
+    return nbReady;
+}
+
+bool eventloop_is_ready(eventloop_t * loopP,
+                        int fd)
+{
+    int i;
+
+    for (i = 0 ; i < loopP->readyCount ; i++)
+    {
+        if (loopP->ready[i].data.fd == fd) return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,49 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+#ifndef EVENTLOOP_H_
+#define EVENTLOOP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EVENTLOOP_MAX_EVENTS 64
+
+/*
+ * Waits on a set of file descriptors with epoll. Each loop owns a timerfd
+ * armed with the next deadline returned by lwm2m_step() so that the loop
+ * sleeps until the next retransmission or lifetime expiry, without the
+ * FD_SETSIZE limit of select().
+ */
+typedef struct _eventloop_t eventloop_t;
+
+eventloop_t * eventloop_new(void);
+void eventloop_free(eventloop_t * loopP);
+
+int eventloop_add_fd(eventloop_t * loopP, int fd);
+int eventloop_remove_fd(eventloop_t * loopP, int fd);
+
+// Blocks until one of the registered descriptors is readable or timeoutMs elapsed.
+// A negative timeoutMs waits without timeout.
+// Returns the number of readable registered descriptors, 0 if the timer expired
+// and -1 in case of error.
+int eventloop_wait(eventloop_t * loopP, int64_t timeoutMs);
+
+// Tells if fd was reported readable by the last eventloop_wait().
+bool eventloop_is_ready(eventloop_t * loopP, int fd);
+
+#endif
@@ -59,6 +59,20 @@ time_t lwm2m_gettime(void)
     return tv.tv_sec;
 }
 
+#ifdef LWM2M_WITH_MS_CLOCK
+int64_t lwm2m_gettime_ms(void)
+{
+    struct timeval tv;
+
+    if (0 != gettimeofday(&tv, NULL))
+    {
+        return -1;
+    }
+
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+#endif
+
 void lwm2m_printf(const char * format, ...)
 {
     va_list ap;
@@ -5,6 +5,8 @@ set(SHARED_SOURCES_DIR ${CMAKE_CURRENT_LIST_DIR})
 set(SHARED_SOURCES 
     ${SHARED_SOURCES_DIR}/commandline.c
     ${SHARED_SOURCES_DIR}/platform.c
+    ${SHARED_SOURCES_DIR}/eventloop.c
+    ${SHARED_SOURCES_DIR}/conntable.c
 	${SHARED_SOURCES_DIR}/memtrace.c)
 
 if(DTLS)
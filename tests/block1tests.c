@@ -21,28 +21,61 @@
 #include "liblwm2m.h"
 
 
-static void handle_12345(lwm2m_block1_data_t ** blk1,
-                                  uint16_t mid) {
-    uint8_t *buffer = "12345";
+#define BLOCK_16 "0123456789abcdef"
+
+static void prv_init_block(coap_packet_t * message,
+                           uint16_t mid,
+                           const char * uri,
+                           uint32_t num,
+                           uint8_t more,
+                           const char * payload,
+                           size_t length)
+{
+    coap_init_message(message, COAP_TYPE_CON, COAP_PUT, mid);
+    coap_set_header_uri_path(message, uri);
+    coap_set_header_block1(message, num, more, 16);
+    coap_set_payload(message, payload, length);
+}
+
+static coap_status_t prv_handle(lwm2m_block1_data_t ** blk1,
+                                coap_packet_t * message,
+                                time_t now,
+                                uint8_t ** resultBuffer,
+                                size_t * bsize)
+{
+    coap_status_t st;
+
+    *resultBuffer = NULL;
+    st = coap_block1_handler(blk1, message, now, resultBuffer, bsize);
+    coap_free_header(message);
+
+    return st;
+}
+
+static void handle_first(lwm2m_block1_data_t ** blk1,
+                         uint16_t mid) {
+    coap_packet_t message;
     size_t bsize;
-    uint8_t *resultBuffer = NULL;
+    uint8_t *resultBuffer;
 
-    coap_status_t st = coap_block1_handler(blk1, mid, buffer, 5, 5, 0, true, &resultBuffer, &bsize);
+    prv_init_block(&message, mid, "/5/0/0", 0, 1, BLOCK_16, 16);
+    coap_status_t st = prv_handle(blk1, &message, 0, &resultBuffer, &bsize);
     CU_ASSERT_EQUAL(st, COAP_231_CONTINUE);
     CU_ASSERT_PTR_NULL(resultBuffer);
 }
 
-static void handle_67(lwm2m_block1_data_t ** blk1,
-                                  uint16_t mid) {
-    uint8_t *buffer = "67";
+static void handle_last(lwm2m_block1_data_t ** blk1,
+                        uint16_t mid) {
+    coap_packet_t message;
     size_t bsize;
-    uint8_t *resultBuffer = NULL;
+    uint8_t *resultBuffer;
 
-    coap_status_t st = coap_block1_handler(blk1, mid, buffer, 2, 5, 1, false, &resultBuffer, &bsize);
+    prv_init_block(&message, mid, "/5/0/0", 1, 0, "67", 2);
+    coap_status_t st = prv_handle(blk1, &message, 0, &resultBuffer, &bsize);
     CU_ASSERT_EQUAL(st, NO_ERROR);
-    CU_ASSERT_PTR_NOT_NULL(*resultBuffer);
-    CU_ASSERT_EQUAL(bsize, 7);
-    CU_ASSERT_NSTRING_EQUAL(resultBuffer, "1234567", 7);
+    CU_ASSERT_PTR_NOT_NULL(resultBuffer);
+    CU_ASSERT_EQUAL(bsize, 18);
+    CU_ASSERT_NSTRING_EQUAL(resultBuffer, BLOCK_16 "67", 18);
 }
 
 
@@ -50,8 +83,8 @@ static void test_block1_nominal(void)
 {
     lwm2m_block1_data_t * blk1 = NULL;
 
-    handle_12345(&blk1, 123);
-    handle_67(&blk1, 346);
+    handle_first(&blk1, 123);
+    handle_last(&blk1, 346);
 
     free_block1_buffer(blk1);
 }
@@ -60,18 +93,185 @@ static void test_block1_retransmit(void)
 {
     lwm2m_block1_data_t * blk1 = NULL;
 
-    handle_12345(&blk1, 1);
-    handle_12345(&blk1, 1);
-    handle_67(&blk1, 3);
-    handle_67(&blk1, 3);
-    handle_67(&blk1, 3);
+    handle_first(&blk1, 1);
+    handle_first(&blk1, 1);
+    handle_last(&blk1, 3);
+    handle_last(&blk1, 3);
+    handle_last(&blk1, 3);
+
+    free_block1_buffer(blk1);
+}
+
+static void test_block1_size1(void)
+{
+    lwm2m_block1_data_t * blk1 = NULL;
+    coap_packet_t message;
+    uint8_t buffer[64];
+    size_t bsize;
+    uint8_t *resultBuffer;
+    uint8_t *firstBuffer;
+    uint32_t num;
+
+    // the whole transfer is allocated from the Size1 option
+    prv_init_block(&message, 1, "/5/0/0", 0, 1, BLOCK_16, 16);
+    coap_set_header_size1(&message, 64);
+    CU_ASSERT_EQUAL(prv_handle(&blk1, &message, 0, &resultBuffer, &bsize), COAP_231_CONTINUE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(blk1);
+    CU_ASSERT_EQUAL(blk1->block1bufferCapacity, 64);
+    firstBuffer = blk1->block1buffer;
+
+    for (num = 1; num < 4; num++)
+    {
+        prv_init_block(&message, 1 + num, "/5/0/0", num, num < 3, BLOCK_16, 16);
+        prv_handle(&blk1, &message, 0, &resultBuffer, &bsize);
+    }
+    CU_ASSERT_PTR_EQUAL(resultBuffer, firstBuffer);
+    CU_ASSERT_EQUAL(bsize, 64);
+
+    // Size1 survives serialization
+    prv_init_block(&message, 1, "/5/0/0", 0, 1, BLOCK_16, 16);
+    coap_set_header_size1(&message, 1000);
+    bsize = coap_serialize_message(&message, buffer);
+    CU_ASSERT_FATAL(bsize != 0);
+    CU_ASSERT_EQUAL(coap_parse_message(&message, buffer, (uint16_t)bsize), NO_ERROR);
+    CU_ASSERT_TRUE(coap_get_header_size1(&message, &num));
+    CU_ASSERT_EQUAL(num, 1000);
+    coap_free_header(&message);
+
+    // announced size is too large
+    prv_init_block(&message, 10, "/5/0/0", 0, 1, BLOCK_16, 16);
+    coap_set_header_size1(&message, LWM2M_BLOCK1_MAX_SIZE + 1);
+    CU_ASSERT_EQUAL(prv_handle(&blk1, &message, 0, &resultBuffer, &bsize), COAP_413_ENTITY_TOO_LARGE);
+    CU_ASSERT_PTR_NULL(blk1);
+
+    free_block1_buffer(blk1);
+}
+
+static void test_block1_growth(void)
+{
+    lwm2m_block1_data_t * blk1 = NULL;
+    coap_packet_t message;
+    size_t bsize;
+    uint8_t *resultBuffer;
+    uint32_t num;
+
+    for (num = 0; num < 20; num++)
+    {
+        prv_init_block(&message, 1 + num, "/5/0/0", num, num < 19, BLOCK_16, 16);
+        prv_handle(&blk1, &message, 0, &resultBuffer, &bsize);
+    }
+    CU_ASSERT_PTR_NOT_NULL_FATAL(resultBuffer);
+    CU_ASSERT_EQUAL(bsize, 20 * 16);
+    CU_ASSERT_NSTRING_EQUAL(resultBuffer + 19 * 16, BLOCK_16, 16);
+    // capacity doubles from four blocks
+    CU_ASSERT_EQUAL(blk1->block1bufferCapacity, 32 * 16);
+
+    // out of order block drops the transfer
+    prv_init_block(&message, 100, "/5/0/0", 0, 1, BLOCK_16, 16);
+    prv_handle(&blk1, &message, 0, &resultBuffer, &bsize);
+    prv_init_block(&message, 101, "/5/0/0", 2, 1, BLOCK_16, 16);
+    CU_ASSERT_EQUAL(prv_handle(&blk1, &message, 0, &resultBuffer, &bsize), COAP_408_REQ_ENTITY_INCOMPLETE);
+    CU_ASSERT_PTR_NULL(blk1);
+
+    free_block1_buffer(blk1);
+}
+
+static void test_block1_concurrent(void)
+{
+    lwm2m_block1_data_t * blk1 = NULL;
+    coap_packet_t message;
+    size_t bsize;
+    uint8_t *resultBuffer;
+    time_t timeout;
+
+    prv_init_block(&message, 1, "/5/0/0", 0, 1, BLOCK_16, 16);
+    prv_handle(&blk1, &message, 0, &resultBuffer, &bsize);
+    prv_init_block(&message, 2, "/3/0/1", 0, 1, "fedcba9876543210", 16);
+    prv_handle(&blk1, &message, 10, &resultBuffer, &bsize);
+
+    prv_init_block(&message, 3, "/5/0/0", 1, 0, "67", 2);
+    CU_ASSERT_EQUAL(prv_handle(&blk1, &message, 20, &resultBuffer, &bsize), NO_ERROR);
+    CU_ASSERT_EQUAL(bsize, 18);
+    CU_ASSERT_NSTRING_EQUAL(resultBuffer, BLOCK_16 "67", 18);
+
+    prv_init_block(&message, 4, "/3/0/1", 1, 0, "xy", 2);
+    CU_ASSERT_EQUAL(prv_handle(&blk1, &message, 20, &resultBuffer, &bsize), NO_ERROR);
+    CU_ASSERT_EQUAL(bsize, 18);
+    CU_ASSERT_NSTRING_EQUAL(resultBuffer, "fedcba9876543210xy", 18);
+
+    // an incomplete transfer expires after LWM2M_BLOCK1_TIMEOUT
+    prv_init_block(&message, 5, "/3/0/2", 0, 1, BLOCK_16, 16);
+    prv_handle(&blk1, &message, 20, &resultBuffer, &bsize);
+
+    timeout = 1000;
+    block1_step(&blk1, 20 + (time_t)COAP_MAX_TRANSMIT_SPAN, &timeout);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(blk1);
+    CU_ASSERT_STRING_EQUAL(blk1->uri, "/3/0/2");
+    CU_ASSERT_PTR_NULL(blk1->next);
+    CU_ASSERT_EQUAL(timeout, LWM2M_BLOCK1_TIMEOUT - (time_t)COAP_MAX_TRANSMIT_SPAN);
+
+    block1_step(&blk1, 20 + LWM2M_BLOCK1_TIMEOUT, &timeout);
+    CU_ASSERT_PTR_NULL(blk1);
 
     free_block1_buffer(blk1);
 }
 
+static uint32_t streamedLength;
+
+static uint8_t prv_block_write(uint16_t instanceId,
+                               uint16_t resourceId,
+                               uint32_t offset,
+                               uint8_t * buffer,
+                               size_t length,
+                               bool more,
+                               lwm2m_object_t * objectP)
+{
+    (void)instanceId;
+    (void)resourceId;
+    (void)buffer;
+    (void)more;
+    (void)objectP;
+
+    if (offset != streamedLength) return COAP_408_REQ_ENTITY_INCOMPLETE;
+    streamedLength += length;
+    return COAP_204_CHANGED;
+}
+
+static void test_block1_streamed(void)
+{
+    lwm2m_context_t context;
+    lwm2m_object_t object;
+    lwm2m_uri_t uri;
+
+    memset(&context, 0, sizeof(context));
+    memset(&object, 0, sizeof(object));
+    object.objID = 5;
+    context.objectList = &object;
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/5/0/0", 6, &uri), 6);
+
+    // objects without the callback get the reassembled payload
+    CU_ASSERT_FALSE(object_isBlockWritable(&context, &uri, LWM2M_CONTENT_OPAQUE));
+    object.blockWriteFunc = prv_block_write;
+    CU_ASSERT_TRUE(object_isBlockWritable(&context, &uri, LWM2M_CONTENT_OPAQUE));
+    CU_ASSERT_FALSE(object_isBlockWritable(&context, &uri, LWM2M_CONTENT_TLV));
+
+    streamedLength = 0;
+    CU_ASSERT_EQUAL(object_writeBlock(&context, &uri, 0, (uint8_t *)BLOCK_16, 16, true), COAP_231_CONTINUE);
+    CU_ASSERT_EQUAL(object_writeBlock(&context, &uri, 32, (uint8_t *)BLOCK_16, 16, true), COAP_408_REQ_ENTITY_INCOMPLETE);
+    CU_ASSERT_EQUAL(object_writeBlock(&context, &uri, 16, (uint8_t *)"67", 2, false), COAP_204_CHANGED);
+    CU_ASSERT_EQUAL(streamedLength, 18);
+
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/5/0", 4, &uri), 4);
+    CU_ASSERT_FALSE(object_isBlockWritable(&context, &uri, LWM2M_CONTENT_OPAQUE));
+}
+
 static struct TestTable table[] = {
         { "test of test_block1_nominal()", test_block1_nominal },
         { "test of test_block1_retransmit()", test_block1_retransmit },
+        { "test of test_block1_size1()", test_block1_size1 },
+        { "test of test_block1_growth()", test_block1_growth },
+        { "test of test_block1_concurrent()", test_block1_concurrent },
+        { "test of test_block1_streamed()", test_block1_streamed },
         { NULL, NULL },
 };
 
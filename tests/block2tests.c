@@ -0,0 +1,150 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+#include "tests.h"
+#include "CUnit/Basic.h"
+#include "internals.h"
+#include "liblwm2m.h"
+
+#include <string.h>
+
+static void prv_init_read(coap_packet_t * message,
+                          const char * uri,
+                          int32_t accept)
+{
+    coap_init_message(message, COAP_TYPE_CON, COAP_GET, 1);
+    coap_set_header_uri_path(message, uri);
+    if (accept >= 0)
+    {
+        coap_set_header_accept(message, (uint16_t)accept);
+    }
+}
+
+static void prv_store(lwm2m_block2_data_t ** cache,
+                      const char * uri,
+                      int32_t accept,
+                      const char * payload,
+                      time_t now)
+{
+    coap_packet_t message;
+    coap_packet_t response;
+    uint8_t * buffer;
+
+    buffer = (uint8_t *)lwm2m_malloc(strlen(payload));
+    memcpy(buffer, payload, strlen(payload));
+    prv_init_read(&message, uri, accept);
+    coap_init_message(&response, COAP_TYPE_ACK, COAP_205_CONTENT, 1);
+    coap_set_header_content_type(&response, LWM2M_CONTENT_TEXT);
+    coap_set_header_etag(&response, (const uint8_t *)payload, 2);
+    block2_store(cache, &message, &response, buffer, strlen(payload), now);
+    coap_free_header(&message);
+}
+
+static lwm2m_block2_data_t * prv_find(lwm2m_block2_data_t * cache,
+                                      const char * uri,
+                                      int32_t accept,
+                                      time_t now)
+{
+    coap_packet_t message;
+    lwm2m_block2_data_t * result;
+
+    prv_init_read(&message, uri, accept);
+    result = block2_find(cache, &message, now);
+    coap_free_header(&message);
+
+    return result;
+}
+
+static void test_block2_cache(void)
+{
+    lwm2m_block2_data_t * cache = NULL;
+    lwm2m_block2_data_t * entryP;
+
+    prv_store(&cache, "/3/0", -1, "first", 0);
+    prv_store(&cache, "/3/0", LWM2M_CONTENT_JSON, "json", 0);
+
+    entryP = prv_find(cache, "/3/0", -1, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(entryP);
+    CU_ASSERT_EQUAL(entryP->length, 5);
+    CU_ASSERT_NSTRING_EQUAL(entryP->buffer, "first", 5);
+    CU_ASSERT_EQUAL(entryP->contentType, LWM2M_CONTENT_TEXT);
+    CU_ASSERT_EQUAL(entryP->etagLen, 2);
+    CU_ASSERT_NSTRING_EQUAL(entryP->etag, "fi", 2);
+
+    entryP = prv_find(cache, "/3/0", LWM2M_CONTENT_JSON, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(entryP);
+    CU_ASSERT_NSTRING_EQUAL(entryP->buffer, "json", 4);
+
+    CU_ASSERT_PTR_NULL(prv_find(cache, "/3", -1, 1));
+    CU_ASSERT_PTR_NULL(prv_find(cache, "/3/0/1", -1, 1));
+
+    // a new read replaces the cached response
+    prv_store(&cache, "/3/0", -1, "second", 2);
+    entryP = prv_find(cache, "/3/0", -1, 2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(entryP);
+    CU_ASSERT_NSTRING_EQUAL(entryP->buffer, "second", 6);
+    CU_ASSERT_PTR_NOT_NULL(cache->next);
+    CU_ASSERT_PTR_NULL(cache->next->next);
+
+    block2_free(cache);
+}
+
+static void test_block2_expiry(void)
+{
+    lwm2m_block2_data_t * cache = NULL;
+    time_t timeout;
+    int i;
+
+    for (i = 0; i < LWM2M_BLOCK2_MAX_RESPONSES; i++)
+    {
+        char uri[8];
+
+        snprintf(uri, sizeof(uri), "/3/%d", i);
+        prv_store(&cache, uri, -1, "payload", i);
+    }
+    // the least recently used response is dropped
+    CU_ASSERT_PTR_NOT_NULL(prv_find(cache, "/3/0", -1, 10));
+    prv_store(&cache, "/4/0", -1, "payload", 11);
+    CU_ASSERT_PTR_NOT_NULL(prv_find(cache, "/3/0", -1, 11));
+    CU_ASSERT_PTR_NULL(prv_find(cache, "/3/1", -1, 11));
+    CU_ASSERT_PTR_NOT_NULL(prv_find(cache, "/4/0", -1, 11));
+
+    timeout = 1000;
+    block2_step(&cache, LWM2M_BLOCK2_TIMEOUT + 5, &timeout);
+    CU_ASSERT_PTR_NOT_NULL(prv_find(cache, "/3/0", -1, LWM2M_BLOCK2_TIMEOUT + 5));
+    CU_ASSERT_PTR_NULL(prv_find(cache, "/3/2", -1, LWM2M_BLOCK2_TIMEOUT + 5));
+    CU_ASSERT_EQUAL(timeout, 6);
+
+    block2_step(&cache, 2 * LWM2M_BLOCK2_TIMEOUT + 5, &timeout);
+    CU_ASSERT_PTR_NULL(cache);
+}
+
+static struct TestTable table[] = {
+        { "test of block2_find() and block2_store()", test_block2_cache },
+        { "test of block2_step()", test_block2_expiry },
+        { NULL, NULL },
+};
+
+CU_ErrorCode create_block2_suit() {
+    CU_pSuite pSuite = NULL;
+    pSuite = CU_add_suite("Suite_block2", NULL, NULL);
+
+    if (NULL == pSuite) {
+        return CU_get_error();
+    }
+    return add_tests(pSuite, table);
+}
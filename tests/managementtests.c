@@ -0,0 +1,1029 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+#include <sys/time.h>
+#include "tests.h"
+#include "CUnit/Basic.h"
+#include "internals.h"
+#include "liblwm2m.h"
+#include "connection.h"
+
+static int callbackCount;
+static int lastStatus;
+static uint8_t lastData[256];
+static int lastDataLength;
+static size_t lastAcknowledged;
+
+static void prv_resultCallback(uint16_t clientID,
+                               lwm2m_uri_t * uriP,
+                               int status,
+                               lwm2m_media_type_t format,
+                               uint8_t * data,
+                               int dataLength,
+                               void * userData)
+{
+    (void)clientID;
+    (void)uriP;
+    (void)format;
+    (void)userData;
+
+    callbackCount++;
+    lastStatus = status;
+    lastDataLength = dataLength;
+    if (data != NULL && dataLength <= (int)sizeof(lastData))
+    {
+        memcpy(lastData, data, dataLength);
+    }
+}
+
+static void prv_progressCallback(uint16_t clientID,
+                                 lwm2m_uri_t * uriP,
+                                 size_t acknowledged,
+                                 size_t total,
+                                 void * userData)
+{
+    (void)clientID;
+    (void)uriP;
+    (void)total;
+    (void)userData;
+
+    lastAcknowledged = acknowledged;
+}
+
+// a connection sending to its own socket, so that requests can be read back
+static connection_t * prv_loopback(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    struct timeval timeout = { 1, 0 };
+    int sock;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) return NULL;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (0 != bind(sock, (struct sockaddr *)&addr, sizeof(addr))
+     || 0 != getsockname(sock, (struct sockaddr *)&addr, &addrLen)
+     || 0 != setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+    {
+        close(sock);
+        return NULL;
+    }
+
+    return connection_new_incoming(NULL, sock, (struct sockaddr *)&addr, addrLen);
+}
+
+static lwm2m_client_t * prv_register(lwm2m_context_t * contextP,
+                             connection_t * connP)
+{
+    coap_packet_t message[1];
+    coap_packet_t response[1];
+    lwm2m_uri_t uri;
+
+    coap_init_message(message, COAP_TYPE_CON, COAP_POST, 1);
+    coap_set_header_uri_query(message, "ep=blockwise&lwm2m=1.0&lt=300");
+    coap_set_header_content_type(message, LWM2M_CONTENT_LINK);
+    coap_set_payload(message, "</1/0>,</3/0>", 13);
+    coap_init_message(response, COAP_TYPE_ACK, 0, 1);
+
+    memset(&uri, 0, sizeof(uri));
+    uri.flag = LWM2M_URI_FLAG_REGISTRATION;
+
+    CU_ASSERT_EQUAL(registration_handleRequest(contextP, &uri, connP, message, response), COAP_201_CREATED);
+    coap_free_header(message);
+    coap_free_header(response);
+
+    return lwm2m_get_client_by_name(contextP, "blockwise");
+}
+
+// reads the next request sent by the server
+static bool prv_receive(connection_t * connP,
+                        coap_packet_t * request)
+{
+    uint8_t buffer[LWM2M_MAX_PACKET_SIZE];
+    ssize_t length;
+
+    length = recv(connP->sock, buffer, sizeof(buffer), 0);
+    if (length <= 0) return false;
+    if (NO_ERROR != coap_parse_message(request, buffer, (uint16_t)length)) return false;
+    coap_free_header(request);
+
+    return true;
+}
+
+// answers the request with the block of the payload it asks for
+static void prv_answer(lwm2m_context_t * contextP,
+                       connection_t * connP,
+                       coap_packet_t * request,
+                       uint8_t * payload,
+                       size_t length,
+                       uint16_t blockSize)
+{
+    coap_packet_t response[1];
+    uint8_t buffer[LWM2M_MAX_PACKET_SIZE];
+    uint32_t num = 0;
+    size_t offset;
+    size_t len;
+
+    coap_get_header_block2(request, &num, NULL, NULL, NULL);
+    offset = num * blockSize;
+    len = MIN(blockSize, length - offset);
+
+    coap_init_message(response, COAP_TYPE_ACK, COAP_205_CONTENT, request->mid);
+    coap_set_header_token(response, request->token, request->token_len);
+    coap_set_header_content_type(response, LWM2M_CONTENT_TLV);
+    coap_set_header_block2(response, num, offset + len < length, blockSize);
+    if (num == 0) coap_set_header_size(response, length);
+    coap_set_payload(response, payload + offset, len);
+
+    len = coap_serialize_message(response, buffer);
+    CU_ASSERT_TRUE_FATAL(len > 0);
+    lwm2m_handle_packet(contextP, buffer, (int)len, connP);
+}
+
+static void test_dm_read_block2(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    connection_t * connP = prv_loopback();
+    coap_packet_t requests[2];
+    uint8_t payload[40];
+    lwm2m_uri_t uri;
+    lwm2m_client_t * clientP;
+    uint16_t clientID;
+    int i;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(connP);
+    for (i = 0 ; i < (int)sizeof(payload) ; i++) payload[i] = (uint8_t)i;
+    callbackCount = 0;
+
+    clientP = prv_register(contextP, connP);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(clientP);
+    clientID = clientP->internalID;
+
+    memset(&uri, 0, sizeof(uri));
+    uri.flag = LWM2M_URI_FLAG_OBJECT_ID;
+    uri.objectId = 3;
+    CU_ASSERT_EQUAL(lwm2m_dm_read(contextP, clientID, &uri, prv_resultCallback, NULL), 0);
+
+    // first block, announcing the total size
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, &requests[0]));
+    CU_ASSERT_FALSE(IS_OPTION(&requests[0], COAP_OPTION_BLOCK2));
+    prv_answer(contextP, connP, &requests[0], payload, sizeof(payload), 16);
+    CU_ASSERT_EQUAL(callbackCount, 0);
+    CU_ASSERT_EQUAL(clientP->block2Count, 1);
+
+    // the two remaining blocks are requested together
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, &requests[0]));
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, &requests[1]));
+    CU_ASSERT_EQUAL(requests[0].block2_num, 1);
+    CU_ASSERT_EQUAL(requests[1].block2_num, 2);
+
+    // answered out of order
+    prv_answer(contextP, connP, &requests[1], payload, sizeof(payload), 16);
+    CU_ASSERT_EQUAL(callbackCount, 0);
+    prv_answer(contextP, connP, &requests[0], payload, sizeof(payload), 16);
+    CU_ASSERT_EQUAL(callbackCount, 1);
+    CU_ASSERT_EQUAL(lastStatus, COAP_205_CONTENT);
+    CU_ASSERT_EQUAL(lastDataLength, sizeof(payload));
+    CU_ASSERT_EQUAL(memcmp(lastData, payload, sizeof(payload)), 0);
+    CU_ASSERT_EQUAL(clientP->block2Count, 0);
+    CU_ASSERT_PTR_NULL(contextP->transactionList);
+
+    lwm2m_close(contextP);
+    close(connP->sock);
+    connection_free(connP);
+}
+
+static void test_dm_read_block2_limit(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    connection_t * connP = prv_loopback();
+    coap_packet_t request[1];
+    uint8_t payload[40];
+    lwm2m_uri_t uri;
+    lwm2m_client_t * clientP;
+    uint16_t clientID;
+    int i;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(connP);
+    memset(payload, 0, sizeof(payload));
+    callbackCount = 0;
+
+    clientP = prv_register(contextP, connP);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(clientP);
+    clientID = clientP->internalID;
+
+    memset(&uri, 0, sizeof(uri));
+    uri.flag = LWM2M_URI_FLAG_OBJECT_ID;
+    uri.objectId = 3;
+    for (i = 0 ; i <= LWM2M_CLIENT_MAX_BLOCK2 ; i++)
+    {
+        CU_ASSERT_EQUAL(lwm2m_dm_read(contextP, clientID, &uri, prv_resultCallback, NULL), 0);
+        // skips the block requests of the previous reads
+        do
+        {
+            CU_ASSERT_TRUE_FATAL(prv_receive(connP, request));
+        } while (IS_OPTION(request, COAP_OPTION_BLOCK2) && request->block2_num != 0);
+        prv_answer(contextP, connP, request, payload, sizeof(payload), 16);
+    }
+
+    // the reassembly over the limit is refused
+    CU_ASSERT_EQUAL(callbackCount, 1);
+    CU_ASSERT_EQUAL(lastStatus, COAP_503_SERVICE_UNAVAILABLE);
+    CU_ASSERT_EQUAL(clientP->block2Count, LWM2M_CLIENT_MAX_BLOCK2);
+
+    lwm2m_close(contextP);
+    close(connP->sock);
+    connection_free(connP);
+}
+
+// acknowledges a block of a Block1 request with the given code and block size
+static void prv_acknowledge(lwm2m_context_t * contextP,
+                            connection_t * connP,
+                            coap_packet_t * request,
+                            uint8_t code,
+                            uint16_t blockSize)
+{
+    coap_packet_t response[1];
+    uint8_t buffer[LWM2M_MAX_PACKET_SIZE];
+    size_t len;
+
+    coap_init_message(response, COAP_TYPE_ACK, code, request->mid);
+    coap_set_header_token(response, request->token, request->token_len);
+    if (code == COAP_231_CONTINUE)
+    {
+        coap_set_header_block1(response, request->block1_num, 1, blockSize);
+    }
+
+    len = coap_serialize_message(response, buffer);
+    CU_ASSERT_TRUE_FATAL(len > 0);
+    lwm2m_handle_packet(contextP, buffer, (int)len, connP);
+}
+
+static void test_dm_write_block1(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    connection_t * connP = prv_loopback();
+    coap_packet_t request[1];
+    uint8_t payload[80];
+    lwm2m_uri_t uri;
+    lwm2m_client_t * clientP;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(connP);
+    memset(payload, 0xAA, sizeof(payload));
+    callbackCount = 0;
+    lastAcknowledged = 0;
+    CU_ASSERT_EQUAL(lwm2m_set_block_size(contextP, 32), COAP_NO_ERROR);
+    lwm2m_set_progress_callback(contextP, prv_progressCallback, NULL);
+
+    clientP = prv_register(contextP, connP);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(clientP);
+
+    memset(&uri, 0, sizeof(uri));
+    uri.flag = LWM2M_URI_FLAG_OBJECT_ID | LWM2M_URI_FLAG_INSTANCE_ID | LWM2M_URI_FLAG_RESOURCE_ID;
+    uri.objectId = 5;
+    uri.instanceId = 0;
+    uri.resourceId = 0;
+    CU_ASSERT_EQUAL(lwm2m_dm_write(contextP, clientP->internalID, &uri, LWM2M_CONTENT_OPAQUE, payload, sizeof(payload), prv_resultCallback, NULL), 0);
+
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, request));
+    CU_ASSERT_TRUE(IS_OPTION(request, COAP_OPTION_BLOCK1));
+    CU_ASSERT_EQUAL(request->block1_num, 0);
+    CU_ASSERT_EQUAL(request->block1_more, 1);
+    CU_ASSERT_EQUAL(request->payload_len, 32);
+
+    // the client asks for smaller blocks
+    prv_acknowledge(contextP, connP, request, COAP_231_CONTINUE, 16);
+    CU_ASSERT_EQUAL(clientP->blockSize, 16);
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, request));
+    CU_ASSERT_EQUAL(request->block1_num, 2);
+    CU_ASSERT_EQUAL(request->block1_size, 16);
+    CU_ASSERT_EQUAL(request->payload_len, 16);
+
+    while (request->block1_more)
+    {
+        prv_acknowledge(contextP, connP, request, COAP_231_CONTINUE, 16);
+        CU_ASSERT_EQUAL(callbackCount, 0);
+        CU_ASSERT_TRUE_FATAL(prv_receive(connP, request));
+    }
+    CU_ASSERT_EQUAL(request->block1_num, 4);
+
+    prv_acknowledge(contextP, connP, request, COAP_204_CHANGED, 0);
+    CU_ASSERT_EQUAL(callbackCount, 1);
+    CU_ASSERT_EQUAL(lastStatus, COAP_204_CHANGED);
+    CU_ASSERT_EQUAL(lastAcknowledged, sizeof(payload));
+    CU_ASSERT_PTR_NULL(contextP->transactionList);
+
+    lwm2m_close(contextP);
+    close(connP->sock);
+    connection_free(connP);
+}
+
+// answers a read with the given code and ETag (NULL for none)
+static void prv_answerETag(lwm2m_context_t * contextP,
+                           connection_t * connP,
+                           coap_packet_t * request,
+                           uint8_t code,
+                           const char * etag)
+{
+    coap_packet_t response[1];
+    uint8_t buffer[LWM2M_MAX_PACKET_SIZE];
+    size_t len;
+
+    coap_init_message(response, COAP_TYPE_ACK, code, request->mid);
+    coap_set_header_token(response, request->token, request->token_len);
+    if (etag != NULL) coap_set_header_etag(response, (const uint8_t *)etag, strlen(etag));
+    if (code == COAP_205_CONTENT)
+    {
+        coap_set_header_content_type(response, LWM2M_CONTENT_TEXT);
+        coap_set_payload(response, "42", 2);
+    }
+
+    len = coap_serialize_message(response, buffer);
+    CU_ASSERT_TRUE_FATAL(len > 0);
+    lwm2m_handle_packet(contextP, buffer, (int)len, connP);
+}
+
+static void test_dm_read_if_changed(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    connection_t * connP = prv_loopback();
+    coap_packet_t request;
+    lwm2m_uri_t uri;
+    lwm2m_client_t * clientP;
+    uint16_t clientID;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(connP);
+    callbackCount = 0;
+
+    clientP = prv_register(contextP, connP);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(clientP);
+    clientID = clientP->internalID;
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/3/0/13", 7, &uri), 7);
+
+    // nothing to present yet
+    CU_ASSERT_EQUAL(lwm2m_dm_read_if_changed(contextP, clientID, &uri, prv_resultCallback, NULL), 0);
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, &request));
+    CU_ASSERT_FALSE(IS_OPTION(&request, COAP_OPTION_ETAG));
+    prv_answerETag(contextP, connP, &request, COAP_205_CONTENT, "v1");
+    CU_ASSERT_EQUAL(callbackCount, 1);
+    CU_ASSERT_EQUAL(lastStatus, COAP_205_CONTENT);
+
+    // the ETag of the last read is presented
+    CU_ASSERT_EQUAL(lwm2m_dm_read_if_changed(contextP, clientID, &uri, prv_resultCallback, NULL), 0);
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, &request));
+    CU_ASSERT_TRUE(IS_OPTION(&request, COAP_OPTION_ETAG));
+    CU_ASSERT_EQUAL(request.etag_len, 2);
+    CU_ASSERT_NSTRING_EQUAL(request.etag, "v1", 2);
+    prv_answerETag(contextP, connP, &request, COAP_203_VALID, "v1");
+    CU_ASSERT_EQUAL(callbackCount, 2);
+    CU_ASSERT_EQUAL(lastStatus, COAP_203_VALID);
+    CU_ASSERT_EQUAL(lastDataLength, 0);
+
+    // plain reads do not present it
+    CU_ASSERT_EQUAL(lwm2m_dm_read(contextP, clientID, &uri, prv_resultCallback, NULL), 0);
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, &request));
+    CU_ASSERT_FALSE(IS_OPTION(&request, COAP_OPTION_ETAG));
+    // a response without ETag forgets it
+    prv_answerETag(contextP, connP, &request, COAP_205_CONTENT, NULL);
+    CU_ASSERT_PTR_NULL(clientP->etagList);
+
+    lwm2m_close(contextP);
+    close(connP->sock);
+    connection_free(connP);
+}
+
+static uint8_t prv_readCounter(uint16_t instanceId,
+                               int * numDataP,
+                               lwm2m_data_t ** dataArrayP,
+                               lwm2m_object_t * objectP)
+{
+    (void)instanceId;
+    (void)objectP;
+
+    if (*numDataP == 0)
+    {
+        *dataArrayP = lwm2m_data_new(1);
+        if (*dataArrayP == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+        *numDataP = 1;
+        (*dataArrayP)->id = 0;
+    }
+    callbackCount++;
+    lwm2m_data_encode_int(callbackCount, *dataArrayP);
+
+    return COAP_205_CONTENT;
+}
+
+// reads /1024/0/0 from the client side, presenting etag if not NULL
+static uint8_t prv_clientRead(lwm2m_context_t * contextP,
+                              lwm2m_server_t * serverP,
+                              const uint8_t * etag,
+                              coap_packet_t * response)
+{
+    coap_packet_t message[1];
+    lwm2m_uri_t uri;
+    uint8_t result;
+
+    coap_init_message(message, COAP_TYPE_CON, COAP_GET, 1);
+    coap_set_header_uri_path(message, "/1024/0/0");
+    if (etag != NULL) coap_set_header_etag(message, etag, response->etag_len);
+    coap_init_message(response, COAP_TYPE_ACK, COAP_205_CONTENT, 1);
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/1024/0/0", 9, &uri), 9);
+
+    result = dm_handleRequest(contextP, &uri, serverP, message, response);
+    coap_free_header(message);
+    lwm2m_free(response->payload);
+
+    return result;
+}
+
+static void test_dm_etag(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    lwm2m_object_t object;
+    lwm2m_list_t instance;
+    lwm2m_server_t server;
+    coap_packet_t response[1];
+    uint8_t etag[COAP_ETAG_LEN];
+    lwm2m_uri_t uri;
+
+    memset(&object, 0, sizeof(object));
+    memset(&instance, 0, sizeof(instance));
+    memset(&server, 0, sizeof(server));
+    object.objID = 1024;
+    object.instanceList = &instance;
+    object.readFunc = prv_readCounter;
+    object.reportsChanges = true;
+    CU_ASSERT_EQUAL(lwm2m_add_object(contextP, &object), 0);
+    server.status = STATE_REGISTERED;
+    callbackCount = 0;
+
+    CU_ASSERT_EQUAL(prv_clientRead(contextP, &server, NULL, response), COAP_205_CONTENT);
+    CU_ASSERT_TRUE_FATAL(IS_OPTION(response, COAP_OPTION_ETAG));
+    memcpy(etag, response->etag, response->etag_len);
+    CU_ASSERT_EQUAL(callbackCount, 1);
+
+    // unchanged: the object is not read again
+    CU_ASSERT_EQUAL(prv_clientRead(contextP, &server, etag, response), COAP_203_VALID);
+    CU_ASSERT_EQUAL(response->etag_len, LWM2M_ETAG_LEN);
+    CU_ASSERT_EQUAL(memcmp(response->etag, etag, LWM2M_ETAG_LEN), 0);
+    CU_ASSERT_EQUAL(callbackCount, 1);
+
+    // changed
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/1024/0/0", 9, &uri), 9);
+    lwm2m_resource_value_changed(contextP, &uri);
+    CU_ASSERT_EQUAL(prv_clientRead(contextP, &server, etag, response), COAP_205_CONTENT);
+    CU_ASSERT_NOT_EQUAL(memcmp(response->etag, etag, LWM2M_ETAG_LEN), 0);
+    CU_ASSERT_EQUAL(callbackCount, 2);
+
+    // objects not reporting their changes are always read and get no ETag
+    memcpy(etag, response->etag, response->etag_len);
+    object.reportsChanges = false;
+    CU_ASSERT_EQUAL(prv_clientRead(contextP, &server, etag, response), COAP_205_CONTENT);
+    CU_ASSERT_FALSE(IS_OPTION(response, COAP_OPTION_ETAG));
+    CU_ASSERT_EQUAL(callbackCount, 3);
+
+    contextP->objectList = NULL;
+    lwm2m_close(contextP);
+}
+
+static uint8_t prv_executeCounter(uint16_t instanceId,
+                                  uint16_t resourceId,
+                                  uint8_t * buffer,
+                                  int length,
+                                  lwm2m_object_t * objectP)
+{
+    (void)instanceId;
+    (void)resourceId;
+    (void)buffer;
+    (void)length;
+    (void)objectP;
+
+    callbackCount++;
+
+    return COAP_204_CHANGED;
+}
+
+static void test_dm_duplicate(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    connection_t * connP = prv_loopback();
+    lwm2m_object_t object;
+    lwm2m_list_t instance;
+    lwm2m_server_t server;
+    coap_packet_t message[1];
+    uint8_t request[64];
+    uint8_t first[64];
+    uint8_t second[64];
+    size_t requestLen;
+    ssize_t firstLen;
+    ssize_t secondLen;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(connP);
+    memset(&object, 0, sizeof(object));
+    memset(&instance, 0, sizeof(instance));
+    memset(&server, 0, sizeof(server));
+    object.objID = 1024;
+    object.instanceList = &instance;
+    object.executeFunc = prv_executeCounter;
+    CU_ASSERT_EQUAL(lwm2m_add_object(contextP, &object), 0);
+    server.status = STATE_REGISTERED;
+    server.sessionH = connP;
+    contextP->serverList = &server;
+    callbackCount = 0;
+
+    coap_init_message(message, COAP_TYPE_CON, COAP_POST, 0x1234);
+    coap_set_header_token(message, (const uint8_t *)"tk", 2);
+    coap_set_header_uri_path(message, "/1024/0/1");
+    requestLen = coap_serialize_message(message, request);
+    coap_free_header(message);
+    CU_ASSERT_TRUE_FATAL(requestLen > 0);
+
+    lwm2m_handle_packet(contextP, request, (int)requestLen, connP);
+    firstLen = recv(connP->sock, first, sizeof(first), 0);
+    CU_ASSERT_TRUE_FATAL(firstLen > 0);
+    CU_ASSERT_EQUAL(callbackCount, 1);
+    CU_ASSERT_PTR_NOT_NULL(server.dedupData);
+
+    // the ACK was lost: the retransmission is answered without executing again
+    lwm2m_handle_packet(contextP, request, (int)requestLen, connP);
+    secondLen = recv(connP->sock, second, sizeof(second), 0);
+    CU_ASSERT_EQUAL_FATAL(secondLen, firstLen);
+    CU_ASSERT_EQUAL(memcmp(first, second, firstLen), 0);
+    CU_ASSERT_EQUAL(callbackCount, 1);
+
+    // a new message ID is a new request
+    request[2]++;
+    lwm2m_handle_packet(contextP, request, (int)requestLen, connP);
+    CU_ASSERT_TRUE(recv(connP->sock, second, sizeof(second), 0) > 0);
+    CU_ASSERT_EQUAL(callbackCount, 2);
+
+    // entries expire after EXCHANGE_LIFETIME
+    CU_ASSERT_PTR_NOT_NULL(dedup_find(server.dedupData, 0x1234, utils_getTime()));
+    CU_ASSERT_PTR_NULL(dedup_find(server.dedupData, 0x1234, utils_getTime() + (time_t)COAP_EXCHANGE_LIFETIME));
+
+    dedup_free(server.dedupData);
+    contextP->serverList = NULL;
+    contextP->objectList = NULL;
+    lwm2m_close(contextP);
+    close(connP->sock);
+    connection_free(connP);
+}
+
+// sends an Observe request for uri from the server on connP and reads back the response
+static void prv_observe(lwm2m_context_t * contextP,
+                        connection_t * connP,
+                        const char * uri,
+                        uint16_t mid,
+                        lwm2m_media_type_t accept)
+{
+    coap_packet_t message[1];
+    uint8_t buffer[64];
+    size_t length;
+
+    coap_init_message(message, COAP_TYPE_CON, COAP_GET, mid);
+    coap_set_header_token(message, (const uint8_t *)&mid, sizeof(mid));
+    coap_set_header_uri_path(message, uri);
+    coap_set_header_observe(message, 0);
+    if (accept != LWM2M_CONTENT_TLV) coap_set_header_accept(message, accept);
+    length = coap_serialize_message(message, buffer);
+    coap_free_header(message);
+    CU_ASSERT_TRUE_FATAL(length > 0);
+    lwm2m_handle_packet(contextP, buffer, (int)length, connP);
+    CU_ASSERT_TRUE_FATAL(recv(connP->sock, buffer, sizeof(buffer), 0) > 0);
+}
+
+static void test_observe_step(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    connection_t * connP = prv_loopback();
+    lwm2m_object_t object;
+    lwm2m_list_t instance;
+    lwm2m_server_t server;
+    lwm2m_attributes_t attr;
+    lwm2m_uri_t uri;
+    uint8_t buffer[64];
+    time_t now;
+    time_t timeout;
+    int count;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(connP);
+    memset(&object, 0, sizeof(object));
+    memset(&instance, 0, sizeof(instance));
+    memset(&server, 0, sizeof(server));
+    object.objID = 1024;
+    object.instanceList = &instance;
+    object.readFunc = prv_readCounter;
+    CU_ASSERT_EQUAL(lwm2m_add_object(contextP, &object), 0);
+    server.status = STATE_REGISTERED;
+    server.sessionH = connP;
+    contextP->serverList = &server;
+    callbackCount = 0;
+
+    prv_observe(contextP, connP, "/1024/0/0", 0x4321, LWM2M_CONTENT_TLV);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(contextP->observedList);
+    count = callbackCount;
+
+    // nothing changed: the resource is not read
+    now = utils_getTime();
+    timeout = 60;
+    observe_step(contextP, now, &timeout);
+    observe_step(contextP, now + 1, &timeout);
+    CU_ASSERT_EQUAL(callbackCount, count);
+    CU_ASSERT_EQUAL(timeout, 60);
+
+    // a change is notified once
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/1024/0/0", 9, &uri), 9);
+    lwm2m_resource_value_changed(contextP, &uri);
+    observe_step(contextP, now + 2, &timeout);
+    CU_ASSERT_EQUAL(callbackCount, count + 1);
+    CU_ASSERT_TRUE(recv(connP->sock, buffer, sizeof(buffer), 0) > 0);
+    observe_step(contextP, now + 3, &timeout);
+    CU_ASSERT_EQUAL(callbackCount, count + 1);
+
+    // the maximal period wakes the step up
+    memset(&attr, 0, sizeof(attr));
+    attr.toSet = LWM2M_ATTR_FLAG_MAX_PERIOD;
+    attr.maxPeriod = 10;
+    CU_ASSERT_EQUAL(observe_setParameters(contextP, &uri, &server, &attr), COAP_204_CHANGED);
+    count = callbackCount;
+    observe_step(contextP, now + 4, &timeout);
+    CU_ASSERT_EQUAL(callbackCount, count);
+    CU_ASSERT_EQUAL(timeout, 8);
+    observe_step(contextP, now + 12, &timeout);
+    CU_ASSERT_EQUAL(callbackCount, count + 1);
+    CU_ASSERT_TRUE(recv(connP->sock, buffer, sizeof(buffer), 0) > 0);
+
+    dedup_free(server.dedupData);
+    contextP->serverList = NULL;
+    contextP->objectList = NULL;
+    lwm2m_close(contextP);
+    close(connP->sock);
+    connection_free(connP);
+}
+
+// returns true if the watchers of the observation of uri were tagged, and untags them
+static bool prv_isTagged(lwm2m_context_t * contextP,
+                         const char * uri)
+{
+    lwm2m_uri_t uriObserved;
+    lwm2m_observed_t * observedP = NULL;
+    bool tagged;
+
+    // the FATAL assertions cannot be used in a function returning a value
+    if (lwm2m_stringToUri(uri, strlen(uri), &uriObserved) > 0)
+    {
+        observedP = observe_findByUri(contextP, &uriObserved);
+    }
+    CU_ASSERT_PTR_NOT_NULL(observedP);
+    if (observedP == NULL) return false;
+    tagged = observedP->watcherList->update;
+    observedP->watcherList->update = false;
+
+    return tagged;
+}
+
+static void test_observe_index(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    connection_t * connP = prv_loopback();
+    lwm2m_object_t object;
+    lwm2m_list_t instances[2];
+    lwm2m_server_t server;
+    lwm2m_uri_t uri;
+    int i;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(connP);
+    memset(&object, 0, sizeof(object));
+    memset(instances, 0, sizeof(instances));
+    memset(&server, 0, sizeof(server));
+    instances[0].next = &instances[1];
+    instances[1].id = 1;
+    object.objID = 1024;
+    object.instanceList = instances;
+    object.readFunc = prv_readCounter;
+    CU_ASSERT_EQUAL(lwm2m_add_object(contextP, &object), 0);
+    server.status = STATE_REGISTERED;
+    server.sessionH = connP;
+    contextP->serverList = &server;
+
+    prv_observe(contextP, connP, "/1024", 1, LWM2M_CONTENT_TLV);
+    prv_observe(contextP, connP, "/1024/0", 2, LWM2M_CONTENT_TLV);
+    prv_observe(contextP, connP, "/1024/0/0", 3, LWM2M_CONTENT_TLV);
+    prv_observe(contextP, connP, "/1024/1/0", 4, LWM2M_CONTENT_TLV);
+
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/1024/0/0", 9, &uri), 9);
+    lwm2m_resource_value_changed(contextP, &uri);
+    CU_ASSERT_TRUE(prv_isTagged(contextP, "/1024"));
+    CU_ASSERT_TRUE(prv_isTagged(contextP, "/1024/0"));
+    CU_ASSERT_TRUE(prv_isTagged(contextP, "/1024/0/0"));
+    CU_ASSERT_FALSE(prv_isTagged(contextP, "/1024/1/0"));
+
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/1024/1", 7, &uri), 7);
+    lwm2m_resource_value_changed(contextP, &uri);
+    CU_ASSERT_TRUE(prv_isTagged(contextP, "/1024"));
+    CU_ASSERT_FALSE(prv_isTagged(contextP, "/1024/0"));
+    CU_ASSERT_FALSE(prv_isTagged(contextP, "/1024/0/0"));
+    CU_ASSERT_TRUE(prv_isTagged(contextP, "/1024/1/0"));
+
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/1024", 5, &uri), 5);
+    lwm2m_resource_value_changed(contextP, &uri);
+    CU_ASSERT_TRUE(prv_isTagged(contextP, "/1024"));
+    CU_ASSERT_TRUE(prv_isTagged(contextP, "/1024/0"));
+    CU_ASSERT_TRUE(prv_isTagged(contextP, "/1024/0/0"));
+    CU_ASSERT_TRUE(prv_isTagged(contextP, "/1024/1/0"));
+
+    // cancelled observations leave the index
+    observe_clear(contextP, &uri);
+    CU_ASSERT_PTR_NULL(contextP->observedList);
+    CU_ASSERT_PTR_NULL(observe_findByUri(contextP, &uri));
+    for (i = 0; i < LWM2M_OBSERVED_TABLE_SIZE; i++)
+    {
+        CU_ASSERT_PTR_NULL(contextP->observedTable[i]);
+    }
+
+    dedup_free(server.dedupData);
+    contextP->serverList = NULL;
+    contextP->objectList = NULL;
+    lwm2m_close(contextP);
+    close(connP->sock);
+    connection_free(connP);
+}
+
+static void test_observe_formats(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    connection_t * connP[2];
+    lwm2m_object_t object;
+    lwm2m_list_t instance;
+    lwm2m_server_t server[2];
+    coap_packet_t notification[1];
+    lwm2m_uri_t uri;
+    time_t timeout;
+    int count;
+    int i;
+
+    memset(&object, 0, sizeof(object));
+    memset(&instance, 0, sizeof(instance));
+    memset(server, 0, sizeof(server));
+    object.objID = 1024;
+    object.instanceList = &instance;
+    object.readFunc = prv_readCounter;
+    CU_ASSERT_EQUAL(lwm2m_add_object(contextP, &object), 0);
+    for (i = 0; i < 2; i++)
+    {
+        connP[i] = prv_loopback();
+        CU_ASSERT_PTR_NOT_NULL_FATAL(connP[i]);
+        server[i].status = STATE_REGISTERED;
+        server[i].sessionH = connP[i];
+        server[i].shortID = (uint16_t)i;
+        server[i].next = (i == 0 ? &server[1] : NULL);
+    }
+    contextP->serverList = server;
+
+    prv_observe(contextP, connP[0], "/1024/0/0", 1, LWM2M_CONTENT_TEXT);
+    prv_observe(contextP, connP[1], "/1024/0/0", 2, LWM2M_CONTENT_TLV);
+    count = callbackCount;
+
+    // the resource is read once and serialized once per format
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/1024/0/0", 9, &uri), 9);
+    lwm2m_resource_value_changed(contextP, &uri);
+    timeout = 60;
+    observe_step(contextP, utils_getTime(), &timeout);
+    CU_ASSERT_EQUAL(callbackCount, count + 1);
+
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP[0], notification));
+    CU_ASSERT_EQUAL((lwm2m_media_type_t)notification->content_type, LWM2M_CONTENT_TEXT);
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP[1], notification));
+    CU_ASSERT_EQUAL((lwm2m_media_type_t)notification->content_type, LWM2M_CONTENT_TLV);
+
+    for (i = 0; i < 2; i++)
+    {
+        dedup_free(server[i].dedupData);
+        close(connP[i]->sock);
+        connection_free(connP[i]);
+    }
+    contextP->serverList = NULL;
+    contextP->objectList = NULL;
+    lwm2m_close(contextP);
+}
+
+static void test_observe_confirmable(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    connection_t * connP = prv_loopback();
+    lwm2m_object_t object;
+    lwm2m_list_t instance;
+    lwm2m_server_t server;
+    coap_packet_t notification[1];
+    coap_packet_t ack[1];
+    uint8_t buffer[16];
+    size_t length;
+    lwm2m_uri_t uri;
+    time_t timeout;
+    int64_t timeoutMs;
+    int count;
+    int i;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(connP);
+    memset(&object, 0, sizeof(object));
+    memset(&instance, 0, sizeof(instance));
+    memset(&server, 0, sizeof(server));
+    object.objID = 1024;
+    object.instanceList = &instance;
+    object.readFunc = prv_readCounter;
+    CU_ASSERT_EQUAL(lwm2m_add_object(contextP, &object), 0);
+    server.status = STATE_REGISTERED;
+    server.sessionH = connP;
+    contextP->serverList = &server;
+    lwm2m_set_confirmable_notifications(contextP, true);
+
+    prv_observe(contextP, connP, "/1024/0/0", 1, LWM2M_CONTENT_TLV);
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/1024/0/0", 9, &uri), 9);
+    timeout = 60;
+
+    lwm2m_resource_value_changed(contextP, &uri);
+    observe_step(contextP, utils_getTime(), &timeout);
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, notification));
+    CU_ASSERT_EQUAL(notification->type, COAP_TYPE_CON);
+    CU_ASSERT_TRUE(server.notifyPending);
+
+    // held until the notification in flight is acknowledged
+    count = callbackCount;
+    lwm2m_resource_value_changed(contextP, &uri);
+    lwm2m_resource_value_changed(contextP, &uri);
+    observe_step(contextP, utils_getTime(), &timeout);
+    CU_ASSERT_EQUAL(callbackCount, count);
+
+    coap_init_message(ack, COAP_TYPE_ACK, 0, notification->mid);
+    length = coap_serialize_message(ack, buffer);
+    lwm2m_handle_packet(contextP, buffer, (int)length, connP);
+    CU_ASSERT_FALSE(server.notifyPending);
+    observe_step(contextP, utils_getTime(), &timeout);
+    CU_ASSERT_EQUAL(callbackCount, count + 1);
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, notification));
+    CU_ASSERT_EQUAL(notification->type, COAP_TYPE_CON);
+
+    // not acknowledged: the observation is cancelled
+    for (i = 1; i <= COAP_MAX_RETRANSMIT + 2; i++)
+    {
+        timeoutMs = 0;
+        transaction_step(contextP, utils_getTimeMs() + (int64_t)i * 100000, &timeoutMs);
+    }
+    CU_ASSERT_PTR_NULL(contextP->transactionList);
+    CU_ASSERT_PTR_NULL(contextP->observedList);
+    CU_ASSERT_FALSE(server.notifyPending);
+
+    dedup_free(server.dedupData);
+    contextP->serverList = NULL;
+    contextP->objectList = NULL;
+    lwm2m_close(contextP);
+    close(connP->sock);
+    connection_free(connP);
+}
+
+static void test_observe_queue_mode(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    connection_t * connP = prv_loopback();
+    lwm2m_object_t object;
+    lwm2m_list_t instances[2];
+    lwm2m_server_t server;
+    coap_packet_t notification[1];
+    coap_packet_t reset[1];
+    uint8_t buffer[16];
+    size_t length;
+    lwm2m_uri_t uri[2];
+    time_t now;
+    time_t timeout;
+    uint32_t counter;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(connP);
+    memset(&object, 0, sizeof(object));
+    memset(instances, 0, sizeof(instances));
+    memset(&server, 0, sizeof(server));
+    instances[0].next = &instances[1];
+    instances[1].id = 1;
+    object.objID = 1024;
+    object.instanceList = instances;
+    object.readFunc = prv_readCounter;
+    CU_ASSERT_EQUAL(lwm2m_add_object(contextP, &object), 0);
+    server.status = STATE_REGISTERED;
+    server.sessionH = connP;
+    server.binding = BINDING_UQ;
+    contextP->serverList = &server;
+
+    prv_observe(contextP, connP, "/1024/0/0", 1, LWM2M_CONTENT_TLV);
+    prv_observe(contextP, connP, "/1024/1/0", 2, LWM2M_CONTENT_TLV);
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/1024/0/0", 9, uri), 9);
+    CU_ASSERT_EQUAL(lwm2m_stringToUri("/1024/1/0", 9, uri + 1), 9);
+    now = utils_getTime();
+    timeout = 60;
+
+    // only the latest notification of each observation is held
+    lwm2m_resource_value_changed(contextP, uri);
+    observe_step(contextP, now, &timeout);
+    lwm2m_resource_value_changed(contextP, uri + 1);
+    observe_step(contextP, now, &timeout);
+    lwm2m_resource_value_changed(contextP, uri);
+    observe_step(contextP, now, &timeout);
+    CU_ASSERT_EQUAL(server.queueCount, 2);
+    counter = server.queue[server.queueFirst].counter;
+
+    // with the history, all of them are
+    lwm2m_set_queue_history(contextP, true);
+    lwm2m_resource_value_changed(contextP, uri);
+    observe_step(contextP, now, &timeout);
+    CU_ASSERT_EQUAL(server.queueCount, 3);
+
+    // not sent until the server can reach the client
+    observe_flushQueue(contextP, &server, now);
+    CU_ASSERT_EQUAL(server.queueCount, 3);
+    server.awakeUntil = now + 10;
+    observe_flushQueue(contextP, &server, now);
+    CU_ASSERT_EQUAL(server.queueCount, 0);
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, notification));
+    CU_ASSERT_EQUAL(notification->token_len, 2);
+    CU_ASSERT_EQUAL(memcmp(notification->token, "\x01\x00", 2), 0);
+    CU_ASSERT_EQUAL(notification->observe, counter);
+    CU_ASSERT_TRUE(prv_receive(connP, notification));
+    CU_ASSERT_TRUE(prv_receive(connP, notification));
+    CU_ASSERT_EQUAL(notification->observe, counter + 1);
+
+    // sent right away while the client is reachable
+    lwm2m_resource_value_changed(contextP, uri);
+    observe_step(contextP, now, &timeout);
+    CU_ASSERT_EQUAL(server.queueCount, 0);
+    CU_ASSERT_TRUE(prv_receive(connP, notification));
+
+    lwm2m_resource_value_changed(contextP, uri);
+    observe_step(contextP, now + 10, &timeout);
+    CU_ASSERT_EQUAL(server.queueCount, 1);
+
+    // the notifications of a cancelled observation are dropped
+    lwm2m_resource_value_changed(contextP, uri + 1);
+    observe_step(contextP, now + 10, &timeout);
+    CU_ASSERT_EQUAL(server.queueCount, 2);
+    observe_clear(contextP, uri);
+    CU_ASSERT_EQUAL_FATAL(server.queueCount, 1);
+    CU_ASSERT_EQUAL(server.queue[server.queueFirst].token[0], 2);
+
+    // a reset to a flushed notification cancels the observation
+    observe_flushQueue(contextP, &server, now);
+    CU_ASSERT_TRUE_FATAL(prv_receive(connP, notification));
+    coap_init_message(reset, COAP_TYPE_RST, 0, notification->mid);
+    length = coap_serialize_message(reset, buffer);
+    lwm2m_handle_packet(contextP, buffer, (int)length, connP);
+    CU_ASSERT_PTR_NULL(contextP->observedList);
+
+    observe_freeQueue(&server);
+    dedup_free(server.dedupData);
+    contextP->serverList = NULL;
+    contextP->objectList = NULL;
+    lwm2m_close(contextP);
+    close(connP->sock);
+    connection_free(connP);
+}
+
+static struct TestTable table[] = {
+        { "test of lwm2m_dm_read() with a Block2 response", test_dm_read_block2 },
+        { "test of the Block2 reassembly limit", test_dm_read_block2_limit },
+        { "test of lwm2m_dm_write() with a Block1 request", test_dm_write_block1 },
+        { "test of lwm2m_dm_read_if_changed()", test_dm_read_if_changed },
+        { "test of ETags of client read responses", test_dm_etag },
+        { "test of the deduplication of retransmitted requests", test_dm_duplicate },
+        { "test of observe_step() scheduling", test_observe_step },
+        { "test of the observation index", test_observe_index },
+        { "test of notifications in several formats", test_observe_formats },
+        { "test of confirmable notifications", test_observe_confirmable },
+        { "test of the notifications held in queue mode", test_observe_queue_mode },
+        { NULL, NULL },
+};
+
+CU_ErrorCode create_management_suit()
+{
+   CU_pSuite pSuite = NULL;
+
+   pSuite = CU_add_suite("Suite_management", NULL, NULL);
+   if (NULL == pSuite) {
+      return CU_get_error();
+   }
+
+   return add_tests(pSuite, table);
+}
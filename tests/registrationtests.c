@@ -0,0 +1,186 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include "tests.h"
+#include "CUnit/Basic.h"
+#include "internals.h"
+#include "liblwm2m.h"
+
+#define CLIENT_COUNT 300
+
+static int peer;
+
+static coap_status_t prv_register(lwm2m_context_t * contextP,
+                                  const char * name,
+                                  int lifetime)
+{
+    coap_packet_t message[1];
+    coap_packet_t response[1];
+    lwm2m_uri_t uri;
+    char query[64];
+    coap_status_t result;
+
+    snprintf(query, sizeof(query), "ep=%s&lwm2m=1.0&lt=%d", name, lifetime);
+    coap_init_message(message, COAP_TYPE_CON, COAP_POST, 1);
+    coap_set_header_uri_query(message, query);
+    coap_set_header_content_type(message, LWM2M_CONTENT_LINK);
+    coap_set_payload(message, "</1/0>,</3/0>", 13);
+    coap_init_message(response, COAP_TYPE_ACK, 0, 1);
+
+    memset(&uri, 0, sizeof(uri));
+    uri.flag = LWM2M_URI_FLAG_REGISTRATION;
+
+    result = registration_handleRequest(contextP, &uri, &peer, message, response);
+    coap_free_header(message);
+    coap_free_header(response);
+
+    return result;
+}
+
+static coap_status_t prv_deregister(lwm2m_context_t * contextP,
+                                    uint16_t clientID)
+{
+    coap_packet_t message[1];
+    coap_packet_t response[1];
+    lwm2m_uri_t uri;
+
+    coap_init_message(message, COAP_TYPE_CON, COAP_DELETE, 1);
+    coap_init_message(response, COAP_TYPE_ACK, 0, 1);
+
+    memset(&uri, 0, sizeof(uri));
+    uri.flag = LWM2M_URI_FLAG_REGISTRATION | LWM2M_URI_FLAG_OBJECT_ID;
+    uri.objectId = clientID;
+
+    return registration_handleRequest(contextP, &uri, &peer, message, response);
+}
+
+static void test_registration_lookup(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    uint16_t ids[CLIENT_COUNT];
+    char name[16];
+    lwm2m_client_t * clientP;
+    int i;
+
+    for (i = 0 ; i < CLIENT_COUNT ; i++)
+    {
+        snprintf(name, sizeof(name), "client%d", i);
+        CU_ASSERT_EQUAL(prv_register(contextP, name, 300), COAP_201_CREATED);
+        clientP = lwm2m_get_client_by_name(contextP, name);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(clientP);
+        ids[i] = clientP->internalID;
+    }
+    CU_ASSERT_EQUAL(contextP->clientCount, CLIENT_COUNT);
+
+    for (i = 0 ; i < CLIENT_COUNT ; i++)
+    {
+        snprintf(name, sizeof(name), "client%d", i);
+        clientP = lwm2m_get_client(contextP, ids[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(clientP);
+        CU_ASSERT_STRING_EQUAL(clientP->name, name);
+    }
+    CU_ASSERT_PTR_NULL(lwm2m_get_client_by_name(contextP, "unknown"));
+
+    // registering again keeps the internal ID
+    CU_ASSERT_EQUAL(prv_register(contextP, "client7", 300), COAP_201_CREATED);
+    CU_ASSERT_EQUAL(lwm2m_get_client_by_name(contextP, "client7")->internalID, ids[7]);
+    CU_ASSERT_EQUAL(contextP->clientCount, CLIENT_COUNT);
+
+    for (i = 0 ; i < CLIENT_COUNT ; i += 2)
+    {
+        CU_ASSERT_EQUAL(prv_deregister(contextP, ids[i]), COAP_202_DELETED);
+    }
+    CU_ASSERT_EQUAL(prv_deregister(contextP, ids[0]), COAP_400_BAD_REQUEST);
+    CU_ASSERT_EQUAL(contextP->clientCount, CLIENT_COUNT / 2);
+
+    for (i = 0 ; i < CLIENT_COUNT ; i++)
+    {
+        snprintf(name, sizeof(name), "client%d", i);
+        if (i % 2 == 0)
+        {
+            CU_ASSERT_PTR_NULL(lwm2m_get_client(contextP, ids[i]));
+            CU_ASSERT_PTR_NULL(lwm2m_get_client_by_name(contextP, name));
+        }
+        else
+        {
+            CU_ASSERT_PTR_EQUAL(lwm2m_get_client(contextP, ids[i]), lwm2m_get_client_by_name(contextP, name));
+        }
+    }
+
+    i = 0;
+    for (clientP = contextP->clientList ; clientP != NULL ; clientP = clientP->next) i++;
+    CU_ASSERT_EQUAL(i, CLIENT_COUNT / 2);
+
+    lwm2m_close(contextP);
+}
+
+static void test_registration_expiry(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    char name[16];
+    time_t now;
+    time_t timeout;
+    int i;
+
+    // lifetimes 100, 90, ..., 10 seconds
+    for (i = 0 ; i < 10 ; i++)
+    {
+        snprintf(name, sizeof(name), "client%d", i);
+        CU_ASSERT_EQUAL(prv_register(contextP, name, 100 - 10 * i), COAP_201_CREATED);
+    }
+    now = utils_getTime();
+
+    timeout = 1000;
+    registration_step(contextP, now, &timeout);
+    CU_ASSERT_EQUAL(contextP->clientCount, 10);
+    CU_ASSERT_TRUE(timeout >= 9 && timeout <= 10);
+
+    timeout = 1000;
+    registration_step(contextP, now + 35, &timeout);
+    CU_ASSERT_EQUAL(contextP->clientCount, 7);
+    CU_ASSERT_PTR_NULL(lwm2m_get_client_by_name(contextP, "client9"));
+    CU_ASSERT_PTR_NOT_NULL(lwm2m_get_client_by_name(contextP, "client6"));
+    CU_ASSERT_TRUE(timeout >= 4 && timeout <= 5);
+
+    // a new registration restarts the lifetime
+    CU_ASSERT_EQUAL(prv_register(contextP, "client6", 200), COAP_201_CREATED);
+
+    timeout = 1000;
+    registration_step(contextP, now + 150, &timeout);
+    CU_ASSERT_EQUAL(contextP->clientCount, 1);
+    CU_ASSERT_PTR_NOT_NULL(lwm2m_get_client_by_name(contextP, "client6"));
+    CU_ASSERT_TRUE(timeout >= 49 && timeout <= 50);
+
+    lwm2m_close(contextP);
+}
+
+static struct TestTable table[] = {
+        { "test of test_registration_lookup()", test_registration_lookup },
+        { "test of test_registration_expiry()", test_registration_expiry },
+        { NULL, NULL },
+};
+
+CU_ErrorCode create_registration_suit() {
+    CU_pSuite pSuite = NULL;
+    pSuite = CU_add_suite("Suite_registration", NULL, NULL);
+
+    if (NULL == pSuite) {
+        return CU_get_error();
+    }
+    return add_tests(pSuite, table);
+}
@@ -32,5 +32,9 @@ CU_ErrorCode create_object_read_suit();
 CU_ErrorCode create_convert_numbers_suit();
 CU_ErrorCode create_tlv_json_suit();
 CU_ErrorCode create_block1_suit();
+CU_ErrorCode create_block2_suit();
+CU_ErrorCode create_transaction_suit();
+CU_ErrorCode create_registration_suit();
+CU_ErrorCode create_management_suit();
 
 #endif /* TESTS_H_ */
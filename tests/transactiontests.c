@@ -0,0 +1,215 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2017 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Please refer to git log
+ *
+ *******************************************************************************/
+
+#include "tests.h"
+#include "CUnit/Basic.h"
+#include "internals.h"
+#include "liblwm2m.h"
+
+static int peerA;
+static int peerB;
+
+static int callbackCount;
+static lwm2m_transaction_t * lastTransaction;
+
+static void prv_callback(lwm2m_transaction_t * transacP,
+                         void * message)
+{
+    (void)message;
+    callbackCount++;
+    lastTransaction = transacP;
+}
+
+static lwm2m_transaction_t * prv_add(lwm2m_context_t * contextP,
+                                     void * sessionH,
+                                     uint16_t mID,
+                                     uint8_t * token)
+{
+    lwm2m_transaction_t * transacP;
+
+    transacP = transaction_new(sessionH, COAP_GET, NULL, NULL, mID, token == NULL ? 0 : 4, token);
+    CU_ASSERT_PTR_NOT_NULL(transacP);
+    if (transacP == NULL) return NULL;
+    transacP->callback = prv_callback;
+    transaction_add(contextP, transacP);
+
+    return transacP;
+}
+
+static bool prv_receive(lwm2m_context_t * contextP,
+                        void * sessionH,
+                        coap_message_type_t type,
+                        uint16_t mID,
+                        uint8_t * token)
+{
+    coap_packet_t message[1];
+
+    coap_init_message(message, type, COAP_205_CONTENT, mID);
+    if (token != NULL) coap_set_header_token(message, token, 4);
+
+    return transaction_handleResponse(contextP, sessionH, message, NULL);
+}
+
+static void test_transaction_ack(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    lwm2m_transaction_t * first;
+    lwm2m_transaction_t * second;
+
+    callbackCount = 0;
+    first = prv_add(contextP, &peerA, 10, NULL);
+    second = prv_add(contextP, &peerA, 11, NULL);
+
+    // wrong peer
+    CU_ASSERT_FALSE(prv_receive(contextP, &peerB, COAP_TYPE_ACK, 10, NULL));
+    CU_ASSERT_EQUAL(callbackCount, 0);
+
+    CU_ASSERT_TRUE(prv_receive(contextP, &peerA, COAP_TYPE_ACK, 10, NULL));
+    CU_ASSERT_EQUAL(callbackCount, 1);
+    CU_ASSERT_PTR_EQUAL(lastTransaction, first);
+    CU_ASSERT_PTR_EQUAL(contextP->transactionList, second);
+    CU_ASSERT_PTR_NULL(second->next);
+
+    // duplicate ACK
+    CU_ASSERT_FALSE(prv_receive(contextP, &peerA, COAP_TYPE_ACK, 10, NULL));
+
+    CU_ASSERT_TRUE(prv_receive(contextP, &peerA, COAP_TYPE_RST, 11, NULL));
+    CU_ASSERT_EQUAL(callbackCount, 2);
+    CU_ASSERT_PTR_NULL(contextP->transactionList);
+
+    lwm2m_close(contextP);
+}
+
+static void test_transaction_separate_response(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    lwm2m_transaction_t * transacP;
+    uint8_t tokenA[] = { 1, 2, 3, 4 };
+    uint8_t tokenB[] = { 5, 6, 7, 8 };
+
+    callbackCount = 0;
+    transacP = prv_add(contextP, &peerA, 20, tokenA);
+    prv_add(contextP, &peerB, 21, tokenB);
+
+    // empty ACK: transaction waits for the separate response
+    CU_ASSERT_TRUE(prv_receive(contextP, &peerA, COAP_TYPE_ACK, 20, NULL));
+    CU_ASSERT_EQUAL(callbackCount, 0);
+    CU_ASSERT_TRUE(transacP->ack_received);
+
+    // token of another peer
+    CU_ASSERT_FALSE(prv_receive(contextP, &peerA, COAP_TYPE_CON, 100, tokenB));
+
+    CU_ASSERT_TRUE(prv_receive(contextP, &peerA, COAP_TYPE_CON, 101, tokenA));
+    CU_ASSERT_EQUAL(callbackCount, 1);
+    CU_ASSERT_PTR_EQUAL(lastTransaction, transacP);
+
+    // piggybacked response
+    CU_ASSERT_TRUE(prv_receive(contextP, &peerB, COAP_TYPE_ACK, 21, tokenB));
+    CU_ASSERT_EQUAL(callbackCount, 2);
+    CU_ASSERT_PTR_NULL(contextP->transactionList);
+
+    lwm2m_close(contextP);
+}
+
+static void test_transaction_many(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    int i;
+
+    callbackCount = 0;
+    for (i = 0 ; i < 4 * LWM2M_TRANSACTION_HASH_SIZE ; i++)
+    {
+        prv_add(contextP, (i & 1) ? &peerA : &peerB, (uint16_t)i, NULL);
+    }
+    for (i = 4 * LWM2M_TRANSACTION_HASH_SIZE - 1 ; i >= 0 ; i -= 2)
+    {
+        CU_ASSERT_TRUE(prv_receive(contextP, (i & 1) ? &peerA : &peerB, COAP_TYPE_ACK, (uint16_t)i, NULL));
+    }
+    for (i = 0 ; i < 4 * LWM2M_TRANSACTION_HASH_SIZE ; i += 2)
+    {
+        CU_ASSERT_TRUE(prv_receive(contextP, (i & 1) ? &peerA : &peerB, COAP_TYPE_ACK, (uint16_t)i, NULL));
+    }
+    CU_ASSERT_EQUAL(callbackCount, 4 * LWM2M_TRANSACTION_HASH_SIZE);
+    CU_ASSERT_PTR_NULL(contextP->transactionList);
+
+    lwm2m_close(contextP);
+}
+
+static void test_transaction_schedule(void)
+{
+    lwm2m_context_t * contextP = lwm2m_init(NULL);
+    lwm2m_transaction_t * transacP[4];
+    time_t timeouts[4] = { 20, 5, 40, 10 };
+    uint8_t token[] = { 1, 2, 3, 4 };
+    int64_t now;
+    int64_t timeout;
+    int i;
+
+    callbackCount = 0;
+    for (i = 0 ; i < 4 ; i++)
+    {
+        token[0] = (uint8_t)i;
+        transacP[i] = prv_add(contextP, &peerA, (uint16_t)(30 + i), token);
+        transacP[i]->response_timeout = timeouts[i];
+        // empty ACK: wait response_timeout seconds for the separate response
+        CU_ASSERT_TRUE(prv_receive(contextP, &peerA, COAP_TYPE_ACK, (uint16_t)(30 + i), NULL));
+    }
+    now = utils_getTimeMs();
+
+    timeout = 60000;
+    transaction_step(contextP, now, &timeout);
+    CU_ASSERT_EQUAL(callbackCount, 0);
+    CU_ASSERT_TRUE(timeout >= 4000 && timeout <= 5000);
+
+    timeout = 60000;
+    transaction_step(contextP, now + 15000, &timeout);
+    CU_ASSERT_EQUAL(callbackCount, 2);
+    CU_ASSERT_EQUAL(timeout, 1000);
+    CU_ASSERT_PTR_EQUAL(lastTransaction, transacP[3]);
+
+    timeout = 60000;
+    transaction_step(contextP, now + 16000, &timeout);
+    CU_ASSERT_EQUAL(callbackCount, 2);
+    CU_ASSERT_TRUE(timeout >= 4000 && timeout <= 5000);
+
+    timeout = 60000;
+    transaction_step(contextP, now + 100000, &timeout);
+    CU_ASSERT_EQUAL(callbackCount, 4);
+    CU_ASSERT_PTR_EQUAL(lastTransaction, transacP[2]);
+    CU_ASSERT_PTR_NULL(contextP->transactionList);
+    CU_ASSERT_PTR_NULL(contextP->transactionHeap);
+
+    lwm2m_close(contextP);
+}
+
+static struct TestTable table[] = {
+        { "test of test_transaction_ack()", test_transaction_ack },
+        { "test of test_transaction_separate_response()", test_transaction_separate_response },
+        { "test of test_transaction_many()", test_transaction_many },
+        { "test of test_transaction_schedule()", test_transaction_schedule },
+        { NULL, NULL },
+};
+
+CU_ErrorCode create_transaction_suit() {
+    CU_pSuite pSuite = NULL;
+    pSuite = CU_add_suite("Suite_transaction", NULL, NULL);
+
+    if (NULL == pSuite) {
+        return CU_get_error();
+    }
+    return add_tests(pSuite, table);
+}
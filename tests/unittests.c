@@ -69,6 +69,18 @@ int main()
    if (CUE_SUCCESS != create_block1_suit()) {
        goto exit;
    }
+   if (CUE_SUCCESS != create_block2_suit()) {
+       goto exit;
+   }
+   if (CUE_SUCCESS != create_transaction_suit()) {
+       goto exit;
+   }
+   if (CUE_SUCCESS != create_registration_suit()) {
+       goto exit;
+   }
+   if (CUE_SUCCESS != create_management_suit()) {
+       goto exit;
+   }
 
    CU_basic_set_mode(CU_BRM_VERBOSE);
    CU_basic_run_tests();
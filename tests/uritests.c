@@ -144,9 +144,76 @@ static void test_string_to_uri(void)
     MEMORY_TRACE_AFTER_EQ;
 }
 
+static void test_uri_decode_parsed(void)
+{
+    coap_packet_t request[1];
+    coap_packet_t parsed[1];
+    coap_option_views_t views;
+    uint8_t buffer[64];
+    size_t length;
+    lwm2m_uri_t* uri;
+
+    coap_init_message(request, COAP_TYPE_CON, COAP_GET, 1);
+    coap_set_header_uri_path(request, "/3/0/1");
+    coap_set_header_uri_query(request, "pmin=10");
+    length = coap_serialize_message(request, buffer);
+    CU_ASSERT_TRUE_FATAL(length > 0);
+
+    MEMORY_TRACE_BEFORE;
+
+    CU_ASSERT_EQUAL(coap_parse_message_views(parsed, buffer, (uint16_t)length, &views), NO_ERROR);
+    CU_ASSERT_EQUAL(views.count, 4);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parsed->uri_path);
+    CU_ASSERT_EQUAL(parsed->uri_path->is_static, 2);
+    CU_ASSERT_TRUE(parsed->uri_path->data > buffer && parsed->uri_path->data < buffer + length);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parsed->uri_query);
+    CU_ASSERT_EQUAL(parsed->uri_query->len, 7);
+    CU_ASSERT_PTR_NULL(parsed->uri_query->next);
+    coap_free_header(parsed);
+
+    MEMORY_TRACE_AFTER_EQ;
+
+    CU_ASSERT_EQUAL(coap_parse_message_views(parsed, buffer, (uint16_t)length, &views), NO_ERROR);
+    uri = uri_decode(NULL, parsed->uri_path);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(uri);
+    CU_ASSERT_EQUAL(uri->objectId, 3);
+    CU_ASSERT_EQUAL(uri->instanceId, 0);
+    CU_ASSERT_EQUAL(uri->resourceId, 1);
+    lwm2m_free(uri);
+    coap_free_header(parsed);
+}
+
+static void test_serialize_bounded(void)
+{
+    coap_packet_t request[1];
+    coap_packet_t parsed[1];
+    uint8_t buffer[64];
+    uint8_t payload[32];
+    size_t length;
+
+    memset(payload, 0x55, sizeof(payload));
+    coap_init_message(request, COAP_TYPE_CON, COAP_POST, 2);
+    coap_set_header_uri_path(request, "/3/0/1");
+    coap_set_payload(request, payload, sizeof(payload));
+
+    // too small: nothing is released so that the caller can retry
+    CU_ASSERT_EQUAL(coap_serialize_message_bounded(request, buffer, 40), 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(request->uri_path);
+
+    length = coap_serialize_message_bounded(request, buffer, sizeof(buffer));
+    CU_ASSERT_TRUE_FATAL(length > 40 && length <= sizeof(buffer));
+
+    CU_ASSERT_EQUAL(coap_parse_message(parsed, buffer, (uint16_t)length), NO_ERROR);
+    CU_ASSERT_EQUAL(parsed->payload_len, sizeof(payload));
+    CU_ASSERT_EQUAL(memcmp(parsed->payload, payload, sizeof(payload)), 0);
+    coap_free_header(parsed);
+}
+
 static struct TestTable table[] = {
         { "test of uri_decode()", test_uri_decode },
+        { "test of uri_decode() on a parsed message", test_uri_decode_parsed },
         { "test of lwm2m_stringToUri()", test_string_to_uri },
+        { "test of coap_serialize_message_bounded()", test_serialize_bounded },
         { NULL, NULL },
 };
 